@@ -0,0 +1,152 @@
+#include "CgroupListener.h"
+
+#include "common/Exception.h"
+#include "common/FD.h"
+#include "common/Utils.h"
+#include "common/WithErrnoCheck.h"
+#include "logger/Logger.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+namespace {
+
+void writeCgroupFile(
+        const std::string& path,
+        const std::string& value,
+        bool required = true) {
+    if (!required && access(path.c_str(), F_OK) < 0) {
+        s2j::logger::debug("Skipping not existing cgroup file ", path);
+        return;
+    }
+
+    // Cgroup files are parsed on each write, so value has to be written at
+    // once.
+    s2j::FD fd = s2j::FD::open(path, O_WRONLY | O_CLOEXEC);
+    s2j::withErrnoCheck(
+            "write " + value + " to " + path,
+            write,
+            static_cast<int>(fd),
+            value.c_str(),
+            value.size());
+}
+
+} // namespace
+
+namespace s2j {
+namespace cgroup {
+
+CgroupListener::CgroupListener(std::string parentPath)
+        : parentPath_(std::move(parentPath)) {
+    TRACE(parentPath_);
+}
+
+CgroupListener::~CgroupListener() {
+    if (procsFd_ >= 0) {
+        close(procsFd_);
+    }
+    // All processes are reaped by now, so group can be removed.
+    if (!path_.empty() && rmdir(path_.c_str()) < 0) {
+        logger::warn("Can't remove cgroup ", path_, ": ", strerror(errno));
+    }
+}
+
+void CgroupListener::requireController(const std::string& controller) {
+    controllers_.insert(controller);
+}
+
+void CgroupListener::setValue(
+        const std::string& file,
+        const std::string& value,
+        bool required) {
+    values_.push_back(Value{file, value, required});
+}
+
+void CgroupListener::onPreFork() {
+    TRACE();
+
+    enableControllers();
+
+    path_ = createTemporaryDirectory(parentPath_ + "/sio2jail-XXXXXX");
+    logger::debug("Created cgroup ", VAR(path_));
+
+    for (const auto& value: values_) {
+        writeCgroupFile(path_ + "/" + value.file, value.value, value.required);
+    }
+
+    procsFd_ = withErrnoCheck(
+            "open " + path_ + "/cgroup.procs",
+            open,
+            (path_ + "/cgroup.procs").c_str(),
+            O_WRONLY | O_CLOEXEC);
+}
+
+void CgroupListener::onPostForkChild() {
+    TRACE();
+
+    // Writing 0 moves the writing process. Fd was opened before fork, so
+    // this works even after namespaces are unshared.
+    withErrnoCheck("join cgroup " + path_, write, procsFd_, "0", 1);
+    withErrnoCheck("close", close, procsFd_);
+    procsFd_ = -1;
+}
+
+void CgroupListener::onPostForkParent(pid_t /* childPid */) {
+    TRACE();
+
+    withErrnoCheck("close", close, procsFd_);
+    procsFd_ = -1;
+}
+
+uint64_t CgroupListener::readValue(const std::string& file) const {
+    std::ifstream stream(path_ + "/" + file);
+    uint64_t value;
+    if (!(stream >> value)) {
+        throw SystemException("Error reading " + path_ + "/" + file);
+    }
+    return value;
+}
+
+std::map<std::string, uint64_t> CgroupListener::readKeys(
+        const std::string& file) const {
+    std::ifstream stream(path_ + "/" + file);
+    if (!stream.good()) {
+        throw SystemException("Error reading " + path_ + "/" + file);
+    }
+
+    std::map<std::string, uint64_t> values;
+    std::string key;
+    uint64_t value;
+    while (stream >> key >> value) {
+        values[key] = value;
+    }
+    return values;
+}
+
+void CgroupListener::enableControllers() {
+    std::ifstream subtreeControl(parentPath_ + "/cgroup.subtree_control");
+    if (!subtreeControl.good()) {
+        throw SystemException(
+                "Error reading " + parentPath_ + "/cgroup.subtree_control");
+    }
+
+    std::set<std::string> enabled;
+    std::string controller;
+    while (subtreeControl >> controller) {
+        enabled.insert(controller);
+    }
+
+    for (const auto& controller: controllers_) {
+        if (enabled.count(controller) == 0) {
+            writeCgroupFile(
+                    parentPath_ + "/cgroup.subtree_control", "+" + controller);
+        }
+    }
+}
+
+} // namespace cgroup
+} // namespace s2j
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "executor/ExecuteEventListener.h"
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace s2j {
+namespace cgroup {
+
+/**
+ * Creates a cgroup v2 group for a single run and moves child into it just
+ * after fork. Other listeners request controllers and limits before fork and
+ * read group's statistics afterwards.
+ */
+class CgroupListener : public executor::ExecuteEventListener {
+public:
+    /**
+     * Per-run groups are created inside parentPath, which has to be a
+     * delegated cgroup v2 directory without processes of its own.
+     */
+    CgroupListener(std::string parentPath);
+    ~CgroupListener();
+
+    /**
+     * Enables given controller for the per-run group.
+     */
+    void requireController(const std::string& controller);
+
+    /**
+     * Writes value to group's file before child is moved into it. Values of
+     * not required files are skipped when kernel doesn't provide the file.
+     */
+    void setValue(
+            const std::string& file,
+            const std::string& value,
+            bool required = true);
+
+    void onPreFork() override;
+    void onPostForkChild() override;
+    void onPostForkParent(pid_t childPid) override;
+
+    /**
+     * Reads single value file, i.e. memory.peak.
+     */
+    uint64_t readValue(const std::string& file) const;
+
+    /**
+     * Reads flat keyed file, i.e. cpu.stat.
+     */
+    std::map<std::string, uint64_t> readKeys(const std::string& file) const;
+
+private:
+    struct Value {
+        std::string file;
+        std::string value;
+        bool required;
+    };
+
+    void enableControllers();
+
+    std::string parentPath_;
+    std::string path_;
+
+    std::set<std::string> controllers_;
+    std::vector<Value> values_;
+
+    int procsFd_{-1};
+};
+
+} // namespace cgroup
+} // namespace s2j
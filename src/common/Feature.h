@@ -6,6 +6,7 @@ enum class Feature {
     PTRACE,
     PERF,
     SECCOMP,
+    SECCOMP_NOTIFY,
     PID_NAMESPACE,
     NET_NAMESPACE,
     IPC_NAMESPACE,
@@ -14,6 +15,7 @@ enum class Feature {
     MOUNT_NAMESPACE,
     MOUNT_PROCFS,
     CAPABILITY_DROP,
+    CPU_CLOCK_TIMER,
     FAKE_TIME
 };
 
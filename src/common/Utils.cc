@@ -1,13 +1,18 @@
 #include "Utils.h"
 #include "Exception.h"
+#include "FD.h"
 #include "WithErrnoCheck.h"
 
 #include <algorithm>
+#include <cctype>
 #include <cstdlib>
 #include <fstream>
 
+#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 namespace s2j {
 
@@ -34,6 +39,52 @@ std::vector<std::string> split(
     return tokens;
 }
 
+std::vector<std::string> splitArguments(const std::string& line) {
+    std::vector<std::string> arguments;
+    std::string argument;
+    bool inArgument = false;
+    char quote = '\0';
+
+    for (size_t pos = 0; pos < line.size(); ++pos) {
+        char character = line[pos];
+        if (character == '\\' && quote != '\'' && pos + 1 < line.size()) {
+            argument += line[++pos];
+            inArgument = true;
+        }
+        else if (quote != '\0') {
+            if (character == quote) {
+                quote = '\0';
+            }
+            else {
+                argument += character;
+            }
+        }
+        else if (character == '\'' || character == '"') {
+            quote = character;
+            inArgument = true;
+        }
+        else if (isspace(static_cast<unsigned char>(character)) != 0) {
+            if (inArgument) {
+                arguments.emplace_back(std::move(argument));
+                argument.clear();
+                inArgument = false;
+            }
+        }
+        else {
+            argument += character;
+            inArgument = true;
+        }
+    }
+
+    if (quote != '\0') {
+        throw Exception("Unterminated quote in: " + line);
+    }
+    if (inArgument) {
+        arguments.emplace_back(std::move(argument));
+    }
+    return arguments;
+}
+
 std::string createTemporaryDirectory(const std::string& directoryTemplate) {
     char directory[directoryTemplate.size() + 1];
     strncpy(directory, directoryTemplate.c_str(), sizeof(directory));
@@ -44,6 +95,47 @@ std::string createTemporaryDirectory(const std::string& directoryTemplate) {
     return directory;
 }
 
+void removeTemporaryDirectory(const std::string& path) {
+    DIR* directory = opendir(path.c_str());
+    if (directory == nullptr) {
+        throw SystemException("opendir failed");
+    }
+    while (struct dirent* entry = readdir(directory)) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") {
+            unlink((path + "/" + name).c_str());
+        }
+    }
+    closedir(directory);
+    withErrnoCheck("rmdir " + path, rmdir, path.c_str());
+}
+
+void writeFileAtomically(const std::string& path, const std::string& content) {
+    // Written under a temporary name in the same directory and renamed, as
+    // concurrent runs may race to create the same file.
+    std::string temporaryPath = path + ".XXXXXX";
+    try {
+        FD file(withErrnoCheck(
+                        "create " + path,
+                        mkostemp,
+                        &temporaryPath[0],
+                        O_CLOEXEC),
+                true);
+        withErrnoCheck("chmod " + temporaryPath, fchmod, file, 0644);
+        file.write(content, false);
+        file.close();
+        withErrnoCheck(
+                "rename " + temporaryPath,
+                rename,
+                temporaryPath.c_str(),
+                path.c_str());
+    }
+    catch (const SystemException&) {
+        unlink(temporaryPath.c_str());
+        throw;
+    }
+}
+
 bool checkKernelVersion(int major, int minor) {
     std::ifstream verfile("/proc/sys/kernel/osrelease");
     if (!verfile.good()) {
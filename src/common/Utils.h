@@ -30,6 +30,13 @@ std::vector<std::string> split(
         const std::string& str,
         const std::string& delimeter);
 
+/**
+ * Splits line into shell-like arguments. Arguments are separated by
+ * whitespace, single and double quotes group characters and backslash
+ * escapes the next character.
+ */
+std::vector<std::string> splitArguments(const std::string& line);
+
 /**
  * Creates a temporary directory and returns path to it.
  *
@@ -38,6 +45,18 @@ std::vector<std::string> split(
 std::string createTemporaryDirectory(
         const std::string& directoryTemplate = "/tmp/sio2jail-XXXXXX");
 
+/**
+ * Removes directory created by createTemporaryDirectory together with files
+ * in it, it must not have subdirectories.
+ */
+void removeTemporaryDirectory(const std::string& path);
+
+/**
+ * Writes content to file at path, replacing it atomically, so that concurrent
+ * readers never see a partially written file. File is created with mode 0644.
+ */
+void writeFileAtomically(const std::string& path, const std::string& content);
+
 /**
  * Default to_string in s2j namespace, usefull for various overloads.
  */
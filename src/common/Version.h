@@ -0,0 +1,10 @@
+#pragma once
+
+namespace s2j {
+
+/**
+ * Version of sio2jail, it also invalidates caches of previous versions.
+ */
+constexpr const char VERSION[] = "1.5.4";
+
+} // namespace s2j
@@ -5,6 +5,8 @@
 
 #include <unistd.h>
 
+#include <vector>
+
 namespace s2j {
 namespace executor {
 
@@ -21,10 +23,30 @@ public:
     virtual ExecuteAction onSigioSignal() {
         return ExecuteAction::CONTINUE;
     }
-    virtual ExecuteAction onSigalrmSignal() {
+    virtual void onPostExecute() {}
+
+    /**
+     * Whether child has to wait with executing the program until
+     * onPostForkParent of all listeners has returned, i.e. when parent sets
+     * something up for child's pid. Queried once before fork, child waits
+     * after onPostForkChild of all listeners, so that both sides proceed in
+     * parallel until then.
+     */
+    virtual bool requiresParentSetup() {
+        return false;
+    }
+
+    /**
+     * File descriptors that executor should watch for input while child is
+     * running, queried once after onPostForkParent. onPollEvent is called
+     * when any of them becomes readable, i.e. when a timerfd expires.
+     */
+    virtual std::vector<int> getPollFds() {
+        return {};
+    }
+    virtual ExecuteAction onPollEvent(int /* fd */) {
         return ExecuteAction::CONTINUE;
     }
-    virtual void onPostExecute() {}
 };
 
 } // namespace executor
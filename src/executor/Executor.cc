@@ -7,6 +7,9 @@
 #include "logger/Logger.h"
 
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -14,25 +17,11 @@
 
 #include <csignal>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <string>
 #include <utility>
 
-namespace {
-
-volatile sig_atomic_t sigioOccurred = 0;
-volatile sig_atomic_t sigalrmOccurred = 0;
-
-void signalSigioHandler(int /*signum*/) {
-    sigioOccurred = 1;
-}
-
-void signalSigalrmHandler(int /*signum*/) {
-    sigalrmOccurred = 1;
-}
-
-} // namespace
-
 namespace s2j {
 namespace executor {
 
@@ -54,11 +43,44 @@ void Executor::execute() {
         listener->onPreFork();
     }
 
+    // Fds are created after listeners' onPreFork, so that they aren't
+    // closed with other inherited fds.
+    int execPipe[2];
+    withErrnoCheck("create exec pipe", pipe2, execPipe, O_CLOEXEC);
+
+    // Socket pair rather than pipe, so that parent doesn't get SIGPIPE when
+    // child has already died.
+    int parentSetupSockets[2]{-1, -1};
+    for (auto& listener: eventListeners_) {
+        if (listener->requiresParentSetup()) {
+            withErrnoCheck(
+                    "create parent setup socket pair",
+                    socketpair,
+                    AF_UNIX,
+                    SOCK_STREAM | SOCK_CLOEXEC,
+                    0,
+                    parentSetupSockets);
+            break;
+        }
+    }
+
+    forkTime_ = std::chrono::steady_clock::now();
     childPid_ = withErrnoCheck("fork", fork);
     if (childPid_ == 0) {
+        close(execPipe[0]);
+        if (parentSetupSockets[1] >= 0) {
+            close(parentSetupSockets[1]);
+        }
+        parentSetupFd_ = parentSetupSockets[0];
         executeChild();
     }
     else {
+        close(execPipe[1]);
+        execPipeFd_ = execPipe[0];
+        if (parentSetupSockets[0] >= 0) {
+            close(parentSetupSockets[0]);
+        }
+        parentSetupFd_ = parentSetupSockets[1];
         executeParent();
     }
 }
@@ -88,6 +110,23 @@ void Executor::executeChild() {
     }
     programArgv[childProgramArgv_.size() + 1] = nullptr;
 
+    if (parentSetupFd_ >= 0) {
+        // Socket is closed without writing anything if parent fails.
+        char parentReady = 0;
+        ssize_t bytesRead;
+        while ((bytesRead = withErrnoCheck(
+                        "wait for parent setup",
+                        {EINTR},
+                        read,
+                        parentSetupFd_,
+                        &parentReady,
+                        sizeof(parentReady))) < 0) {
+        }
+        if (bytesRead == 0) {
+            throw Exception("parent failed to set up child");
+        }
+    }
+
     // And execute program!
     withErrnoCheck("execv", execv, programName, programArgv);
 
@@ -115,24 +154,40 @@ void Executor::executeParent() {
         listener->onPostForkParent(childPid_);
     }
 
+    if (parentSetupFd_ >= 0) {
+        // Child might have died already, its exit is handled as usual then.
+        char parentReady = 1;
+        withErrnoCheck(
+                "notify child",
+                {EPIPE, ECONNRESET},
+                send,
+                parentSetupFd_,
+                &parentReady,
+                sizeof(parentReady),
+                MSG_NOSIGNAL);
+        withErrnoCheck("close parent setup socket", close, parentSetupFd_);
+        parentSetupFd_ = -1;
+    }
+
+    setupPolling();
+
     while (true) {
         ExecuteEvent event{};
         siginfo_t waitInfo;
+        executor::ExecuteAction action = ExecuteAction::CONTINUE;
 
-        executor::ExecuteAction action = checkSignals();
-        if (action == ExecuteAction::KILL) {
-            killChild();
-        }
+        // Child events are only polled here, executor sleeps in epoll_wait
+        // until SIGCHLD or other event arrives. SIGCHLD is blocked, so it
+        // can't get lost between waitid and epoll_wait.
+        int waitOptions = WEXITED | WSTOPPED | WNOWAIT | WNOHANG;
+        waitInfo.si_pid = 0;
 
-        // Potential race condition here.
         int returnValue{-1};
         if (supportThreads_) {
-            returnValue =
-                    waitid(P_ALL, -1, &waitInfo, WEXITED | WSTOPPED | WNOWAIT);
+            returnValue = waitid(P_ALL, -1, &waitInfo, waitOptions);
         }
         else {
-            returnValue = waitid(
-                    P_PID, childPid_, &waitInfo, WEXITED | WSTOPPED | WNOWAIT);
+            returnValue = waitid(P_PID, childPid_, &waitInfo, waitOptions);
         }
 
         if (returnValue == -1) {
@@ -143,6 +198,13 @@ void Executor::executeParent() {
             continue;
         }
 
+        if (waitInfo.si_pid == 0) {
+            if (waitForEvents(-1) == ExecuteAction::KILL) {
+                killChild();
+            }
+            continue;
+        }
+
         event.pid = waitInfo.si_pid;
         if (waitInfo.si_code == CLD_EXITED) {
             event.exited = true;
@@ -193,10 +255,14 @@ void Executor::executeParent() {
             }
         }
 
+        // Child producing events all the time mustn't starve other events.
+        action = std::max(action, waitForEvents(0));
         if (action == ExecuteAction::KILL) {
             killChild();
         }
     }
+    restoreSignalHandling();
+
     for (auto& listener: eventListeners_) {
         listener->onPostExecute();
     }
@@ -208,40 +274,169 @@ void Executor::executeParent() {
 void Executor::setupSignalHandling() {
     TRACE();
 
-    sigioOccurred = 0;
-    sigalrmOccurred = 0;
-
+    // Perf reports overflows with SIGIO, which would terminate sio2jail if
+    // it was ever unblocked while pending.
     struct sigaction signalAction {};
-    signalAction.sa_flags = 0;
-    withErrnoCheck("sigfillset", sigfillset, &signalAction.sa_mask);
+    signalAction.sa_handler = SIG_IGN;
+    withErrnoCheck(
+            "sigaction",
+            sigaction,
+            SIGIO,
+            &signalAction,
+            &originalSigioAction_);
+
+    sigset_t signals;
+    withErrnoCheck("sigemptyset", sigemptyset, &signals);
+    withErrnoCheck("sigaddset", sigaddset, &signals, SIGCHLD);
+    withErrnoCheck("sigaddset", sigaddset, &signals, SIGIO);
+    withErrnoCheck(
+            "sigprocmask",
+            sigprocmask,
+            SIG_BLOCK,
+            &signals,
+            &originalSignalMask_);
+
+    signalFd_ = withErrnoCheck(
+            "signalfd",
+            signalfd,
+            -1,
+            &signals,
+            SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+void Executor::setupPolling() {
+    TRACE();
 
-    signalAction.sa_handler = signalSigioHandler;
-    withErrnoCheck("sigaction", sigaction, SIGIO, &signalAction, nullptr);
+    epollFd_ = withErrnoCheck("epoll_create", epoll_create1, EPOLL_CLOEXEC);
+
+    pollFds_.clear();
+    pollFds_.emplace_back(signalFd_, nullptr);
+    pollFds_.emplace_back(execPipeFd_, nullptr);
+    for (auto& listener: eventListeners_) {
+        for (int fd: listener->getPollFds()) {
+            pollFds_.emplace_back(fd, listener);
+        }
+    }
 
-    signalAction.sa_handler = signalSigalrmHandler;
-    withErrnoCheck("sigaction", sigaction, SIGALRM, &signalAction, nullptr);
+    for (size_t index = 0; index < pollFds_.size(); ++index) {
+        struct epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.u64 = index;
+        withErrnoCheck(
+                "epoll_ctl add",
+                epoll_ctl,
+                epollFd_,
+                EPOLL_CTL_ADD,
+                pollFds_[index].first,
+                &event);
+    }
 }
 
-executor::ExecuteAction Executor::checkSignals() {
+void Executor::restoreSignalHandling() {
     TRACE();
 
+    pollFds_.clear();
+    withErrnoCheck("close epoll fd", close, epollFd_);
+    epollFd_ = -1;
+    if (execPipeFd_ >= 0) {
+        withErrnoCheck("close exec pipe", close, execPipeFd_);
+        execPipeFd_ = -1;
+    }
+
+    // Consume signals that are still pending, so that they aren't delivered
+    // after unblocking.
+    readSignals();
+    withErrnoCheck("close signalfd", close, signalFd_);
+    signalFd_ = -1;
+
+    withErrnoCheck(
+            "sigprocmask",
+            sigprocmask,
+            SIG_SETMASK,
+            &originalSignalMask_,
+            nullptr);
+    // Only after unblocking, so that a SIGIO which got pending meanwhile is
+    // still discarded.
+    withErrnoCheck(
+            "sigaction", sigaction, SIGIO, &originalSigioAction_, nullptr);
+}
+
+executor::ExecuteAction Executor::waitForEvents(int timeoutMs) {
+    TRACE(timeoutMs);
+
+    std::vector<struct epoll_event> events(pollFds_.size());
+    int eventsCount = withErrnoCheck(
+            "epoll_wait",
+            {EINTR},
+            epoll_wait,
+            epollFd_,
+            events.data(),
+            events.size(),
+            timeoutMs);
+
     executor::ExecuteAction action = executor::ExecuteAction::CONTINUE;
-    if (sigioOccurred != 0) {
-        sigioOccurred = 0;
-        for (auto& listener: eventListeners_) {
-            action = std::max(action, listener->onSigioSignal());
+    for (int eventIndex = 0; eventIndex < eventsCount; ++eventIndex) {
+        const auto& pollFd = pollFds_[events[eventIndex].data.u64];
+        if (pollFd.first == execPipeFd_) {
+            logger::debug(
+                    "Child executed program ",
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - forkTime_)
+                            .count(),
+                    "us after fork");
+            withErrnoCheck(
+                    "epoll_ctl del",
+                    epoll_ctl,
+                    epollFd_,
+                    EPOLL_CTL_DEL,
+                    execPipeFd_,
+                    nullptr);
+            withErrnoCheck("close exec pipe", close, execPipeFd_);
+            execPipeFd_ = -1;
         }
-    }
-    if (sigalrmOccurred != 0) {
-        sigalrmOccurred = 0;
-        for (auto& listener: eventListeners_) {
-            action = std::max(action, listener->onSigalrmSignal());
+        else if (pollFd.second == nullptr) {
+            if (readSignals().count(SIGIO) > 0) {
+                for (auto& listener: eventListeners_) {
+                    action = std::max(action, listener->onSigioSignal());
+                }
+            }
+        }
+        else if ((events[eventIndex].events & EPOLLIN) != 0) {
+            action = std::max(action, pollFd.second->onPollEvent(pollFd.first));
+        }
+        else {
+            // Hang up or error, there is nothing more to read from fd.
+            logger::debug("Stopped polling fd ", pollFd.first);
+            withErrnoCheck(
+                    "epoll_ctl del",
+                    epoll_ctl,
+                    epollFd_,
+                    EPOLL_CTL_DEL,
+                    pollFd.first,
+                    nullptr);
         }
     }
 
     return action;
 }
 
+std::set<int> Executor::readSignals() {
+    std::set<int> signals;
+
+    struct signalfd_siginfo signalInfo;
+    while (withErrnoCheck(
+                   "read signalfd",
+                   {EAGAIN},
+                   read,
+                   signalFd_,
+                   &signalInfo,
+                   sizeof(signalInfo)) == sizeof(signalInfo)) {
+        signals.insert(signalInfo.ssi_signo);
+    }
+
+    return signals;
+}
+
 void Executor::onProgramNameChange(const std::string& newProgramName) {
     TRACE(newProgramName);
 
@@ -6,9 +6,14 @@
 #include "ns/MountEventListener.h"
 #include "printer/OutputSource.h"
 
+#include <chrono>
 #include <memory>
+#include <set>
+#include <utility>
 #include <vector>
 
+#include <csignal>
+
 namespace s2j {
 namespace executor {
 
@@ -41,8 +46,11 @@ private:
     void executeChild();
     void executeParent();
     void setupSignalHandling();
+    void setupPolling();
+    void restoreSignalHandling();
     void killChild();
-    ExecuteAction checkSignals();
+    ExecuteAction waitForEvents(int timeoutMs);
+    std::set<int> readSignals();
 
     std::string childProgramName_;
     std::vector<std::string> childProgramArgv_;
@@ -50,6 +58,25 @@ private:
 
     pid_t childPid_;
     const bool supportThreads_;
+
+    // Socket written to by parent after onPostForkParent of all listeners,
+    // if any of them requires child to wait for it. Both processes keep
+    // their own end.
+    int parentSetupFd_{-1};
+
+    // Read end of a close-on-exec pipe, which hangs up once child executes
+    // the program, used to measure latency of child's setup.
+    int execPipeFd_{-1};
+    std::chrono::steady_clock::time_point forkTime_;
+
+    // Fds watched with epoll, signalfd receiving SIGCHLD and SIGIO and exec
+    // pipe are the first ones and have no listener.
+    std::vector<std::pair<int, std::shared_ptr<ExecuteEventListener>>>
+            pollFds_;
+    int epollFd_{-1};
+    int signalFd_{-1};
+    sigset_t originalSignalMask_;
+    struct sigaction originalSigioAction_ {};
 };
 
 } // namespace executor
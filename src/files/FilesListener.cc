@@ -9,8 +9,13 @@ namespace files {
 const std::string FilesListener::DEV_NULL = "/dev/null";
 const std::string FilesListener::FDS_PATH = "/proc/self/fd/";
 
-FilesListener::FilesListener(bool suppressStderr)
-        : suppressStderr_(suppressStderr) {}
+FilesListener::FilesListener(
+        bool suppressStderr,
+        std::string stdinPath,
+        std::string stdoutPath)
+        : suppressStderr_(suppressStderr)
+        , stdinPath_(std::move(stdinPath))
+        , stdoutPath_(std::move(stdoutPath)) {}
 
 void FilesListener::onPreFork() {
     TRACE();
@@ -44,6 +49,23 @@ void FilesListener::onPreFork() {
     // Open /dev/null for child
     devnull_ =
             withErrnoCheck("open /dev/null", open, DEV_NULL.c_str(), O_WRONLY);
+
+    // Open redirection files outside of the sandbox
+    if (!stdinPath_.empty()) {
+        stdin_ = withErrnoCheck(
+                "open stdin file " + stdinPath_,
+                open,
+                stdinPath_.c_str(),
+                O_RDONLY | O_CLOEXEC);
+    }
+    if (!stdoutPath_.empty()) {
+        stdout_ = withErrnoCheck(
+                "open stdout file " + stdoutPath_,
+                open,
+                stdoutPath_.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+    }
 }
 
 void FilesListener::onPostForkChild() {
@@ -55,6 +77,13 @@ void FilesListener::onPostForkChild() {
     }
     withErrnoCheck("close /dev/null", close, devnull_);
 
+    if (stdin_ >= 0) {
+        withErrnoCheck("redirect stdin", dup2, stdin_, 0);
+    }
+    if (stdout_ >= 0) {
+        withErrnoCheck("redirect stdout", dup2, stdout_, 1);
+    }
+
     for (size_t fdsIndex = 0; fdsIndex < fds_.size();) {
         try {
             withErrnoCheck("close fd", close, fds_[fdsIndex]);
@@ -71,5 +100,16 @@ void FilesListener::onPostForkChild() {
     }
 }
 
+void FilesListener::onPostForkParent(pid_t /*childPid*/) {
+    TRACE();
+
+    for (int* fd: {&devnull_, &stdin_, &stdout_}) {
+        if (*fd >= 0) {
+            withErrnoCheck("close fd", close, *fd);
+            *fd = -1;
+        }
+    }
+}
+
 } // namespace files
 } // namespace s2j
@@ -14,9 +14,13 @@ namespace files {
 
 class FilesListener : public executor::ExecuteEventListener {
 public:
-    FilesListener(bool suppressStderr = true);
+    FilesListener(
+            bool suppressStderr = true,
+            std::string stdinPath = "",
+            std::string stdoutPath = "");
 
     void onPostForkChild() override;
+    void onPostForkParent(pid_t childPid) override;
     void onPreFork() override;
 
     const static std::string DEV_NULL;
@@ -24,8 +28,12 @@ public:
 
 private:
     const bool suppressStderr_;
+    const std::string stdinPath_;
+    const std::string stdoutPath_;
     std::vector<int> fds_;
     int devnull_{-1};
+    int stdin_{-1};
+    int stdout_{-1};
 };
 
 } // namespace files
@@ -22,19 +22,39 @@
 #include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <utility>
 
 namespace s2j {
 namespace limits {
 
 const uint64_t MemoryLimitListener::MEMORY_LIMIT_MARGIN = 8 * 1024 * 1024;
 
-MemoryLimitListener::MemoryLimitListener(uint64_t memoryLimitKb)
+MemoryLimitListener::MemoryLimitListener(
+        uint64_t memoryLimitKb,
+        std::shared_ptr<cgroup::CgroupListener> cgroup,
+        bool seccompNotify)
         : memoryPeakKb_(0)
         , memoryLimitKb_(memoryLimitKb)
         , vmPeakValid_(false)
-        , childPid_(-1) {
+        , childPid_(-1)
+        , cgroup_(std::move(cgroup)) {
     TRACE(memoryLimitKb);
 
+    if (cgroup_ != nullptr) {
+        // Kernel enforces the limit itself, there is no need to trace any
+        // allocations.
+        cgroup_->requireController("memory");
+        if (memoryLimitKb_ > 0) {
+            cgroup_->setValue(
+                    "memory.max",
+                    std::to_string(
+                            memoryLimitKb_ * 1024 + MEMORY_LIMIT_MARGIN));
+        }
+        cgroup_->setValue("memory.swap.max", "0", false);
+        cgroup_->setValue("memory.oom.group", "1");
+        return;
+    }
+
     // Possible memory problem here, we will return this references to *this.
     // User is responsible for ensuring that MemoryLimitListener last at least
     // as long as any reference to it's rules.
@@ -76,6 +96,26 @@ MemoryLimitListener::MemoryLimitListener(uint64_t memoryLimitKb)
                 return handleMemoryAllocation(newMemoryAllocated);
             }),
             Arg(2) > MEMORY_LIMIT_MARGIN / 2));
+
+    if (!seccompNotify) {
+        return;
+    }
+
+    // With seccomp user notifications there is no ptrace stop before process
+    // exits, so read memory peak while address space still exists.
+    for (const auto& syscall: {"exit", "exit_group"}) {
+        syscallRules_.emplace_back(seccomp::SeccompRule(
+                syscall,
+                seccomp::action::ActionTrace(
+                        [this](tracer::Tracee& /* tracee */) {
+                    TRACE();
+                    if (!vmPeakValid_) {
+                        return tracer::TraceAction::CONTINUE;
+                    }
+                    return checkMemoryPeak() ? tracer::TraceAction::KILL
+                                             : tracer::TraceAction::CONTINUE;
+                })));
+    }
 }
 tracer::TraceAction MemoryLimitListener::handleMemoryAllocation(
         uint64_t allocatedMemoryKb) {
@@ -105,11 +145,17 @@ void MemoryLimitListener::onPostForkChild() {
     if (memoryLimitKb_ > 0) {
         struct rlimit memoryLimit {};
 
-        memoryLimit.rlim_cur = memoryLimit.rlim_max =
-                memoryLimitKb_ * 1024 + MEMORY_LIMIT_MARGIN;
-        logger::debug("Seting address space limit ", VAR(memoryLimit.rlim_max));
-        withErrnoCheck(
-                "setrlimit address space", setrlimit, RLIMIT_AS, &memoryLimit);
+        if (cgroup_ == nullptr) {
+            memoryLimit.rlim_cur = memoryLimit.rlim_max =
+                    memoryLimitKb_ * 1024 + MEMORY_LIMIT_MARGIN;
+            logger::debug(
+                    "Seting address space limit ", VAR(memoryLimit.rlim_max));
+            withErrnoCheck(
+                    "setrlimit address space",
+                    setrlimit,
+                    RLIMIT_AS,
+                    &memoryLimit);
+        }
 
         memoryLimit.rlim_cur = memoryLimit.rlim_max = RLIM_INFINITY;
         logger::debug("Seting stack limit to infinity");
@@ -135,10 +181,30 @@ executor::ExecuteAction MemoryLimitListener::onExecuteEvent(
         const executor::ExecuteEvent& /*executeEvent*/) {
     TRACE();
 
-    if (!vmPeakValid_) {
+    if (!vmPeakValid_ || cgroup_ != nullptr) {
         return executor::ExecuteAction::CONTINUE;
     }
 
+    if (checkMemoryPeak()) {
+        return executor::ExecuteAction::KILL;
+    }
+
+    return executor::ExecuteAction::CONTINUE;
+}
+
+void MemoryLimitListener::onPostExecute() {
+    TRACE();
+
+    if (cgroup_ == nullptr) {
+        return;
+    }
+
+    // Child killed by the kernel's oom killer has its peak just below
+    // memory.max, which is above the limit anyway.
+    checkMemoryPeak();
+}
+
+bool MemoryLimitListener::checkMemoryPeak() {
     memoryPeakKb_ = std::max(memoryPeakKb_, getMemoryPeakKb());
     logger::debug("Read new memory peak ", VAR(memoryPeakKb_));
 
@@ -149,13 +215,16 @@ executor::ExecuteAction MemoryLimitListener::onExecuteEvent(
                 "memory limit exceeded");
         logger::debug(
                 "Limit ", VAR(memoryLimitKb_), " exceeded, killing tracee");
-        return executor::ExecuteAction::KILL;
+        return true;
     }
 
-    return executor::ExecuteAction::CONTINUE;
+    return false;
 }
 
 uint64_t MemoryLimitListener::getMemoryPeakKb() {
+    if (cgroup_ != nullptr) {
+        return cgroup_->readValue("memory.peak") / 1024;
+    }
     return procfs::readProcFS(childPid_, procfs::Field::VM_PEAK);
 }
 
@@ -1,11 +1,13 @@
 #pragma once
 
+#include "cgroup/CgroupListener.h"
 #include "executor/ExecuteEventListener.h"
 #include "printer/OutputSource.h"
 #include "seccomp/policy/SyscallPolicy.h"
 #include "tracer/TraceEventListener.h"
 
 #include <cstdint>
+#include <memory>
 
 namespace s2j {
 namespace limits {
@@ -16,7 +18,17 @@ class MemoryLimitListener
         , public printer::OutputSource
         , public seccomp::policy::SyscallPolicy {
 public:
-    MemoryLimitListener(uint64_t memoryLimitKb);
+    /**
+     * When cgroup is given memory usage is resident memory charged to it,
+     * limited by memory.max and read from memory.peak once child exits.
+     * Otherwise address space size is limited with RLIMIT_AS and polled from
+     * procfs, also on exit when seccompNotify is set, as there is no ptrace
+     * stop then.
+     */
+    MemoryLimitListener(
+            uint64_t memoryLimitKb,
+            std::shared_ptr<cgroup::CgroupListener> cgroup = nullptr,
+            bool seccompNotify = false);
 
     void onPostForkChild() override;
     void onPostForkParent(pid_t childPid) override;
@@ -25,6 +37,7 @@ public:
             tracer::Tracee& tracee) override;
     executor::ExecuteAction onExecuteEvent(
             const executor::ExecuteEvent& executeEvent) override;
+    void onPostExecute() override;
 
     const std::vector<seccomp::SeccompRule>& getRules() const;
 
@@ -34,10 +47,14 @@ private:
     uint64_t getMemoryPeakKb();
     uint64_t getMemoryUsageKb();
 
+    /* Updates memory peak, returns true when limit is exceeded. */
+    bool checkMemoryPeak();
+
     uint64_t memoryPeakKb_;
     uint64_t memoryLimitKb_;
     bool vmPeakValid_;
     pid_t childPid_;
+    std::shared_ptr<cgroup::CgroupListener> cgroup_;
 
     std::vector<seccomp::SeccompRule> syscallRules_;
     tracer::TraceAction handleMemoryAllocation(uint64_t allocatedMemoryKb);
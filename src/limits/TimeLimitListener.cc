@@ -3,6 +3,8 @@
 #include "common/WithErrnoCheck.h"
 #include "logger/Logger.h"
 
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -12,11 +14,14 @@
 #include <ctime>
 #include <fstream>
 #include <limits>
+#include <utility>
 
 namespace s2j {
 namespace limits {
 
-const uint64_t TimeLimitListener::TIMER_TICKING_INTERVAL_US =
+const uint64_t TimeLimitListener::DEFAULT_TIMER_MIN_INTERVAL_US =
+        1 * 1000; // 1ms
+const uint64_t TimeLimitListener::DEFAULT_TIMER_MAX_INTERVAL_US =
         200 * 1000; // 200ms
 const long TimeLimitListener::CLOCK_TICKS_PER_SECOND =
         withErrnoCheck("sysconf", sysconf, _SC_CLK_TCK);
@@ -25,19 +30,31 @@ TimeLimitListener::TimeLimitListener(
         uint64_t rTimelimitUs,
         uint64_t uTimelimitUs,
         uint64_t sTimelimitUs,
-        uint64_t usTimelimitUs)
+        uint64_t usTimelimitUs,
+        uint64_t timerMinIntervalUs,
+        uint64_t timerMaxIntervalUs,
+        std::shared_ptr<cgroup::CgroupListener> cgroup,
+        bool cpuClockTimer)
         : rTimelimitUs_(rTimelimitUs)
         , uTimelimitUs_(uTimelimitUs)
         , sTimelimitUs_(sTimelimitUs)
         , usTimelimitUs_(usTimelimitUs)
-        , isTimerCreated_(false) {
+        , cgroup_(std::move(cgroup))
+        , timerMinIntervalUs_(timerMinIntervalUs)
+        , timerMaxIntervalUs_(timerMaxIntervalUs)
+        , cpuClockTimer_(cpuClockTimer) {
     TRACE(rTimelimitUs, uTimelimitUs, sTimelimitUs, usTimelimitUs);
 }
 
 TimeLimitListener::~TimeLimitListener() {
-    if (isTimerCreated_) {
-        timer_delete(timerId_);
-        isTimerCreated_ = false;
+    try {
+        deleteCpuClockTimer();
+    }
+    catch (...) {
+    }
+    if (timerFd_ >= 0) {
+        close(timerFd_);
+        timerFd_ = -1;
     }
 }
 
@@ -46,59 +63,253 @@ void TimeLimitListener::onPostForkParent(pid_t childPid) {
     // TODO: run this just before execve
     startRealTime_ = std::chrono::steady_clock::now();
 
-    uint64_t firstTimerTick = std::numeric_limits<uint64_t>::max();
-    if (rTimelimitUs_ != 0 && rTimelimitUs_ < firstTimerTick) {
-        firstTimerTick = rTimelimitUs_;
+    lastTickRealTimeUs_ = 0;
+    lastTickProcessTimeUs_ = 0;
+
+    bool hasProcessTimeLimits =
+            uTimelimitUs_ != 0 || sTimelimitUs_ != 0 || usTimelimitUs_ != 0;
+    if (hasProcessTimeLimits && cpuClockTimer_) {
+        createCpuClockTimer();
+        armCpuClockTimer();
     }
-    if (uTimelimitUs_ != 0 && uTimelimitUs_ < firstTimerTick) {
-        firstTimerTick = uTimelimitUs_;
+    // Other processes of the cgroup don't advance child's CPU clock.
+    tickProcessTime_ = hasProcessTimeLimits &&
+            (!isCpuClockTimerCreated_ || cgroup_ != nullptr);
+
+    if (rTimelimitUs_ != 0 || tickProcessTime_) {
+        timerFd_ = withErrnoCheck(
+                "timerfd_create",
+                timerfd_create,
+                CLOCK_MONOTONIC,
+                TFD_NONBLOCK | TFD_CLOEXEC);
+        armTimer(
+                tickProcessTime_
+                        ? getProcessTimeTickUs(TimeUsage{0, ProcessTimeUsage{}})
+                        : 0);
     }
-    if (sTimelimitUs_ != 0 && sTimelimitUs_ < firstTimerTick) {
-        firstTimerTick = sTimelimitUs_;
+}
+
+std::vector<int> TimeLimitListener::getPollFds() {
+    std::vector<int> fds;
+    if (timerFd_ >= 0) {
+        fds.push_back(timerFd_);
     }
-    if (usTimelimitUs_ != 0 && usTimelimitUs_ < firstTimerTick) {
-        firstTimerTick = usTimelimitUs_;
+    if (cpuClockSignalFd_ >= 0) {
+        fds.push_back(cpuClockSignalFd_);
     }
+    return fds;
+}
 
-    if (firstTimerTick != std::numeric_limits<uint64_t>::max()) {
-        withErrnoCheck(
-                "timer_create",
-                timer_create,
-                CLOCK_MONOTONIC,
-                nullptr,
-                &timerId_);
-        isTimerCreated_ = true;
-
-        struct itimerspec timerSpec {};
-        timerSpec.it_value.tv_sec = firstTimerTick / 1000000;
-        timerSpec.it_value.tv_nsec = firstTimerTick % 1000000 * 1000;
-        timerSpec.it_interval.tv_sec = TIMER_TICKING_INTERVAL_US / 1000000;
-        timerSpec.it_interval.tv_nsec =
-                TIMER_TICKING_INTERVAL_US % 1000000 * 1000;
-        withErrnoCheck(
-                "timer_settime",
-                timer_settime,
-                timerId_,
-                0,
-                &timerSpec,
-                nullptr);
+executor::ExecuteAction TimeLimitListener::onPollEvent(int fd) {
+    if (fd == cpuClockSignalFd_) {
+        struct signalfd_siginfo signalInfo;
+        while (withErrnoCheck(
+                       "read signalfd",
+                       {EAGAIN},
+                       read,
+                       cpuClockSignalFd_,
+                       &signalInfo,
+                       sizeof(signalInfo)) > 0) {
+        }
+
+        auto time = getTimeUsage();
+        executor::ExecuteAction action = verifyTimeUsage(move(time));
+        if (action == executor::ExecuteAction::CONTINUE) {
+            armCpuClockTimer();
+        }
+        return action;
     }
+
+    uint64_t expirations;
+    withErrnoCheck(
+            "read timerfd",
+            {EAGAIN},
+            read,
+            timerFd_,
+            &expirations,
+            sizeof(expirations));
+
+    auto time = getTimeUsage();
+    uint64_t processTimeTickUs =
+            tickProcessTime_ ? getProcessTimeTickUs(*time) : 0;
+    executor::ExecuteAction action = verifyTimeUsage(move(time));
+    if (action == executor::ExecuteAction::CONTINUE) {
+        armTimer(processTimeTickUs);
+    }
+    return action;
 }
 
-executor::ExecuteAction TimeLimitListener::onSigalrmSignal() {
-    if (!isTimerCreated_) {
-        return executor::ExecuteAction::CONTINUE;
+void TimeLimitListener::armTimer(uint64_t processTimeTickUs) {
+    uint64_t nextTickUs = std::numeric_limits<uint64_t>::max();
+    if (tickProcessTime_) {
+        nextTickUs = processTimeTickUs;
+    }
+    if (rTimelimitUs_ != 0) {
+        uint64_t realTimeUs = getRealTimeUsage();
+        nextTickUs = std::min(
+                nextTickUs,
+                rTimelimitUs_ > realTimeUs ? rTimelimitUs_ - realTimeUs : 0);
+    }
+    // Zero would disarm the timer
+    nextTickUs = std::max<uint64_t>(nextTickUs, 1);
+
+    struct itimerspec timerSpec {};
+    timerSpec.it_value.tv_sec = nextTickUs / 1000000;
+    timerSpec.it_value.tv_nsec = nextTickUs % 1000000 * 1000;
+    withErrnoCheck(
+            "timerfd_settime",
+            timerfd_settime,
+            timerFd_,
+            0,
+            &timerSpec,
+            nullptr);
+}
+
+uint64_t TimeLimitListener::getProcessTimeTickUs(const TimeUsage& timeUsage) {
+    const ProcessTimeUsage& ptu = timeUsage.processTimeUs;
+    uint64_t processTimeUs = ptu.uTimeUs + ptu.sTimeUs;
+    uint64_t realTimeDeltaUs = timeUsage.realTimeUs - lastTickRealTimeUs_;
+    uint64_t processTimeDeltaUs = processTimeUs > lastTickProcessTimeUs_
+            ? processTimeUs - lastTickProcessTimeUs_
+            : 0;
+    lastTickRealTimeUs_ = timeUsage.realTimeUs;
+    lastTickProcessTimeUs_ = processTimeUs;
+
+    uint64_t tickUs = getRemainingProcessTimeUs(ptu);
+    if (realTimeDeltaUs > 0 && processTimeDeltaUs > realTimeDeltaUs) {
+        tickUs = tickUs * realTimeDeltaUs / processTimeDeltaUs;
+    }
+    tickUs = std::max(tickUs, timerMinIntervalUs_);
+    tickUs = std::min(tickUs, timerMaxIntervalUs_);
+    logger::debug(
+            "Next process time check ",
+            VAR(tickUs),
+            ", ",
+            VAR(processTimeDeltaUs),
+            ", ",
+            VAR(realTimeDeltaUs));
+    return tickUs;
+}
+
+uint64_t TimeLimitListener::getRemainingProcessTimeUs(
+        const ProcessTimeUsage& processTimeUsage) const {
+    uint64_t remainingUs = std::numeric_limits<uint64_t>::max();
+    auto updateRemaining = [&remainingUs](uint64_t limitUs, uint64_t usedUs) {
+        if (limitUs != 0) {
+            remainingUs = std::min(
+                    remainingUs, limitUs > usedUs ? limitUs - usedUs : 0);
+        }
+    };
+    updateRemaining(uTimelimitUs_, processTimeUsage.uTimeUs);
+    updateRemaining(sTimelimitUs_, processTimeUsage.sTimeUs);
+    updateRemaining(
+            usTimelimitUs_,
+            processTimeUsage.uTimeUs + processTimeUsage.sTimeUs);
+    return remainingUs;
+}
+
+void TimeLimitListener::createCpuClockTimer() {
+    int error = clock_getcpuclockid(childPid_, &cpuClockId_);
+    if (error != 0) {
+        throw SystemException("clock_getcpuclockid failed", error);
+    }
+
+    sigset_t signals;
+    sigset_t originalSignals;
+    withErrnoCheck("sigemptyset", sigemptyset, &signals);
+    withErrnoCheck("sigaddset", sigaddset, &signals, SIGALRM);
+    withErrnoCheck(
+            "sigprocmask", sigprocmask, SIG_BLOCK, &signals, &originalSignals);
+    unblockSigalrm_ = sigismember(&originalSignals, SIGALRM) == 0;
+    cpuClockSignalFd_ = withErrnoCheck(
+            "signalfd", signalfd, -1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    struct sigevent timerEvent {};
+    timerEvent.sigev_notify = SIGEV_SIGNAL;
+    timerEvent.sigev_signo = SIGALRM;
+    withErrnoCheck(
+            "timer_create",
+            timer_create,
+            cpuClockId_,
+            &timerEvent,
+            &cpuClockTimerId_);
+    isCpuClockTimerCreated_ = true;
+}
+
+void TimeLimitListener::armCpuClockTimer() {
+    uint64_t remainingUs = getRemainingProcessTimeUs(getProcessTimeUsage());
+    // Zero would disarm the timer
+    remainingUs = std::max<uint64_t>(remainingUs, 1);
+
+    struct itimerspec timerSpec {};
+    timerSpec.it_value.tv_sec = remainingUs / 1000000;
+    timerSpec.it_value.tv_nsec = remainingUs % 1000000 * 1000;
+    withErrnoCheck(
+            "timer_settime",
+            timer_settime,
+            cpuClockTimerId_,
+            0,
+            &timerSpec,
+            nullptr);
+}
+
+void TimeLimitListener::deleteCpuClockTimer() {
+    if (!isCpuClockTimerCreated_) {
+        return;
+    }
+    isCpuClockTimerCreated_ = false;
+    withErrnoCheck("timer_delete", timer_delete, cpuClockTimerId_);
+
+    // Consume pending signal, so that it isn't delivered after unblocking.
+    struct signalfd_siginfo signalInfo;
+    while (withErrnoCheck(
+                   "read signalfd",
+                   {EAGAIN},
+                   read,
+                   cpuClockSignalFd_,
+                   &signalInfo,
+                   sizeof(signalInfo)) > 0) {
+    }
+    withErrnoCheck("close signalfd", close, cpuClockSignalFd_);
+    cpuClockSignalFd_ = -1;
+
+    if (unblockSigalrm_) {
+        sigset_t signals;
+        withErrnoCheck("sigemptyset", sigemptyset, &signals);
+        withErrnoCheck("sigaddset", sigaddset, &signals, SIGALRM);
+        withErrnoCheck(
+                "sigprocmask", sigprocmask, SIG_UNBLOCK, &signals, nullptr);
     }
-    auto time = getTimeUsage();
-    return verifyTimeUsage(move(time));
 }
 
 void TimeLimitListener::onPostExecute() {
     // TODO: run this just after child exit
     auto time = getTimeUsage();
+    deleteCpuClockTimer();
     outputBuilder_->setRealTimeMicroseconds(time->realTimeUs);
     outputBuilder_->setUserTimeMicroseconds(time->processTimeUs.uTimeUs);
     outputBuilder_->setSysTimeMicroseconds(time->processTimeUs.sTimeUs);
+
+    // How long the program ran past its limit, which tells how precisely
+    // limits are enforced.
+    bool limitExceeded = false;
+    uint64_t overshootUs = 0;
+    auto updateOvershoot = [&](uint64_t limitUs, uint64_t usedUs) {
+        if (limitUs != 0 && usedUs > limitUs) {
+            limitExceeded = true;
+            overshootUs = std::max(overshootUs, usedUs - limitUs);
+        }
+    };
+    const ProcessTimeUsage& ptu = time->processTimeUs;
+    updateOvershoot(rTimelimitUs_, time->realTimeUs);
+    updateOvershoot(uTimelimitUs_, ptu.uTimeUs);
+    updateOvershoot(sTimelimitUs_, ptu.sTimeUs);
+    updateOvershoot(usTimelimitUs_, ptu.uTimeUs + ptu.sTimeUs);
+    if (limitExceeded) {
+        logger::debug("Time limit exceeded by ", VAR(overshootUs));
+        outputBuilder_->setTimeLimitOvershoot(overshootUs);
+    }
+
     verifyTimeUsage(move(time));
 }
 
@@ -147,6 +358,14 @@ uint64_t TimeLimitListener::getRealTimeUsage() const {
 
 TimeLimitListener::ProcessTimeUsage TimeLimitListener::getProcessTimeUsage()
         const {
+    if (cgroup_ != nullptr) {
+        auto cpuStat = cgroup_->readKeys("cpu.stat");
+        ProcessTimeUsage result{};
+        result.uTimeUs = cpuStat["user_usec"];
+        result.sTimeUs = cpuStat["system_usec"];
+        return result;
+    }
+
     std::ifstream stat("/proc/" + std::to_string(childPid_) + "/stat");
     if (!stat.good()) {
         throw SystemException("Error reading /proc/childPid_/stat");
@@ -167,6 +386,21 @@ TimeLimitListener::ProcessTimeUsage TimeLimitListener::getProcessTimeUsage()
     }
 
     ProcessTimeUsage result{};
+    if (isCpuClockTimerCreated_) {
+        // CPU clock is precise, clock ticks only tell how it splits between
+        // user and system time.
+        struct timespec cpuTime {};
+        withErrnoCheck("clock_gettime", clock_gettime, cpuClockId_, &cpuTime);
+        uint64_t cpuTimeUs = static_cast<uint64_t>(cpuTime.tv_sec) * 1000000 +
+                static_cast<uint64_t>(cpuTime.tv_nsec) / 1000;
+        uint64_t timeTicks = uTimeTicks + sTimeTicks;
+        result.uTimeUs = timeTicks == 0
+                ? cpuTimeUs
+                : cpuTimeUs * uTimeTicks / timeTicks;
+        result.sTimeUs = cpuTimeUs - result.uTimeUs;
+        return result;
+    }
+
     result.uTimeUs = uTimeTicks * 1000000 / CLOCK_TICKS_PER_SECOND;
     result.sTimeUs = sTimeTicks * 1000000 / CLOCK_TICKS_PER_SECOND;
     return result;
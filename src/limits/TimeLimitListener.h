@@ -1,10 +1,14 @@
 #pragma once
 
+#include "cgroup/CgroupListener.h"
 #include "executor/ExecuteEventListener.h"
 #include "printer/OutputSource.h"
 
 #include <chrono>
+#include <ctime>
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace s2j {
 namespace limits {
@@ -13,17 +17,36 @@ class TimeLimitListener
         : public executor::ExecuteEventListener
         , public printer::OutputSource {
 public:
+    /**
+     * When cgroup is given user and system times are read from its cpu.stat,
+     * which counts all processes and threads with microsecond precision.
+     * Otherwise they are read from main process' /proc/$PID/stat.
+     *
+     * When cpuClockTimer is set process time limits are enforced with a timer
+     * on child's CPU clock instead of periodic checks.
+     *
+     * Interval between periodic checks adapts to remaining budget and is kept
+     * between timerMinIntervalUs and timerMaxIntervalUs.
+     */
     TimeLimitListener(
             uint64_t rTimelimitUs,
             uint64_t uTimelimitUs,
             uint64_t sTimelimitUs,
-            uint64_t usTimelimitUs);
+            uint64_t usTimelimitUs,
+            uint64_t timerMinIntervalUs = DEFAULT_TIMER_MIN_INTERVAL_US,
+            uint64_t timerMaxIntervalUs = DEFAULT_TIMER_MAX_INTERVAL_US,
+            std::shared_ptr<cgroup::CgroupListener> cgroup = nullptr,
+            bool cpuClockTimer = false);
     ~TimeLimitListener();
 
     void onPostForkParent(pid_t childPid) override;
-    executor::ExecuteAction onSigalrmSignal() override;
+    std::vector<int> getPollFds() override;
+    executor::ExecuteAction onPollEvent(int fd) override;
     void onPostExecute() override;
 
+    static const uint64_t DEFAULT_TIMER_MIN_INTERVAL_US;
+    static const uint64_t DEFAULT_TIMER_MAX_INTERVAL_US;
+
 private:
     struct ProcessTimeUsage {
         uint64_t uTimeUs; // user time in [us]
@@ -35,9 +58,34 @@ private:
         ProcessTimeUsage processTimeUs;
     };
 
-    static const uint64_t TIMER_TICKING_INTERVAL_US;
     static const long CLOCK_TICKS_PER_SECOND;
 
+    /**
+     * Arms timer to expire after processTimeTickUs or at real time limit,
+     * whichever comes first. Process time isn't predictable, so it's
+     * checked periodically.
+     */
+    void armTimer(uint64_t processTimeTickUs);
+
+    /**
+     * Computes delay of the next process time check from the smallest
+     * remaining budget and rate at which process time was used since the
+     * previous check. Rates below one CPU aren't trusted, as sleeping
+     * program may start computing at any moment.
+     */
+    uint64_t getProcessTimeTickUs(const TimeUsage& timeUsage);
+    uint64_t getRemainingProcessTimeUs(
+            const ProcessTimeUsage& processTimeUsage) const;
+
+    /**
+     * CPU clock of the child counts both user and system time of all its
+     * threads, so none of the limits can be exceeded before it advances by
+     * the smallest remaining budget. Timer's signal is read from a signalfd.
+     */
+    void createCpuClockTimer();
+    void armCpuClockTimer();
+    void deleteCpuClockTimer();
+
     executor::ExecuteAction verifyTimeUsage(std::unique_ptr<TimeUsage>);
     uint64_t getRealTimeUsage() const;
     ProcessTimeUsage getProcessTimeUsage() const;
@@ -48,10 +96,22 @@ private:
     uint64_t sTimelimitUs_; // system time limit in [us]
     uint64_t usTimelimitUs_; // user+system time limit in [us]
     pid_t childPid_{};
+    std::shared_ptr<cgroup::CgroupListener> cgroup_;
 
     std::chrono::steady_clock::time_point startRealTime_;
-    bool isTimerCreated_;
-    timer_t timerId_{};
+    int timerFd_{-1};
+    bool tickProcessTime_{false};
+    uint64_t timerMinIntervalUs_;
+    uint64_t timerMaxIntervalUs_;
+    uint64_t lastTickRealTimeUs_{};
+    uint64_t lastTickProcessTimeUs_{};
+
+    const bool cpuClockTimer_;
+    clockid_t cpuClockId_{};
+    bool isCpuClockTimerCreated_{false};
+    timer_t cpuClockTimerId_{};
+    int cpuClockSignalFd_{-1};
+    bool unblockSigalrm_{false};
 };
 
 } // namespace limits
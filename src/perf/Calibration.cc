@@ -0,0 +1,265 @@
+#include "Calibration.h"
+#include "PerfEventConfig.h"
+
+#include "common/Exception.h"
+#include "common/Utils.h"
+#include "common/WithErrnoCheck.h"
+#include "logger/Logger.h"
+
+#include <asm/unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const int KERNEL_REPETITIONS = 3;
+const uint64_t KERNEL_ITERATIONS = 100'000'000;
+// Memory kernel's steps are much slower, and its array is much larger than
+// last level caches.
+const uint64_t MEMORY_KERNEL_ITERATIONS = 2'000'000;
+const uint32_t MEMORY_KERNEL_SIZE = 16 * 1024 * 1024;
+
+const std::string INSTRUCTIONS_PER_SECOND_KEY = "instructions-per-second";
+
+long perf_event_open(
+        struct perf_event_attr* hw_event,
+        pid_t pid,
+        int cpu,
+        int group_fd,
+        unsigned long flags) {
+    return syscall(__NR_perf_event_open, hw_event, pid, cpu, group_fd, flags);
+}
+
+/**
+ * Counts user space instructions of the calling thread, on every core PMU
+ * as PerfListener does.
+ */
+class InstructionsCounter {
+public:
+    explicit InstructionsCounter(const std::string& cacheDirectory) {
+        struct perf_event_attr attrs {};
+        memset(&attrs, 0, sizeof(attrs));
+        attrs.size = sizeof(attrs);
+        attrs.exclude_kernel = 1;
+        attrs.exclude_hv = 1;
+        attrs.disabled = 1;
+
+        for (const auto& config:
+             s2j::perf::getInstructionsEventConfigs(cacheDirectory)) {
+            attrs.type = config.type;
+            attrs.config = config.config[0];
+            attrs.config1 = config.config[1];
+            attrs.config2 = config.config[2];
+            perfFds_.emplace_back(s2j::withErrnoCheck(
+                    "perf event open", perf_event_open, &attrs, 0, -1, -1, 0));
+        }
+    }
+
+    ~InstructionsCounter() {
+        for (int perfFd: perfFds_) {
+            close(perfFd);
+        }
+    }
+
+    void start() {
+        for (int perfFd: perfFds_) {
+            s2j::withErrnoCheck(
+                    "reset perf counter", ioctl, perfFd, PERF_EVENT_IOC_RESET);
+            s2j::withErrnoCheck(
+                    "enable perf counter",
+                    ioctl,
+                    perfFd,
+                    PERF_EVENT_IOC_ENABLE);
+        }
+    }
+
+    uint64_t stop() {
+        uint64_t instructions = 0;
+        for (int perfFd: perfFds_) {
+            s2j::withErrnoCheck(
+                    "disable perf counter",
+                    ioctl,
+                    perfFd,
+                    PERF_EVENT_IOC_DISABLE);
+            uint64_t count = 0;
+            if (s2j::withErrnoCheck(
+                        "read perf counter",
+                        read,
+                        perfFd,
+                        &count,
+                        sizeof(count)) != sizeof(count)) {
+                throw s2j::Exception("read failed");
+            }
+            instructions += count;
+        }
+        return instructions;
+    }
+
+private:
+    std::vector<int> perfFds_;
+};
+
+// Results are accumulated here, so that kernels can't be optimized out.
+volatile uint64_t kernelsResult;
+
+// Dependent integer arithmetic, like in most of simple solutions.
+uint64_t arithmeticKernel() {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < KERNEL_ITERATIONS; ++i) {
+        sum += (i * i) ^ (sum >> 3);
+    }
+    return sum;
+}
+
+// Data dependent branches that can't be predicted.
+uint64_t branchKernel() {
+    uint64_t state = 88172645463325252ULL;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < KERNEL_ITERATIONS; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        if ((state & 1) != 0) {
+            sum += state >> 32;
+        }
+        else {
+            sum ^= state;
+        }
+    }
+    return sum;
+}
+
+// Dependent floating point operations.
+uint64_t floatingPointKernel() {
+    double value = 1.0;
+    for (uint64_t i = 0; i < KERNEL_ITERATIONS; ++i) {
+        value = value * 0.999999 + 1e-7;
+    }
+    return static_cast<uint64_t>(value * 1e9);
+}
+
+// Random accesses to memory, following a single cycle through an array.
+std::function<uint64_t()> makeMemoryKernel() {
+    auto next = std::make_shared<std::vector<uint32_t>>(MEMORY_KERNEL_SIZE);
+    for (uint32_t i = 0; i < MEMORY_KERNEL_SIZE; ++i) {
+        (*next)[i] = i;
+    }
+    // Sattolo's algorithm, with a fixed seed so that every host follows the
+    // same cycle.
+    uint64_t state = 2463534242ULL;
+    for (uint32_t i = MEMORY_KERNEL_SIZE - 1; i > 0; --i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        std::swap((*next)[i], (*next)[state % i]);
+    }
+
+    return [next]() -> uint64_t {
+        uint32_t position = 0;
+        for (uint64_t i = 0; i < MEMORY_KERNEL_ITERATIONS; ++i) {
+            position = (*next)[position];
+        }
+        return position;
+    };
+}
+
+} // namespace
+
+namespace s2j {
+namespace perf {
+
+CalibrationProfile CalibrationProfile::load(const std::string& path) {
+    std::ifstream profileFile(path);
+    if (!profileFile.is_open()) {
+        throw Exception("can't open calibration profile " + path);
+    }
+
+    CalibrationProfile profile;
+    std::string key;
+    uint64_t value;
+    while (profileFile >> key >> value) {
+        if (key == INSTRUCTIONS_PER_SECOND_KEY) {
+            profile.instructionsPerSecond = value;
+        }
+    }
+    if (!profileFile.eof() || profile.instructionsPerSecond == 0) {
+        throw Exception("malformed calibration profile " + path);
+    }
+    return profile;
+}
+
+void CalibrationProfile::store(const std::string& path) const {
+    writeFileAtomically(path, dump());
+}
+
+std::string CalibrationProfile::dump() const {
+    std::stringstream ss;
+    ss << INSTRUCTIONS_PER_SECOND_KEY << " " << instructionsPerSecond
+       << std::endl;
+    return ss.str();
+}
+
+CalibrationProfile calibrate(const std::string& cacheDirectory) {
+    TRACE(cacheDirectory);
+
+    const std::vector<std::pair<std::string, std::function<uint64_t()>>>
+            kernels{{"arithmetic", arithmeticKernel},
+                    {"branch", branchKernel},
+                    {"floating point", floatingPointKernel},
+                    {"memory", makeMemoryKernel()}};
+
+    InstructionsCounter counter(cacheDirectory);
+    uint64_t totalInstructions = 0;
+    std::chrono::nanoseconds totalTime{0};
+    for (const auto& kernel: kernels) {
+        uint64_t bestInstructions = 0;
+        std::chrono::nanoseconds bestTime{0};
+        for (int repetition = 0; repetition < KERNEL_REPETITIONS;
+             ++repetition) {
+            auto startTime = std::chrono::steady_clock::now();
+            counter.start();
+            kernelsResult = kernelsResult + kernel.second();
+            uint64_t instructions = counter.stop();
+            auto time = std::chrono::steady_clock::now() - startTime;
+
+            if (repetition == 0 || time < bestTime) {
+                bestInstructions = instructions;
+                bestTime = time;
+            }
+        }
+
+        logger::info(
+                "Calibration kernel ",
+                kernel.first,
+                " executed ",
+                bestInstructions,
+                " instructions in ",
+                bestTime.count(),
+                "ns");
+        totalInstructions += bestInstructions;
+        totalTime += bestTime;
+    }
+
+    if (totalInstructions == 0 || totalTime.count() <= 0) {
+        throw Exception("calibration kernels didn't count any instructions");
+    }
+
+    CalibrationProfile profile;
+    profile.instructionsPerSecond = static_cast<uint64_t>(
+            static_cast<long double>(totalInstructions) * 1'000'000'000 /
+            totalTime.count());
+    return profile;
+}
+
+} // namespace perf
+} // namespace s2j
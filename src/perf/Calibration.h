@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace s2j {
+namespace perf {
+
+/**
+ * Speed of the host, used to convert instruction counts to time.
+ *
+ * Profile file holds "key value" lines, currently only
+ * "instructions-per-second".
+ */
+struct CalibrationProfile {
+    uint64_t instructionsPerSecond{};
+
+    static CalibrationProfile load(const std::string& path);
+    void store(const std::string& path) const;
+    std::string dump() const;
+};
+
+/**
+ * Runs a fixed set of reference kernels with their instructions counted and
+ * measures how many instructions per wall clock second this host executes.
+ *
+ * Each kernel is run several times and only its fastest run is taken, so
+ * that preemptions and frequency ramp-up don't skew the result.
+ */
+CalibrationProfile calibrate(const std::string& cacheDirectory);
+
+} // namespace perf
+} // namespace s2j
@@ -0,0 +1,136 @@
+#include "ElfSymbols.h"
+
+#include "common/Exception.h"
+#include "logger/Logger.h"
+
+#include <elf.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+const uint64_t PAGE_ALIGNMENT = 4096;
+
+template<typename T>
+const T* at(const std::string& image, uint64_t offset, uint64_t count = 1) {
+    if (offset > image.size() || count > (image.size() - offset) / sizeof(T)) {
+        throw s2j::Exception("malformed ELF file, data out of bounds");
+    }
+    return reinterpret_cast<const T*>(image.data() + offset);
+}
+
+} // namespace
+
+namespace s2j {
+namespace perf {
+
+ElfSymbols::ElfSymbols(const std::string& path) {
+    TRACE(path);
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw Exception("can't open ELF file " + path);
+    }
+    std::string image{
+            std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>()};
+
+    const auto* ident = at<unsigned char>(image, 0, EI_NIDENT);
+    if (std::string(reinterpret_cast<const char*>(ident), SELFMAG) != ELFMAG) {
+        throw Exception("not an ELF file " + path);
+    }
+    if (ident[EI_CLASS] == ELFCLASS64) {
+        parse<Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr, Elf64_Sym>(image);
+    }
+    else if (ident[EI_CLASS] == ELFCLASS32) {
+        parse<Elf32_Ehdr, Elf32_Phdr, Elf32_Shdr, Elf32_Sym>(image);
+    }
+    else {
+        throw Exception("unsupported ELF class of " + path);
+    }
+    logger::debug("Read ", symbols_.size(), " function symbols from ", path);
+}
+
+template<typename Ehdr, typename Phdr, typename Shdr, typename Sym>
+void ElfSymbols::parse(const std::string& image) {
+    const auto* header = at<Ehdr>(image, 0);
+    positionIndependent_ = header->e_type == ET_DYN;
+
+    const auto* programHeaders =
+            at<Phdr>(image, header->e_phoff, header->e_phnum);
+    bool hasLoadSegment = false;
+    for (int index = 0; index < header->e_phnum; ++index) {
+        const Phdr& segment = programHeaders[index];
+        if (segment.p_type != PT_LOAD) {
+            continue;
+        }
+        uint64_t address = segment.p_vaddr & ~(PAGE_ALIGNMENT - 1);
+        if (!hasLoadSegment || address < loadAddress_) {
+            loadAddress_ = address;
+        }
+        hasLoadSegment = true;
+    }
+
+    const auto* sections = at<Shdr>(image, header->e_shoff, header->e_shnum);
+    for (int index = 0; index < header->e_shnum; ++index) {
+        const Shdr& section = sections[index];
+        // Only static symbol table, dynamic one of executables is mostly
+        // imported functions.
+        if (section.sh_type != SHT_SYMTAB ||
+            section.sh_link >= header->e_shnum) {
+            continue;
+        }
+        const Shdr& strings = sections[section.sh_link];
+        const auto* names = at<char>(image, strings.sh_offset, strings.sh_size);
+        const auto* symbols = at<Sym>(
+                image, section.sh_offset, section.sh_size / sizeof(Sym));
+        for (uint64_t symbol = 0; symbol < section.sh_size / sizeof(Sym);
+             ++symbol) {
+            const Sym& entry = symbols[symbol];
+            if ((entry.st_info & 0xf) != STT_FUNC || entry.st_value == 0 ||
+                entry.st_name >= strings.sh_size) {
+                continue;
+            }
+            const char* name = names + entry.st_name;
+            symbols_.push_back(Symbol{
+                    entry.st_value,
+                    entry.st_size,
+                    std::string(
+                            name,
+                            std::find(name, names + strings.sh_size, '\0'))});
+        }
+    }
+
+    std::sort(
+            symbols_.begin(),
+            symbols_.end(),
+            [](const Symbol& lhs, const Symbol& rhs) {
+                return lhs.address < rhs.address;
+            });
+}
+
+std::string ElfSymbols::findFunction(uint64_t address) const {
+    // Last symbol starting at or before address
+    auto symbol = std::upper_bound(
+            symbols_.begin(),
+            symbols_.end(),
+            address,
+            [](uint64_t address, const Symbol& symbol) {
+                return address < symbol.address;
+            });
+    if (symbol == symbols_.begin()) {
+        return "";
+    }
+    --symbol;
+    // Some hand written functions have no size, attribute address to them
+    // rather than to nothing.
+    if (symbol->size != 0 && address >= symbol->address + symbol->size) {
+        return "";
+    }
+    return symbol->name;
+}
+
+} // namespace perf
+} // namespace s2j
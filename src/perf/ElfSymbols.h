@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace s2j {
+namespace perf {
+
+/**
+ * Function symbols from static symbol table (.symtab) of an ELF file, both
+ * 32 and 64 bit. Stripped files have no symbols, but can still be used to
+ * compute load bias of position independent executables.
+ */
+class ElfSymbols {
+public:
+    explicit ElfSymbols(const std::string& path);
+
+    /**
+     * Whether file is loaded at an address chosen by kernel.
+     */
+    bool isPositionIndependent() const {
+        return positionIndependent_;
+    }
+
+    /**
+     * Lowest virtual address of loaded segments, page aligned, i.e. address
+     * at which file's first page is mapped when not relocated.
+     */
+    uint64_t getLoadAddress() const {
+        return loadAddress_;
+    }
+
+    /**
+     * Name of function containing given (not relocated) address, or empty
+     * string if there is none.
+     */
+    std::string findFunction(uint64_t address) const;
+
+private:
+    struct Symbol {
+        uint64_t address;
+        uint64_t size;
+        std::string name;
+    };
+
+    template<typename Ehdr, typename Phdr, typename Shdr, typename Sym>
+    void parse(const std::string& image);
+
+    bool positionIndependent_{};
+    uint64_t loadAddress_{};
+    // Sorted by address
+    std::vector<Symbol> symbols_;
+};
+
+} // namespace perf
+} // namespace s2j
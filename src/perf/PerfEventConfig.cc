@@ -0,0 +1,215 @@
+#include "PerfEventConfig.h"
+
+#include "common/Assert.h"
+#include "common/Exception.h"
+#include "common/Utils.h"
+#include "common/WithErrnoCheck.h"
+#include "logger/Logger.h"
+
+#include <dirent.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+namespace {
+
+// A "simple" file is oneline and has no whitespace.
+std::string readSimpleFile(const std::string& path) {
+    std::string result;
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return "";
+    }
+    file >> result;
+    return result;
+}
+
+// Parse "config", "config1" and "config2", for everything else return -1.
+int getConfigFieldNumber(const std::string& name) {
+    if (name.size() < 6 || name.size() > 7 || name.substr(0, 6) != "config") {
+        return -1;
+    }
+    int index = name.size() == 7 ? int(name[6] - '0') : 0;
+    return index < 0 || index > 3 ? -1 : index;
+}
+
+// Tracefs is mounted on its own since Linux 4.1, and under debugfs before.
+const std::vector<std::string> TRACEFS_PATHS{
+        "/sys/kernel/tracing",
+        "/sys/kernel/debug/tracing"};
+
+std::vector<s2j::perf::PerfEventConfig> discoverEventConfigs() {
+    using s2j::perf::PerfEventConfig;
+    namespace logger = s2j::logger;
+
+    std::vector<PerfEventConfig> eventConfigs;
+    const std::string sysfsPath = "/sys/devices";
+    std::unique_ptr<DIR, int (*)(DIR*)> sysfsDir(
+            s2j::withErrnoCheck(
+                    "open /sys/devices directory", opendir, sysfsPath.c_str()),
+            closedir);
+    for (struct dirent* entry = readdir(sysfsDir.get()); entry != nullptr;
+         entry = readdir(sysfsDir.get())) {
+        // According to linux's perf tool at tools/perf/util/pmus.c, we need
+        // to consider folders with the "cpu" name or with a "cpus" file inside.
+        std::string dir = sysfsPath + "/" + entry->d_name + "/",
+                    cpus = readSimpleFile(dir + "cpus"),
+                    type = readSimpleFile(dir + "type");
+        if ((strcmp(entry->d_name, "cpu") && !cpus.size()) || !type.size()) {
+            continue;
+        }
+
+        logger::debug("Generating a raw perf event from ", dir);
+        PerfEventConfig config;
+        config.type = std::stoul(type);
+        std::string configStr = readSimpleFile(dir + "events/instructions");
+        assert_1(configStr.size());
+
+        // This parses for example "event=0x2e,umask=0x4f"
+        for (const std::string& s: s2j::split(configStr, ",")) {
+            auto spl = s2j::split(s, "=0x");
+            assert_1(spl.size() == 2);
+            std::string& name = spl[0];
+            uint64_t value = std::stoull(spl[1], nullptr, 16);
+            logger::debug("Setting '", name, "' in the config to ", value);
+            int field = getConfigFieldNumber(name);
+            if (field >= 0) { // set an entire config field
+                config.config[field] |= value;
+            }
+            else { // set only certain bits
+                std::string format = readSimpleFile(dir + "format/" + name);
+                assert_1(format.size());
+                config.insertIntoConfig(format, value);
+            }
+        }
+        eventConfigs.emplace_back(config);
+    }
+    return eventConfigs;
+}
+
+// Cache file holds one "type config config1 config2" line per PMU.
+bool loadFromCache(
+        const std::string& path,
+        std::vector<s2j::perf::PerfEventConfig>& eventConfigs) {
+    std::ifstream cacheFile(path);
+    if (!cacheFile.is_open()) {
+        return false;
+    }
+
+    s2j::perf::PerfEventConfig config;
+    while (cacheFile >> config.type >> config.config[0] >> config.config[1] >>
+           config.config[2]) {
+        eventConfigs.emplace_back(config);
+    }
+    if (!cacheFile.eof() || eventConfigs.empty()) {
+        s2j::logger::warn("Ignoring malformed perf cache file ", path);
+        eventConfigs.clear();
+        return false;
+    }
+    return true;
+}
+
+void storeInCache(
+        const std::string& path,
+        const std::vector<s2j::perf::PerfEventConfig>& eventConfigs) {
+    std::stringstream content;
+    for (const auto& config: eventConfigs) {
+        content << config.type << " " << config.config[0] << " "
+                << config.config[1] << " " << config.config[2] << "\n";
+    }
+
+    try {
+        s2j::writeFileAtomically(path, content.str());
+    }
+    catch (const s2j::SystemException& ex) {
+        s2j::logger::warn("Can't store perf events in cache: ", ex.what());
+    }
+}
+
+} // namespace
+
+namespace s2j {
+namespace perf {
+
+void PerfEventConfig::insertIntoConfig(
+        const std::string& format,
+        uint64_t value) {
+    // `format` specifies the bits which need to be set to `value`.
+    // It can look like config:0-7, config1:8 or even config:0-7,32-35.
+    // According to https://lwn.net/Articles/611945/, the attributes
+    // can overlap.
+    auto spl = split(format, ":");
+    assert_1(spl.size() == 2);
+    int field = getConfigFieldNumber(spl[0]);
+    assert_1(field >= 0);
+    // Iterate over bit ranges.
+    for (const std::string& s: split(spl[1], ",")) {
+        auto rangespl = split(s, "-");
+        assert_1(rangespl.size() && rangespl.size() < 3);
+        unsigned long start = std::stoul(rangespl[0]), end = start;
+        if (rangespl.size() == 2) {
+            end = std::stoul(rangespl[1]);
+        }
+        assert_1(start <= end);
+        unsigned long width = end - start + 1;
+        config[field] |= (value & ((1ull << width) - 1)) << start;
+        value >>= width;
+    }
+    assert_1(!value);
+}
+
+const std::vector<PerfEventConfig>& getInstructionsEventConfigs(
+        const std::string& cacheDirectory) {
+    TRACE(cacheDirectory);
+
+    static std::vector<PerfEventConfig> eventConfigs;
+    if (!eventConfigs.empty()) {
+        return eventConfigs;
+    }
+
+    std::string cachePath;
+    if (!cacheDirectory.empty()) {
+        std::string bootId = readSimpleFile("/proc/sys/kernel/random/boot_id");
+        if (bootId.empty()) {
+            logger::warn("Can't read boot id, perf cache is not used");
+        }
+        else {
+            cachePath = cacheDirectory + "/pmu-" + bootId;
+            if (loadFromCache(cachePath, eventConfigs)) {
+                logger::debug("Perf events loaded from cache ", cachePath);
+                return eventConfigs;
+            }
+        }
+    }
+
+    eventConfigs = discoverEventConfigs();
+    // Inform the user rather than silently provide a possibly faulty fallback.
+    if (eventConfigs.empty()) {
+        throw Exception("failed to generate at least one perf event config");
+    }
+    if (!cachePath.empty()) {
+        storeInCache(cachePath, eventConfigs);
+    }
+    return eventConfigs;
+}
+
+uint64_t getTracepointConfig(const std::string& tracepoint) {
+    TRACE(tracepoint);
+
+    for (const auto& tracefsPath: TRACEFS_PATHS) {
+        std::string id =
+                readSimpleFile(tracefsPath + "/events/" + tracepoint + "/id");
+        if (!id.empty()) {
+            return std::stoull(id);
+        }
+    }
+    throw Exception(
+            "can't find perf tracepoint " + tracepoint +
+            ", is tracefs mounted?");
+}
+
+} // namespace perf
+} // namespace s2j
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace s2j {
+namespace perf {
+
+/**
+ * Raw perf event attributes of instructions event on a single PMU.
+ */
+struct PerfEventConfig {
+    uint32_t type = 0;
+    uint64_t config[3] = {0, 0, 0};
+
+    void insertIntoConfig(const std::string& format, uint64_t value);
+};
+
+/**
+ * Returns instructions event configs of all core PMUs found in /sys/devices.
+ *
+ * PMU layout doesn't change until reboot, so discovery is done once per
+ * process. When cacheDirectory is not empty configs are also stored there in
+ * a file named after current boot id and reused by subsequent processes.
+ */
+const std::vector<PerfEventConfig>& getInstructionsEventConfigs(
+        const std::string& cacheDirectory);
+
+/**
+ * Returns perf config of tracepoint given as "subsystem/event", read from
+ * tracefs mounted at one of its usual places.
+ */
+uint64_t getTracepointConfig(const std::string& tracepoint);
+
+} // namespace perf
+} // namespace s2j
@@ -1,23 +1,33 @@
 #include "PerfListener.h"
+#include "PerfEventConfig.h"
 
 #include "common/Assert.h"
 #include "common/Exception.h"
 #include "common/Utils.h"
 #include "common/WithErrnoCheck.h"
 #include "logger/Logger.h"
+#include "seccomp/SeccompContext.h"
+#include "seccomp/SyscallProfile.h"
+#include "tracer/Tracee.h"
 
 #include <asm/unistd.h>
-#include <dirent.h>
+#include <elf.h>
 #include <fcntl.h>
 #include <linux/hw_breakpoint.h>
 #include <linux/perf_event.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <csignal>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <map>
+#include <sstream>
 
 namespace {
 
@@ -30,6 +40,89 @@ long perf_event_open(
     return syscall(__NR_perf_event_open, hw_event, pid, cpu, group_fd, flags);
 }
 
+// Layout of a group read with PERF_FORMAT_GROUP,
+// PERF_FORMAT_TOTAL_TIME_ENABLED and PERF_FORMAT_TOTAL_TIME_RUNNING, followed
+// by values of all events in the group.
+struct GroupReadFormat {
+    uint64_t nr;
+    uint64_t timeEnabled;
+    uint64_t timeRunning;
+};
+
+// Hardware events on hybrid CPUs need PMU type in upper bits of config, see
+// PERF_PMU_TYPE_SHIFT.
+const int PMU_TYPE_SHIFT = 32;
+
+const std::string SYSCALL_TRACEPOINT = "raw_syscalls/sys_enter";
+
+// Event counting syscalls for syscall statistics
+const std::string SYSCALLS_EVENT = "syscalls";
+
+std::vector<std::string> withEvent(
+        std::vector<std::string> events,
+        const std::string& event) {
+    if (std::find(events.begin(), events.end(), event) == events.end()) {
+        events.push_back(event);
+    }
+    return events;
+}
+
+/**
+ * Architecture of syscalls made by given executable, by its ELF class.
+ */
+s2j::tracer::Arch getExecutableArch(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    unsigned char ident[EI_NIDENT];
+    if (!file.read(reinterpret_cast<char*>(ident), EI_NIDENT) ||
+        memcmp(ident, ELFMAG, SELFMAG) != 0) {
+        return s2j::tracer::Arch::UNKNOWN;
+    }
+    if (ident[EI_CLASS] == ELFCLASS64) {
+        return s2j::tracer::Arch::X86_64;
+    }
+    if (ident[EI_CLASS] == ELFCLASS32) {
+        return s2j::tracer::Arch::X86;
+    }
+    return s2j::tracer::Arch::UNKNOWN;
+}
+
+/**
+ * Consumes all records from ring buffer with dataSize bytes of data following
+ * its metadata page. Handler gets type of each record and a function that
+ * returns its n-th 8 byte field after header.
+ */
+template<typename Handler>
+void consumeRecords(
+        void* ringBuffer,
+        uint64_t pageSize,
+        uint64_t dataSize,
+        Handler handler) {
+    auto* metadata = static_cast<struct perf_event_mmap_page*>(ringBuffer);
+    const char* data = static_cast<const char*>(ringBuffer) + pageSize;
+
+    // Records are complete up to data_head, which kernel publishes after
+    // writing them.
+    uint64_t head = __atomic_load_n(&metadata->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = metadata->data_tail;
+    while (tail < head) {
+        // Records are 8 byte aligned, so their fields never wrap around.
+        const auto* header = reinterpret_cast<const struct perf_event_header*>(
+                data + tail % dataSize);
+        if (header->size == 0) {
+            throw s2j::Exception("malformed perf ring buffer record");
+        }
+        auto field = [&](size_t index) {
+            return *reinterpret_cast<const uint64_t*>(
+                    data +
+                    (tail + sizeof(*header) + index * sizeof(uint64_t)) %
+                            dataSize);
+        };
+        handler(header->type, field);
+        tail += header->size;
+    }
+    __atomic_store_n(&metadata->data_tail, tail, __ATOMIC_RELEASE);
+}
+
 } // namespace
 
 namespace s2j {
@@ -37,146 +130,221 @@ namespace perf {
 
 const Feature PerfListener::feature = Feature::PERF;
 
+const uint64_t PerfListener::DEFAULT_PROFILE_PERIOD = 1'000'000;
+
+const std::map<std::string, PerfListener::Event> PerfListener::EVENTS{
+        {"cycles", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, false}},
+        {"cache-references",
+         {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, false}},
+        {"cache-misses",
+         {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, false}},
+        {"branches",
+         {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, false}},
+        {"branch-misses",
+         {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, false}},
+        {"page-faults", {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, false}},
+        {"minor-faults",
+         {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN, false}},
+        {"major-faults",
+         {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ, false}},
+        // Scheduler events happen in kernel mode
+        {"context-switches",
+         {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, true}},
+        {"cpu-migrations",
+         {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, true}},
+        // Tracepoints fire in kernel mode too
+        {"syscalls", {PERF_TYPE_TRACEPOINT, 0, true, SYSCALL_TRACEPOINT}},
+};
+
 PerfListener::PerfListener(
         uint64_t instructionCountLimit,
-        uint64_t samplingFactor)
+        uint64_t samplingFactor,
+        std::string cacheDirectory,
+        bool inherit,
+        std::vector<std::string> events,
+        uint64_t threadInstructionCountLimit,
+        uint64_t profilePeriod,
+        size_t profileEntries,
+        bool rearmPeriod,
+        std::string syscallProfilePath,
+        SyscallStats syscallStats,
+        std::map<std::string, uint64_t> syscallBudgets)
         : instructionCountLimit_(instructionCountLimit)
-        , samplingFactor_{std::max<uint64_t>(1ULL, samplingFactor)} {}
+        , threadInstructionCountLimit_(threadInstructionCountLimit)
+        , samplingFactor_{std::max<uint64_t>(1ULL, samplingFactor)}
+        , cacheDirectory_(std::move(cacheDirectory))
+        , inherit_(inherit)
+        , events_(
+                  syscallStats != SyscallStats::OFF
+                          ? withEvent(events, SYSCALLS_EVENT)
+                          : events)
+        , reportedEventsCount_(events.size())
+        , profilePeriod_(inherit ? 0 : profilePeriod)
+        , profileEntries_(profileEntries)
+        , rearmPeriod_(inherit ? false : rearmPeriod)
+        , syscallProfilePath_(inherit ? "" : std::move(syscallProfilePath))
+        , syscallStats_(syscallStats)
+        , syscallBudgets_(
+                  inherit ? std::map<std::string, uint64_t>{}
+                          : std::move(syscallBudgets))
+        , recordSyscalls_(
+                  !syscallProfilePath_.empty() ||
+                  (!inherit && syscallStats == SyscallStats::HISTOGRAM)) {
+    // Overflows have to be frequent enough for the tighter of limits. Re-armed
+    // counters get their exact budget once opened, so they don't need to
+    // oversample.
+    for (uint64_t limit:
+         {instructionCountLimit_, threadInstructionCountLimit_}) {
+        if (limit == 0) {
+            continue;
+        }
+        uint64_t period = rearmPeriod_
+                ? limit
+                : std::max<uint64_t>(1ULL, limit / samplingFactor_);
+        if (samplePeriod_ == 0 || period < samplePeriod_) {
+            samplePeriod_ = period;
+        }
+    }
+}
 
 PerfListener::~PerfListener() {
     // TODO: handle closing perfFds in move assignement / constructor as well
-    for (int& fd: perfFds_)
-        if (fd >= 0) {
-            close(fd);
-            fd = -1;
-        }
+    for (auto& thread: threads_) {
+        closeCounters(thread);
+    }
+    if (epollFd_ >= 0) {
+        close(epollFd_);
+    }
 }
 
 void PerfListener::onPreFork() {
     TRACE();
 
-    barrier_ =
-            withGuardedErrnoCheck(
-                    "mmap shared memory",
-                    [](auto&& result) -> bool { return result != MAP_FAILED; },
-                    mmap,
-                    nullptr,
-                    sizeof(pthread_barrier_t),
-                    PROT_READ | PROT_WRITE,
-                    MAP_ANONYMOUS | MAP_SHARED,
-                    0,
-                    0)
-                    .as<pthread_barrier_t*>();
-
-    pthread_barrierattr_t attr;
-    pthread_barrierattr_init(&attr);
-    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
-
-    pthread_barrier_init(barrier_, &attr, 2);
-
-    pthread_barrierattr_destroy(&attr);
-}
-
-// A "simple" file is oneline and has no whitespace.
-std::string readSimpleFile(const std::string& path) {
-    std::string result;
-    std::ifstream file(path);
-    if (!file.is_open()) {
-        return "";
-    }
-    file >> result;
-    return result;
-}
-
-// Parse "config", "config1" and "config2", for everything else return -1.
-int getConfigFieldNumber(const std::string& name) {
-    if (name.size() < 6 || name.size() > 7 || name.substr(0, 6) != "config") {
-        return -1;
-    }
-    int index = name.size() == 7 ? int(name[6] - '0') : 0;
-    return index < 0 || index > 3 ? -1 : index;
-}
-
-struct perfEventConfig {
-    uint32_t type = 0;
-    uint64_t config[3] = {0, 0, 0};
-    void insertIntoConfig(const std::string& format, uint64_t value) {
-        // `format` specifies the bits which need to be set to `value`.
-        // It can look like config:0-7, config1:8 or even config:0-7,32-35.
-        // According to https://lwn.net/Articles/611945/, the attributes
-        // can overlap.
-        auto spl = split(format, ":");
-        assert_1(spl.size() == 2);
-        int field = getConfigFieldNumber(spl[0]);
-        assert_1(field >= 0);
-        // Iterate over bit ranges.
-        for (const std::string& s: split(spl[1], ",")) {
-            auto rangespl = split(s, "-");
-            assert_1(rangespl.size() && rangespl.size() < 3);
-            unsigned long start = std::stoul(rangespl[0]), end = start;
-            if (rangespl.size() == 2) {
-                end = std::stoul(rangespl[1]);
-            }
-            assert_1(start <= end);
-            unsigned long width = end - start + 1;
-            config[field] |= (value & ((1ull << width) - 1)) << start;
-            value >>= width;
-        }
-        assert_1(!value);
+    // Child waits until its counters are opened, so anything that doesn't
+    // need its pid is done before fork.
+    getInstructionsEventConfigs(cacheDirectory_);
+    pageSize_ = sysconf(_SC_PAGESIZE);
+    if ((samplePeriod_ != 0 || profilePeriod_ != 0 || recordSyscalls_ ||
+         !syscallBudgets_.empty()) &&
+        !inherit_ && epollFd_ < 0) {
+        epollFd_ = withErrnoCheck(
+                "perf epoll_create", epoll_create1, EPOLL_CLOEXEC);
     }
-};
+}
 
 void PerfListener::onPostForkParent(pid_t childPid) {
     TRACE();
 
     childPid_ = childPid;
+    openCounters(childPid, true);
+}
 
-    std::vector<perfEventConfig> eventConfigs;
-    const std::string sysfsPath = "/sys/devices";
-    std::unique_ptr<DIR, int (*)(DIR*)> sysfsDir(
-            withErrnoCheck(
-                    "open /sys/devices directory", opendir, sysfsPath.c_str()),
-            closedir);
-    for (struct dirent* entry = readdir(sysfsDir.get()); entry != nullptr;
-         entry = readdir(sysfsDir.get())) {
-        // According to linux's perf tool at tools/perf/util/pmus.c, we need
-        // to consider folders with the "cpu" name or with a "cpus" file inside.
-        std::string dir = sysfsPath + "/" + entry->d_name + "/",
-                    cpus = readSimpleFile(dir + "cpus"),
-                    type = readSimpleFile(dir + "type");
-        if ((strcmp(entry->d_name, "cpu") && !cpus.size()) || !type.size()) {
-            continue;
-        }
+bool PerfListener::requiresParentSetup() {
+    // Counters have to be opened before child executes the program.
+    return true;
+}
+
+tracer::TraceAction PerfListener::onPostExec(
+        const tracer::TraceEvent& /* traceEvent */,
+        tracer::Tracee& tracee) {
+    TRACE(tracee.getPid());
+
+    if (recordSyscalls_ || !syscallBudgets_.empty()) {
+        syscallArch_ = getExecutableArch(
+                "/proc/" + std::to_string(tracee.getPid()) + "/exe");
+        setupSyscallBudgets();
+    }
+    if (profilePeriod_ == 0) {
+        return tracer::TraceAction::CONTINUE;
+    }
+
+    // Program is symbolized now, as both its file and its mappings can be
+    // gone when it exits.
+    try {
+        std::string procPath = "/proc/" + std::to_string(tracee.getPid());
+        symbols_ = std::make_unique<ElfSymbols>(procPath + "/exe");
+
+        struct stat executableStat {};
+        withErrnoCheck(
+                "stat executable",
+                stat,
+                (procPath + "/exe").c_str(),
+                &executableStat);
 
-        logger::debug("Generating a raw perf event from ", dir);
-        perfEventConfig config;
-        config.type = std::stoul(type);
-        std::string configStr = readSimpleFile(dir + "events/instructions");
-        assert_1(configStr.size());
-
-        // This parses for example "event=0x2e,umask=0x4f"
-        for (const std::string& s: split(configStr, ",")) {
-            auto spl = split(s, "=0x");
-            assert_1(spl.size() == 2);
-            std::string& name = spl[0];
-            uint64_t value = std::stoull(spl[1], nullptr, 16);
-            logger::debug("Setting '", name, "' in the config to ", value);
-            int field = getConfigFieldNumber(name);
-            if (field >= 0) { // set an entire config field
-                config.config[field] |= value;
+        std::ifstream maps(procPath + "/maps");
+        std::string line;
+        while (std::getline(maps, line)) {
+            // start-end perms offset dev inode path
+            uint64_t start, end, offset, inode;
+            std::string permissions, device;
+            char dash;
+            std::stringstream ss(line);
+            ss >> std::hex >> start >> dash >> end >> permissions >> offset >>
+                    device >> std::dec >> inode;
+            if (!ss || inode != executableStat.st_ino) {
+                continue;
             }
-            else { // set only certain bits
-                std::string format = readSimpleFile(dir + "format/" + name);
-                assert_1(format.size());
-                config.insertIntoConfig(format, value);
+            if (offset == 0 && symbols_->isPositionIndependent()) {
+                loadBias_ = start - symbols_->getLoadAddress();
+            }
+            if (permissions.find('x') != std::string::npos) {
+                executableMappings_.emplace_back(start, end);
             }
         }
-        eventConfigs.emplace_back(config);
     }
-    // Inform the user rather than silently provide a possibly faulty fallback.
-    if (eventConfigs.empty()) {
-        throw Exception("failed to generate at least one perf event config");
+    catch (const Exception& ex) {
+        logger::warn("Can't symbolize perf profile: ", ex.what());
+        symbols_.reset();
+        executableMappings_.clear();
+    }
+    return tracer::TraceAction::CONTINUE;
+}
+
+std::tuple<tracer::TraceAction, tracer::TraceAction> PerfListener::onPostClone(
+        const tracer::TraceEvent& /* traceEvent */,
+        tracer::Tracee& /* tracee */,
+        tracer::Tracee& traceeChild) {
+    TRACE(traceeChild.getPid());
+
+    if (!inherit_) {
+        // New thread is stopped until all listeners are done, so its
+        // counters don't miss anything.
+        openCounters(traceeChild.getPid(), false);
+    }
+    return {tracer::TraceAction::CONTINUE, tracer::TraceAction::CONTINUE};
+}
+
+executor::ExecuteAction PerfListener::onExecuteEvent(
+        const executor::ExecuteEvent& executeEvent) {
+    if (inherit_ || (!executeEvent.exited && !executeEvent.killed)) {
+        return executor::ExecuteAction::CONTINUE;
+    }
+
+    // Counters of finished threads keep their final values, remember them
+    // and release fds, so that threads created later don't exhaust them.
+    // Syscalls recorded until the exit are checked, as the buffer may not
+    // have filled up enough to be polled.
+    for (auto& thread: threads_) {
+        if (thread.tid == executeEvent.pid && thread.counts.empty()) {
+            thread.budgetCounts = readBudgetCounters(thread);
+            thread.counts = readCounters(thread);
+            readSamples(thread);
+            closeCounters(thread);
+            logger::debug(
+                    "Thread ",
+                    thread.tid,
+                    " finished after ",
+                    thread.counts[0],
+                    " instructions");
+        }
     }
+    return checkSyscallBudgets();
+}
+
+void PerfListener::openCounters(pid_t tid, bool enableOnExec) {
+    TRACE(tid, enableOnExec);
+
+    const auto& eventConfigs = getInstructionsEventConfigs(cacheDirectory_);
 
     struct perf_event_attr attrs {};
     memset(&attrs, 0, sizeof(attrs));
@@ -184,15 +352,22 @@ void PerfListener::onPostForkParent(pid_t childPid) {
     attrs.exclude_user = 0;
     attrs.exclude_kernel = 1;
     attrs.exclude_hv = 1;
-    attrs.disabled = 1;
-    attrs.enable_on_exec = 1;
-    attrs.inherit = 1;
-    if (instructionCountLimit_ != 0) {
-        attrs.sample_period = instructionCountLimit_ / samplingFactor_;
+    attrs.disabled = enableOnExec ? 1 : 0;
+    attrs.enable_on_exec = enableOnExec ? 1 : 0;
+    attrs.inherit = inherit_ ? 1 : 0;
+    attrs.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+    if (samplePeriod_ != 0) {
+        attrs.sample_period = samplePeriod_;
         attrs.wakeup_events = 1;
     }
 
-    for (auto& config: eventConfigs) {
+    threads_.emplace_back();
+    ThreadCounters& thread = threads_.back();
+    thread.tid = tid;
+    for (const auto& config: eventConfigs) {
+        // Events of different PMUs can't be grouped together, so each of
+        // them leads its own group.
         logger::debug("Opening perf event for pmu with id ", config.type);
         attrs.type = config.type;
         attrs.config = config.config[0];
@@ -207,86 +382,940 @@ void PerfListener::onPostForkParent(pid_t childPid) {
                 "perf event open",
                 perf_event_open,
                 &attrs,
-                childPid,
+                tid,
+                -1,
+                -1,
+                0 /* PERF_FLAG_FD_CLOEXEC */);
+        withErrnoCheck(
+                "set cloexec flag on perfFd",
+                fcntl,
+                perfFd,
+                F_SETFD,
+                FD_CLOEXEC);
+        thread.groupFds.emplace_back(perfFd);
+
+        openGroupMembers(thread, perfFd, config.type, eventConfigs.size() > 1);
+    }
+
+    if (profilePeriod_ != 0) {
+        openProfileCounters(thread, enableOnExec);
+    }
+    if (recordSyscalls_) {
+        openSyscallCounter(thread, enableOnExec);
+    }
+    if (!syscallBudgetsByNumber_.empty()) {
+        openBudgetCounters(thread);
+    }
+
+    if (samplePeriod_ == 0) {
+        return;
+    }
+
+    if (epollFd_ >= 0) {
+        for (int perfFd: thread.groupFds) {
+            void* ringBuffer = mapRingBuffer(perfFd, 1);
+            if (ringBuffer == nullptr) {
+                break;
+            }
+            thread.ringBuffers.emplace_back(ringBuffer);
+        }
+        if (thread.ringBuffers.size() != thread.groupFds.size()) {
+            for (void* ringBuffer: thread.ringBuffers) {
+                munmap(ringBuffer, 2 * pageSize_);
+            }
+            thread.ringBuffers.clear();
+        }
+    }
+
+    for (size_t index = 0; index < thread.groupFds.size(); ++index) {
+        int perfFd = thread.groupFds[index];
+        if (!thread.ringBuffers.empty()) {
+            watchRingBuffer(thread, perfFd, index);
+            continue;
+        }
+        int myPid = getpid();
+        withErrnoCheck("fcntl", fcntl, perfFd, F_SETOWN, myPid);
+        int oldFlags = withErrnoCheck("fcntl", fcntl, perfFd, F_GETFL, 0);
+        withErrnoCheck("fcntl", fcntl, perfFd, F_SETFL, oldFlags | O_ASYNC);
+    }
+
+    if (rearmPeriod_) {
+        // Budget is now shared with one more thread
+        rearmCounters();
+    }
+}
+
+void PerfListener::openProfileCounters(
+        ThreadCounters& thread,
+        bool enableOnExec) {
+    TRACE(thread.tid);
+
+    struct perf_event_attr attrs {};
+    memset(&attrs, 0, sizeof(attrs));
+    attrs.size = sizeof(attrs);
+    attrs.exclude_kernel = 1;
+    attrs.exclude_hv = 1;
+    attrs.disabled = enableOnExec ? 1 : 0;
+    attrs.enable_on_exec = enableOnExec ? 1 : 0;
+    attrs.sample_period = profilePeriod_;
+    attrs.sample_type = PERF_SAMPLE_IP;
+    // Samples are consumed when buffer is half full, or when thread exits
+    attrs.watermark = 1;
+    attrs.wakeup_watermark = PROFILE_BUFFER_PAGES * pageSize_ / 2;
+
+    for (const auto& config: getInstructionsEventConfigs(cacheDirectory_)) {
+        attrs.type = config.type;
+        attrs.config = config.config[0];
+        attrs.config1 = config.config[1];
+        attrs.config2 = config.config[2];
+        int perfFd = withErrnoCheck(
+                "perf event open profile",
+                perf_event_open,
+                &attrs,
+                thread.tid,
                 -1,
                 -1,
-                PERF_FLAG_FD_NO_GROUP /* | PERF_FLAG_FD_CLOEXEC */);
+                0 /* PERF_FLAG_FD_CLOEXEC */);
         withErrnoCheck(
-                "set cloexec flag on perfFd", fcntl, F_SETFD, FD_CLOEXEC);
-        if (instructionCountLimit_ != 0) {
-            int myPid = getpid();
-            withErrnoCheck("fcntl", fcntl, perfFd, F_SETOWN, myPid);
-            int oldFlags = withErrnoCheck("fcntl", fcntl, perfFd, F_GETFL, 0);
-            withErrnoCheck("fcntl", fcntl, perfFd, F_SETFL, oldFlags | O_ASYNC);
+                "set cloexec flag on perfFd",
+                fcntl,
+                perfFd,
+                F_SETFD,
+                FD_CLOEXEC);
+        thread.profileFds.emplace_back(perfFd);
+
+        void* ringBuffer = mapRingBuffer(perfFd, PROFILE_BUFFER_PAGES);
+        if (ringBuffer == nullptr) {
+            throw Exception("can't map perf profile ring buffer");
         }
-        perfFds_.emplace_back(perfFd);
+        thread.profileBuffers.emplace_back(ringBuffer);
+        watchRingBuffer(
+                thread,
+                perfFd,
+                thread.groupFds.size() + thread.profileFds.size() - 1);
     }
+}
+
+void PerfListener::openSyscallCounter(
+        ThreadCounters& thread,
+        bool enableOnExec) {
+    TRACE(thread.tid);
+
+    struct perf_event_attr attrs {};
+    memset(&attrs, 0, sizeof(attrs));
+    attrs.size = sizeof(attrs);
+    attrs.type = PERF_TYPE_TRACEPOINT;
+    attrs.config = getTracepointConfig(SYSCALL_TRACEPOINT);
+    // Tracepoint fires in kernel, so it can't exclude it
+    attrs.exclude_hv = 1;
+    attrs.disabled = enableOnExec ? 1 : 0;
+    attrs.enable_on_exec = enableOnExec ? 1 : 0;
+    attrs.sample_period = 1;
+    attrs.sample_type = PERF_SAMPLE_RAW;
+    attrs.watermark = 1;
+    attrs.wakeup_watermark = SYSCALL_BUFFER_PAGES * pageSize_ / 2;
 
-    pthread_barrier_wait(barrier_);
-    pthread_barrier_destroy(barrier_);
+    thread.syscallFd = withErrnoCheck(
+            "perf event open " + SYSCALL_TRACEPOINT,
+            perf_event_open,
+            &attrs,
+            thread.tid,
+            -1,
+            -1,
+            0 /* PERF_FLAG_FD_CLOEXEC */);
     withErrnoCheck(
-            "munmap shared memory",
-            munmap,
-            barrier_,
-            sizeof(pthread_barrier_t));
+            "set cloexec flag on perfFd",
+            fcntl,
+            thread.syscallFd,
+            F_SETFD,
+            FD_CLOEXEC);
+
+    thread.syscallBuffer =
+            mapRingBuffer(thread.syscallFd, SYSCALL_BUFFER_PAGES);
+    if (thread.syscallBuffer == nullptr) {
+        throw Exception("can't map perf syscalls ring buffer");
+    }
+    watchRingBuffer(
+            thread,
+            thread.syscallFd,
+            thread.groupFds.size() + thread.profileFds.size());
 }
 
-void PerfListener::onPostForkChild() {
-    TRACE();
+void PerfListener::openBudgetCounters(ThreadCounters& thread) {
+    TRACE(thread.tid);
+
+    struct perf_event_attr attrs {};
+    memset(&attrs, 0, sizeof(attrs));
+    attrs.size = sizeof(attrs);
+    attrs.type = PERF_TYPE_TRACEPOINT;
+    attrs.config = getTracepointConfig(SYSCALL_TRACEPOINT);
+    attrs.exclude_hv = 1;
+    attrs.disabled = 1;
+    attrs.wakeup_events = 1;
+
+    // Calls made so far by other threads are already used up, so this
+    // thread alone can't exceed what is left unnoticed.
+    auto callsCount = readBudgetCounters();
+    size_t index = 0;
+    for (const auto& budget: syscallBudgetsByNumber_) {
+        attrs.sample_period = budget.second.second + 1 -
+                std::min(callsCount[index], budget.second.second);
+        int perfFd = withErrnoCheck(
+                "perf event open budget of " + budget.second.first,
+                perf_event_open,
+                &attrs,
+                thread.tid,
+                -1,
+                -1,
+                0 /* PERF_FLAG_FD_CLOEXEC */);
+        withErrnoCheck(
+                "set cloexec flag on perfFd",
+                fcntl,
+                perfFd,
+                F_SETFD,
+                FD_CLOEXEC);
+        thread.budgetFds.emplace_back(perfFd);
+
+        std::string filter = "id == " + std::to_string(budget.first);
+        withErrnoCheck(
+                "set perf budget filter",
+                ioctl,
+                perfFd,
+                PERF_EVENT_IOC_SET_FILTER,
+                filter.c_str());
+
+        void* ringBuffer = mapRingBuffer(perfFd, 1);
+        if (ringBuffer == nullptr) {
+            throw Exception("can't map perf budget ring buffer");
+        }
+        thread.budgetBuffers.emplace_back(ringBuffer);
+        watchRingBuffer(
+                thread,
+                perfFd,
+                thread.groupFds.size() + thread.profileFds.size() + 1 +
+                        index);
+        withErrnoCheck(
+                "enable perf budget counter",
+                ioctl,
+                perfFd,
+                PERF_EVENT_IOC_ENABLE,
+                0);
+        ++index;
+    }
+}
 
-    pthread_barrier_wait(barrier_);
+void PerfListener::watchRingBuffer(
+        const ThreadCounters& thread,
+        int perfFd,
+        size_t index) {
+    // Threads are never removed from threads_, so their index identifies
+    // them for the whole run.
+    uint64_t threadIndex = &thread - threads_.data();
+    struct epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.u64 = threadIndex << 32 | index;
     withErrnoCheck(
-            "munmap shared memory",
-            munmap,
-            barrier_,
-            sizeof(pthread_barrier_t));
+            "perf epoll_ctl add",
+            epoll_ctl,
+            epollFd_,
+            EPOLL_CTL_ADD,
+            perfFd,
+            &event);
 }
 
-uint64_t PerfListener::getInstructionsUsed() {
-    TRACE();
+void PerfListener::openGroupMembers(
+        ThreadCounters& thread,
+        int groupFd,
+        uint32_t pmuType,
+        bool hybrid) {
+    TRACE(groupFd, pmuType);
+
+    struct perf_event_attr attrs {};
+    memset(&attrs, 0, sizeof(attrs));
+    attrs.size = sizeof(attrs);
+    attrs.exclude_hv = 1;
+    attrs.inherit = inherit_ ? 1 : 0;
+    attrs.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // Members are scheduled together with instructions counter of their
+    // group, so also software events are counted once across all groups.
+    for (const auto& name: events_) {
+        const Event& event = EVENTS.at(name);
+        attrs.type = event.type;
+        attrs.config = event.tracepoint.empty()
+                ? event.config
+                : getTracepointConfig(event.tracepoint);
+        if (hybrid && event.type == PERF_TYPE_HARDWARE) {
+            attrs.config |= static_cast<uint64_t>(pmuType) << PMU_TYPE_SHIFT;
+        }
+        attrs.exclude_kernel = event.countsKernel ? 0 : 1;
+
+        logger::debug("Opening perf event ", name, " in group ", groupFd);
+        int perfFd = withErrnoCheck(
+                "perf event open " + name,
+                perf_event_open,
+                &attrs,
+                thread.tid,
+                -1,
+                groupFd,
+                0 /* PERF_FLAG_FD_CLOEXEC */);
+        withErrnoCheck(
+                "set cloexec flag on perfFd",
+                fcntl,
+                perfFd,
+                F_SETFD,
+                FD_CLOEXEC);
+        thread.memberFds.emplace_back(perfFd);
+    }
+}
+
+void PerfListener::closeCounters(ThreadCounters& thread) {
+    for (void* ringBuffer: thread.ringBuffers) {
+        munmap(ringBuffer, 2 * pageSize_);
+    }
+    thread.ringBuffers.clear();
+    for (void* ringBuffer: thread.profileBuffers) {
+        munmap(ringBuffer, (1 + PROFILE_BUFFER_PAGES) * pageSize_);
+    }
+    thread.profileBuffers.clear();
+    for (int fd: thread.profileFds) {
+        close(fd);
+    }
+    thread.profileFds.clear();
+    if (thread.syscallBuffer != nullptr) {
+        munmap(thread.syscallBuffer, (1 + SYSCALL_BUFFER_PAGES) * pageSize_);
+        thread.syscallBuffer = nullptr;
+    }
+    if (thread.syscallFd >= 0) {
+        close(thread.syscallFd);
+        thread.syscallFd = -1;
+    }
+    for (void* ringBuffer: thread.budgetBuffers) {
+        munmap(ringBuffer, 2 * pageSize_);
+    }
+    thread.budgetBuffers.clear();
+    for (int fd: thread.budgetFds) {
+        close(fd);
+    }
+    thread.budgetFds.clear();
+    for (int fd: thread.memberFds) {
+        close(fd);
+    }
+    thread.memberFds.clear();
+    for (int fd: thread.groupFds) {
+        close(fd);
+    }
+    thread.groupFds.clear();
+}
 
-    uint64_t instructionsUsedSum = 0;
-    for (int fd: perfFds_) {
-        long long int instructionsUsed;
-        int size = withErrnoCheck(
-                "read perf value",
-                read,
-                fd,
-                &instructionsUsed,
-                sizeof(long long));
-        if (size != sizeof(instructionsUsed)) {
+std::vector<uint64_t> PerfListener::readCounters(const ThreadCounters& thread) {
+    if (!thread.counts.empty()) {
+        return thread.counts;
+    }
+
+    // Instructions count followed by counts of events_.
+    std::vector<uint64_t> counters(1 + events_.size());
+    std::vector<uint64_t> buffer(
+            sizeof(GroupReadFormat) / sizeof(uint64_t) + counters.size());
+    uint64_t timeEnabled = 0;
+    uint64_t timeRunning = 0;
+    for (int fd: thread.groupFds) {
+        size_t expectedSize = buffer.size() * sizeof(uint64_t);
+        size_t size = withErrnoCheck(
+                "read perf group", read, fd, buffer.data(), expectedSize);
+        const auto* group = reinterpret_cast<GroupReadFormat*>(buffer.data());
+        if (size != expectedSize || group->nr != counters.size()) {
             throw Exception("read failed");
         }
-        if (instructionsUsed < 0) {
-            throw Exception("read negative instructions count");
+        const uint64_t* values = buffer.data() +
+                sizeof(GroupReadFormat) / sizeof(uint64_t);
+        for (size_t index = 0; index < counters.size(); ++index) {
+            counters[index] += values[index];
+        }
+        // All events are enabled together, while each one runs only when its
+        // PMU is scheduled.
+        timeEnabled = std::max(timeEnabled, group->timeEnabled);
+        timeRunning += group->timeRunning;
+    }
+
+    if (timeRunning > 0 && timeRunning < timeEnabled) {
+        // Counters were multiplexed with other events, extrapolate.
+        logger::debug(
+                "Scaling multiplexed perf counters of thread ",
+                thread.tid,
+                " ",
+                VAR(timeEnabled),
+                VAR(timeRunning));
+        for (auto& counter: counters) {
+            counter = static_cast<uint64_t>(
+                    static_cast<long double>(counter) * timeEnabled /
+                    timeRunning);
+        }
+    }
+    return counters;
+}
+
+std::vector<uint64_t> PerfListener::readCounters() {
+    TRACE();
+
+    std::vector<uint64_t> counters(1 + events_.size());
+    for (const auto& thread: threads_) {
+        auto threadCounters = readCounters(thread);
+        for (size_t index = 0; index < counters.size(); ++index) {
+            counters[index] += threadCounters[index];
         }
-        instructionsUsedSum += static_cast<uint64_t>(instructionsUsed);
     }
-    return instructionsUsedSum;
+    return counters;
 }
 
 void PerfListener::onPostExecute() {
     TRACE();
 
-    outputBuilder_->setCyclesUsed(getInstructionsUsed());
+    auto counters = readCounters();
+    outputBuilder_->setCyclesUsed(counters[0]);
+    for (size_t index = 0; index < reportedEventsCount_; ++index) {
+        outputBuilder_->setPerfEventCount(events_[index], counters[index + 1]);
+    }
+    if (syscallStats_ != SyscallStats::OFF) {
+        auto syscallsEvent =
+                std::find(events_.begin(), events_.end(), SYSCALLS_EVENT);
+        outputBuilder_->setSyscallsCount(
+                counters[1 + (syscallsEvent - events_.begin())]);
+    }
+    if (!inherit_) {
+        std::vector<uint64_t> threadsInstructionsUsed;
+        for (const auto& thread: threads_) {
+            threadsInstructionsUsed.push_back(readCounters(thread)[0]);
+        }
+        outputBuilder_->setThreadsInstructionsUsed(threadsInstructionsUsed);
+    }
+    for (auto& thread: threads_) {
+        readSamples(thread);
+    }
+    // Program that exceeded a budget by less than the buffer can hold
+    // exits before the buffer is polled.
+    checkSyscallBudgets();
+    if (profilePeriod_ != 0) {
+        setProfile();
+    }
+    if (!syscallProfilePath_.empty()) {
+        storeSyscallProfile();
+    }
+    if (recordSyscalls_ && syscallStats_ == SyscallStats::HISTOGRAM) {
+        setSyscallsHistogram();
+    }
 }
 
 executor::ExecuteAction PerfListener::onSigioSignal() {
     TRACE();
 
-    uint64_t instructionsUsed = getInstructionsUsed();
+    return checkInstructionsUsed(true);
+}
+
+std::vector<int> PerfListener::getPollFds() {
+    if (epollFd_ >= 0) {
+        return {epollFd_};
+    }
+    return {};
+}
+
+executor::ExecuteAction PerfListener::onPollEvent(int /* fd */) {
+    TRACE();
+
+    // Perf fds clear their readiness when polled, which happens already
+    // when executor's epoll checks ours, so it only tells that some buffer
+    // was written. All of them are cheap to scan without syscalls.
+    for (auto& thread: threads_) {
+        for (void* ringBuffer: thread.ringBuffers) {
+            thread.overflowsCount += readOverflows(ringBuffer);
+        }
+        // Budget counters are read when checked, overflows only wake us up
+        for (void* ringBuffer: thread.budgetBuffers) {
+            readOverflows(ringBuffer);
+        }
+        readSamples(thread);
+    }
+
+    std::vector<struct epoll_event> events(16);
+    int eventsCount = withErrnoCheck(
+            "perf epoll_wait",
+            {EINTR},
+            epoll_wait,
+            epollFd_,
+            events.data(),
+            events.size(),
+            0);
+    for (int eventIndex = 0; eventIndex < eventsCount; ++eventIndex) {
+        if ((events[eventIndex].events & (EPOLLHUP | EPOLLERR)) == 0) {
+            continue;
+        }
+        // Thread has finished, fd is closed when its exit is handled.
+        const ThreadCounters& thread =
+                threads_[events[eventIndex].data.u64 >> 32];
+        size_t index = events[eventIndex].data.u64 & 0xffffffff;
+        size_t syscallIndex = thread.groupFds.size() + thread.profileFds.size();
+        int perfFd = thread.syscallFd;
+        if (index < thread.groupFds.size()) {
+            perfFd = thread.groupFds[index];
+        }
+        else if (index < syscallIndex) {
+            perfFd = thread.profileFds[index - thread.groupFds.size()];
+        }
+        else if (index > syscallIndex) {
+            perfFd = thread.budgetFds[index - syscallIndex - 1];
+        }
+        withErrnoCheck(
+                "perf epoll_ctl del",
+                epoll_ctl,
+                epollFd_,
+                EPOLL_CTL_DEL,
+                perfFd,
+                nullptr);
+    }
+
+    if (checkSyscallBudgets() == executor::ExecuteAction::KILL) {
+        return executor::ExecuteAction::KILL;
+    }
+    if (samplePeriod_ == 0) {
+        // Only profile and syscall buffers are watched, there are no
+        // instruction limits to check.
+        return executor::ExecuteAction::CONTINUE;
+    }
+    return checkInstructionsUsed(false);
+}
+
+executor::ExecuteAction PerfListener::checkInstructionsUsed(bool exact) {
+    // Re-armed counters are read on every wakeup, their overflows don't
+    // tell how much was counted.
+    exact = exact || rearmPeriod_;
+
+    uint64_t instructionsUsed = 0;
+    // Upper bound of instructions counted since last overflows
+    uint64_t uncounted = 0;
+    for (const auto& thread: threads_) {
+        uint64_t threadInstructionsUsed = 0;
+        uint64_t threadUncounted = 0;
+        if (!thread.counts.empty()) {
+            threadInstructionsUsed = thread.counts[0];
+        }
+        else if (exact || thread.ringBuffers.empty()) {
+            threadInstructionsUsed = readCounters(thread)[0];
+        }
+        else {
+            // Every overflow means that one of the counters has counted a
+            // whole period, so this is a lower bound that doesn't need
+            // reading counters.
+            threadInstructionsUsed = thread.overflowsCount * samplePeriod_;
+            threadUncounted = thread.groupFds.size() * (samplePeriod_ - 1);
+            if (threadInstructionCountLimit_ != 0 &&
+                threadInstructionsUsed + threadUncounted >=
+                        threadInstructionCountLimit_) {
+                threadInstructionsUsed = readCounters(thread)[0];
+                threadUncounted = 0;
+            }
+        }
+
+        if (threadInstructionCountLimit_ != 0 &&
+            threadInstructionsUsed >= threadInstructionCountLimit_) {
+            return killOnLimit("thread", threadInstructionsUsed);
+        }
+        instructionsUsed += threadInstructionsUsed;
+        uncounted += threadUncounted;
+    }
+
+    if (instructionCountLimit_ != 0 && uncounted != 0 &&
+        instructionsUsed + uncounted >= instructionCountLimit_) {
+        instructionsUsed = readCounters()[0];
+    }
     if (instructionCountLimit_ != 0 &&
         instructionsUsed >= instructionCountLimit_) {
+        return killOnLimit("total", instructionsUsed);
+    }
+
+    if (rearmPeriod_) {
+        rearmCounters();
+    }
+    return executor::ExecuteAction::CONTINUE;
+}
+
+void PerfListener::rearmCounters() {
+    TRACE();
+
+    if (samplePeriod_ == 0) {
+        return;
+    }
+
+    std::vector<uint64_t> threadsInstructionsUsed;
+    uint64_t instructionsUsed = 0;
+    size_t countersCount = 0;
+    for (const auto& thread: threads_) {
+        threadsInstructionsUsed.push_back(readCounters(thread)[0]);
+        instructionsUsed += threadsInstructionsUsed.back();
+        countersCount += thread.groupFds.size();
+    }
+
+    // Each counter gets an equal share of what is left, so that no limit can
+    // be exceeded before one of counters overflows. Shares shrink with each
+    // wakeup, until a counter overflows right at the limit.
+    uint64_t totalShare = 0;
+    if (instructionCountLimit_ != 0 && countersCount > 0) {
+        uint64_t remaining = instructionCountLimit_ -
+                std::min(instructionsUsed, instructionCountLimit_);
+        totalShare = remaining / countersCount;
+    }
+    for (size_t index = 0; index < threads_.size(); ++index) {
+        const ThreadCounters& thread = threads_[index];
+        if (thread.groupFds.empty()) {
+            continue;
+        }
+
+        uint64_t period = totalShare;
+        if (threadInstructionCountLimit_ != 0) {
+            uint64_t remaining = threadInstructionCountLimit_ -
+                    std::min(
+                            threadsInstructionsUsed[index],
+                            threadInstructionCountLimit_);
+            uint64_t threadShare = remaining / thread.groupFds.size();
+            if (instructionCountLimit_ == 0 || threadShare < period) {
+                period = threadShare;
+            }
+        }
+        period = std::max<uint64_t>(1ULL, period);
+
+        for (int perfFd: thread.groupFds) {
+            withErrnoCheck(
+                    "perf set period",
+                    ioctl,
+                    perfFd,
+                    PERF_EVENT_IOC_PERIOD,
+                    &period);
+        }
+    }
+}
+
+executor::ExecuteAction PerfListener::killOnLimit(
+        const std::string& limit,
+        uint64_t instructionsUsed) {
+    logger::debug(
+            "Killing tracee after instructions count ",
+            instructionsUsed,
+            " exceeded ",
+            limit,
+            " limit");
+    outputBuilder_->setKillReason(
+            printer::OutputBuilder::KillReason::TLE, "time limit exceeded");
+    return executor::ExecuteAction::KILL;
+}
+
+void* PerfListener::mapRingBuffer(int perfFd, size_t dataPages) {
+    TRACE(perfFd, dataPages);
+
+    // Metadata page is followed by data pages, their number must be a power
+    // of two. Writable mapping makes kernel respect data_tail and report
+    // lost records instead of overwriting them.
+    void* ringBuffer = mmap(
+            nullptr,
+            (1 + dataPages) * pageSize_,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            perfFd,
+            0);
+    if (ringBuffer == MAP_FAILED) {
+        logger::warn(
+                "Can't map perf ring buffer, using SIGIO instead: ",
+                strerror(errno));
+        return nullptr;
+    }
+    return ringBuffer;
+}
+
+uint64_t PerfListener::readOverflows(void* ringBuffer) {
+    uint64_t overflows = 0;
+    consumeRecords(
+            ringBuffer,
+            pageSize_,
+            pageSize_,
+            [&](uint32_t type, const auto& field) {
+                if (type == PERF_RECORD_SAMPLE) {
+                    ++overflows;
+                }
+                else if (type == PERF_RECORD_LOST) {
+                    // Lost record is {header, id, lost}
+                    overflows += field(1);
+                }
+            });
+    return overflows;
+}
+
+void PerfListener::readSamples(ThreadCounters& thread) {
+    for (void* ringBuffer: thread.profileBuffers) {
+        consumeRecords(
+                ringBuffer,
+                pageSize_,
+                PROFILE_BUFFER_PAGES * pageSize_,
+                [&](uint32_t type, const auto& field) {
+                    if (type == PERF_RECORD_SAMPLE) {
+                        // Sample record is {header, ip}
+                        ++profileSamples_[field(0)];
+                    }
+                    else if (type == PERF_RECORD_LOST) {
+                        profileLostSamples_ += field(1);
+                    }
+                });
+    }
+    if (thread.syscallBuffer == nullptr) {
+        return;
+    }
+    consumeRecords(
+            thread.syscallBuffer,
+            pageSize_,
+            SYSCALL_BUFFER_PAGES * pageSize_,
+            [&](uint32_t type, const auto& field) {
+                if (type == PERF_RECORD_SAMPLE) {
+                    // Sample record is {header, u32 size, raw data}, where
+                    // raw data starts with 8 bytes of common tracepoint
+                    // fields followed by syscall number, so its lower half
+                    // is the upper half of the second field.
+                    int32_t syscall = field(1) >> 32;
+                    if (syscall >= 0) {
+                        ++syscallSamples_[syscall];
+                    }
+                }
+                else if (type == PERF_RECORD_LOST) {
+                    syscallLostSamples_ += field(1);
+                }
+            });
+}
+
+void PerfListener::setProfile() {
+    TRACE();
+
+    // Samples are attributed to functions of the executed program, or to
+    // raw addresses when it has no symbols there.
+    std::map<std::string, uint64_t> histogram;
+    uint64_t samplesCount = 0;
+    for (const auto& sample: profileSamples_) {
+        std::string location = "[other]";
+        for (const auto& mapping: executableMappings_) {
+            if (sample.first < mapping.first ||
+                sample.first >= mapping.second) {
+                continue;
+            }
+            uint64_t address = sample.first - loadBias_;
+            location = symbols_->findFunction(address);
+            if (location.empty()) {
+                std::stringstream ss;
+                ss << "0x" << std::hex << address;
+                location = ss.str();
+            }
+            break;
+        }
+        histogram[location] += sample.second;
+        samplesCount += sample.second;
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> profile(
+            histogram.begin(), histogram.end());
+    std::stable_sort(
+            profile.begin(),
+            profile.end(),
+            [](const std::pair<std::string, uint64_t>& lhs,
+               const std::pair<std::string, uint64_t>& rhs) {
+                return lhs.second > rhs.second;
+            });
+    if (profile.size() > profileEntries_) {
+        profile.resize(profileEntries_);
+    }
+    if (profileLostSamples_ != 0) {
+        logger::warn("Perf profile lost ", profileLostSamples_, " samples");
+    }
+    outputBuilder_->setProfile(profile, samplesCount);
+}
+
+std::map<std::string, uint64_t> PerfListener::getSyscallCounts() {
+    TRACE();
+
+    std::map<std::string, uint64_t> counts;
+    auto arch = seccomp::SeccompContext::SECCOMP_FILTER_ARCHITECTURES.find(
+            syscallArch_);
+    if (arch ==
+        seccomp::SeccompContext::SECCOMP_FILTER_ARCHITECTURES.end()) {
+        logger::warn("Can't name syscalls of unknown architecture");
+        return counts;
+    }
+    for (const auto& sample: syscallSamples_) {
+        char* name =
+                seccomp_syscall_resolve_num_arch(arch->second, sample.first);
+        if (name == nullptr) {
+            logger::debug("Unknown syscall number ", sample.first);
+            continue;
+        }
+        counts[name] += sample.second;
+        free(name);
+    }
+    return counts;
+}
+
+void PerfListener::storeSyscallProfile() {
+    TRACE();
+
+    if (syscallLostSamples_ != 0) {
+        logger::warn(
+                "Syscall profile lost ", syscallLostSamples_, " syscalls");
+    }
+    auto counts = getSyscallCounts();
+    if (counts.empty()) {
+        return;
+    }
+
+    try {
+        // Profile accumulates counts of all runs recorded into it
+        seccomp::SyscallProfile profile;
+        if (std::ifstream(syscallProfilePath_).is_open()) {
+            profile = seccomp::SyscallProfile::load(syscallProfilePath_);
+        }
+        for (const auto& count: counts) {
+            profile.counts[count.first] += count.second;
+        }
+        profile.store(syscallProfilePath_);
+    }
+    catch (const Exception& ex) {
+        logger::warn("Can't store syscall profile: ", ex.what());
+    }
+}
+
+void PerfListener::setupSyscallBudgets() {
+    TRACE();
+
+    // Budgets are resolved on the first exec, counters of later ones
+    // keep counting.
+    if (syscallBudgets_.empty() || !syscallBudgetsByNumber_.empty()) {
+        return;
+    }
+    auto arch = seccomp::SeccompContext::SECCOMP_FILTER_ARCHITECTURES.find(
+            syscallArch_);
+    if (arch ==
+        seccomp::SeccompContext::SECCOMP_FILTER_ARCHITECTURES.end()) {
+        logger::warn("Can't enforce syscall budgets of unknown architecture");
+        return;
+    }
+
+    for (const auto& budget: syscallBudgets_) {
+        int syscall = seccomp_syscall_resolve_name_arch(
+                arch->second, budget.first.c_str());
+        if (syscall < 0) {
+            continue;
+        }
+        syscallBudgetsByNumber_[syscall] = budget;
+    }
+    for (auto& thread: threads_) {
+        if (thread.counts.empty()) {
+            openBudgetCounters(thread);
+        }
+    }
+}
+
+std::vector<uint64_t> PerfListener::readBudgetCounters(
+        const ThreadCounters& thread) {
+    if (!thread.counts.empty()) {
+        return thread.budgetCounts;
+    }
+
+    std::vector<uint64_t> counts;
+    for (int fd: thread.budgetFds) {
+        uint64_t count = 0;
+        size_t size = withErrnoCheck(
+                "read perf budget counter", read, fd, &count, sizeof(count));
+        if (size != sizeof(count)) {
+            throw Exception("read failed");
+        }
+        counts.push_back(count);
+    }
+    return counts;
+}
+
+std::vector<uint64_t> PerfListener::readBudgetCounters() {
+    std::vector<uint64_t> counts(syscallBudgetsByNumber_.size());
+    for (const auto& thread: threads_) {
+        auto threadCounts = readBudgetCounters(thread);
+        // Thread created before budgets were resolved has no counters
+        for (size_t index = 0; index < threadCounts.size(); ++index) {
+            counts[index] += threadCounts[index];
+        }
+    }
+    return counts;
+}
+
+executor::ExecuteAction PerfListener::checkSyscallBudgets() {
+    if (syscallBudgetsByNumber_.empty()) {
+        return executor::ExecuteAction::CONTINUE;
+    }
+
+    auto callsCount = readBudgetCounters();
+    size_t index = 0;
+    for (const auto& budget: syscallBudgetsByNumber_) {
+        uint64_t calls = callsCount[index++];
+        if (calls <= budget.second.second) {
+            continue;
+        }
         logger::debug(
-                "Killing tracee after instructions count ",
-                instructionsUsed,
-                " exceeded limit");
+                "Killing tracee after ",
+                calls,
+                " calls of ",
+                budget.second.first,
+                " exceeded its budget");
         outputBuilder_->setKillReason(
-                printer::OutputBuilder::KillReason::TLE, "time limit exceeded");
+                printer::OutputBuilder::KillReason::RV,
+                "syscall budget of " + budget.second.first + " exceeded");
         return executor::ExecuteAction::KILL;
     }
     return executor::ExecuteAction::CONTINUE;
 }
 
+bool PerfListener::canRecordSyscalls() {
+    struct perf_event_attr attrs {};
+    memset(&attrs, 0, sizeof(attrs));
+    attrs.size = sizeof(attrs);
+    attrs.type = PERF_TYPE_TRACEPOINT;
+    attrs.exclude_hv = 1;
+    attrs.disabled = 1;
+    try {
+        attrs.config = getTracepointConfig(SYSCALL_TRACEPOINT);
+    }
+    catch (const Exception& ex) {
+        logger::debug("Can't record syscalls: ", ex.what());
+        return false;
+    }
+
+    int perfFd = perf_event_open(&attrs, 0, -1, -1, 0);
+    if (perfFd < 0) {
+        logger::debug("Can't record syscalls: ", strerror(errno));
+        return false;
+    }
+    close(perfFd);
+    return true;
+}
+
+void PerfListener::setSyscallsHistogram() {
+    TRACE();
+
+    if (syscallLostSamples_ != 0 && syscallProfilePath_.empty()) {
+        logger::warn(
+                "Syscalls histogram lost ", syscallLostSamples_, " syscalls");
+    }
+    auto counts = getSyscallCounts();
+    std::vector<std::pair<std::string, uint64_t>> histogram(
+            counts.begin(), counts.end());
+    std::stable_sort(
+            histogram.begin(),
+            histogram.end(),
+            [](const std::pair<std::string, uint64_t>& lhs,
+               const std::pair<std::string, uint64_t>& rhs) {
+                return lhs.second > rhs.second;
+            });
+    outputBuilder_->setSyscallsHistogram(histogram);
+}
+
 } // namespace perf
 } // namespace s2j
@@ -1,10 +1,18 @@
 #pragma once
 
+#include "ElfSymbols.h"
+
 #include "common/Feature.h"
 #include "executor/ExecuteEventListener.h"
 #include "printer/OutputSource.h"
+#include "tracer/TraceEventListener.h"
+#include "tracer/Tracee.h"
 
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace s2j {
@@ -12,29 +20,316 @@ namespace perf {
 
 class PerfListener
         : public executor::ExecuteEventListener
+        , public tracer::TraceEventListener
         , public printer::OutputSource {
 public:
-    PerfListener(uint64_t instructionCountLimit, uint64_t samplingFactor);
+    struct Event {
+        uint32_t type;
+        uint64_t config;
+        bool countsKernel;
+        // Name of tracepoint, whose config is read from tracefs
+        std::string tracepoint;
+    };
+
+    enum class SyscallStats { OFF, COUNT, HISTOGRAM };
+
+    /**
+     * With inherit set counters are opened once and follow all threads and
+     * children of the child process. Otherwise each thread reported by
+     * onPostClone gets its own counters, which gives per-thread counts and
+     * allows enforcing threadInstructionCountLimit. Overflows of not
+     * inherited counters are read from a ring buffer instead of SIGIO, as
+     * kernel can't map inherited counters.
+     *
+     * Counts of events, named as in EVENTS, are reported together with
+     * instructions count.
+     *
+     * With profilePeriod set, instruction pointer of each thread is sampled
+     * every profilePeriod instructions and profileEntries most frequent
+     * functions of the program are reported. Samples are read from ring
+     * buffers, so it needs counters not inherited.
+     *
+     * With rearmPeriod set, counters are re-armed after every wakeup to
+     * overflow once remaining budget is used, instead of every fraction of
+     * limit given by samplingFactor. Limits are then enforced at the
+     * instruction they are exceeded, plus counters' skid. Counters copied
+     * by kernel to children keep their period, so inherited counters are
+     * never re-armed.
+     *
+     * With syscallProfilePath set, every syscall entered by threads of the
+     * program is recorded with raw_syscalls tracepoint, and their counts
+     * are added to syscall profile in that file. Syscalls denied by seccomp
+     * are not counted. Like profile, it needs counters not inherited.
+     *
+     * With syscallStats other than OFF, syscalls of the program are counted
+     * with "syscalls" event, which is cheap as it's only a counter in the
+     * group of instructions counter, and the total is reported as syscalls
+     * count. With HISTOGRAM, syscalls are also recorded as for syscall
+     * profile and their counts are reported by name, so it needs counters
+     * not inherited.
+     *
+     * With syscallBudgets, given by syscall name, each budgeted syscall is
+     * counted by a raw_syscalls event of its own in every thread, and the
+     * program is killed once any of them is called more times than its
+     * budget. Counters overflow at the first call over the budget left when
+     * they are opened, so a single thread is stopped right at the limit,
+     * and calls of all threads together are checked on every wakeup and
+     * when threads exit. Budgets need the program to be reported by tracer,
+     * as they are resolved for its architecture.
+     */
+    PerfListener(
+            uint64_t instructionCountLimit,
+            uint64_t samplingFactor,
+            std::string cacheDirectory = "",
+            bool inherit = true,
+            std::vector<std::string> events = {},
+            uint64_t threadInstructionCountLimit = 0,
+            uint64_t profilePeriod = 0,
+            size_t profileEntries = 0,
+            bool rearmPeriod = false,
+            std::string syscallProfilePath = "",
+            SyscallStats syscallStats = SyscallStats::OFF,
+            std::map<std::string, uint64_t> syscallBudgets = {});
     ~PerfListener();
 
     void onPreFork() override;
     void onPostForkParent(pid_t childPid) override;
-    void onPostForkChild() override;
+    executor::ExecuteAction onExecuteEvent(
+            const executor::ExecuteEvent& executeEvent) override;
     void onPostExecute() override;
+    bool requiresParentSetup() override;
     executor::ExecuteAction onSigioSignal() override;
+    std::vector<int> getPollFds() override;
+    executor::ExecuteAction onPollEvent(int fd) override;
+
+    tracer::TraceAction onPostExec(
+            const tracer::TraceEvent& traceEvent,
+            tracer::Tracee& tracee) override;
+    std::tuple<tracer::TraceAction, tracer::TraceAction> onPostClone(
+            const tracer::TraceEvent& traceEvent,
+            tracer::Tracee& tracee,
+            tracer::Tracee& traceeChild) override;
 
     const static Feature feature;
 
+    /**
+     * Whether syscalls can be recorded with raw_syscalls tracepoint, i.e.
+     * tracefs is mounted and perf_event_paranoid lets us open it.
+     */
+    static bool canRecordSyscalls();
+
+    /**
+     * Additional events that can be counted, by perf tool's names.
+     */
+    static const std::map<std::string, Event> EVENTS;
+
+    static const uint64_t DEFAULT_PROFILE_PERIOD;
+
 private:
-    uint64_t getInstructionsUsed();
+    /**
+     * Counters of a single thread, or of the whole process when inherited.
+     */
+    struct ThreadCounters {
+        pid_t tid;
+        // Instructions counter of each PMU, leading group of events_
+        std::vector<int> groupFds;
+        std::vector<int> memberFds;
+        // Ring buffers of groupFds, empty when overflows are reported with
+        // SIGIO instead
+        std::vector<void*> ringBuffers;
+        uint64_t overflowsCount{};
+        // Instruction pointer sampling events of each PMU, with their ring
+        // buffers
+        std::vector<int> profileFds;
+        std::vector<void*> profileBuffers;
+        // Syscalls tracepoint event, with its ring buffer
+        int syscallFd{-1};
+        void* syscallBuffer{};
+        // Counting syscalls tracepoint events of syscallBudgetsByNumber_, in
+        // its order, with their ring buffers
+        std::vector<int> budgetFds;
+        std::vector<void*> budgetBuffers;
+        // Final counts, read when thread exits
+        std::vector<uint64_t> counts;
+        std::vector<uint64_t> budgetCounts;
+    };
+
+    /**
+     * Opens counters of given thread, enabled on its exec or right away.
+     */
+    void openCounters(pid_t tid, bool enableOnExec);
+
+    /**
+     * Opens events_ in group of instructions counter of given PMU.
+     */
+    void openGroupMembers(
+            ThreadCounters& thread,
+            int groupFd,
+            uint32_t pmuType,
+            bool hybrid);
+
+    /**
+     * Opens instruction pointer sampling events of given thread.
+     */
+    void openProfileCounters(ThreadCounters& thread, bool enableOnExec);
+
+    /**
+     * Opens syscalls tracepoint event of given thread.
+     */
+    void openSyscallCounter(ThreadCounters& thread, bool enableOnExec);
+
+    /**
+     * Opens counters of budgeted syscalls of given thread, enabled right
+     * away.
+     */
+    void openBudgetCounters(ThreadCounters& thread);
+
+    /**
+     * Adds ring buffer of perf fd to epollFd_, index identifies fd among
+     * groupFds followed by profileFds, syscallFd and budgetFds of thread.
+     */
+    void watchRingBuffer(
+            const ThreadCounters& thread,
+            int perfFd,
+            size_t index);
+
+    void closeCounters(ThreadCounters& thread);
+
+    /**
+     * Reads thread's instructions count followed by counts of events_,
+     * summed over all PMUs.
+     */
+    std::vector<uint64_t> readCounters(const ThreadCounters& thread);
+
+    /**
+     * Same as above, summed over all threads.
+     */
+    std::vector<uint64_t> readCounters();
+
+    /**
+     * Checks instruction count limits. Unless exact is set, counters are
+     * read only when overflows counted so far don't rule out exceeding
+     * them.
+     */
+    executor::ExecuteAction checkInstructionsUsed(bool exact);
+    executor::ExecuteAction killOnLimit(
+            const std::string& limit,
+            uint64_t instructionsUsed);
+
+    /**
+     * Sets period of every counter to its share of remaining budget.
+     */
+    void rearmCounters();
+
+    /**
+     * Maps ring buffer of perf fd with given number of data pages, so that
+     * records can be polled for and read without syscalls. Returns nullptr
+     * when it can't be mapped.
+     */
+    void* mapRingBuffer(int perfFd, size_t dataPages);
+
+    /**
+     * Consumes all records from ring buffer and returns number of counter
+     * overflows they report.
+     */
+    uint64_t readOverflows(void* ringBuffer);
+
+    /**
+     * Consumes all records from thread's profile ring buffers into
+     * profileSamples_, and from its syscall ring buffer into
+     * syscallSamples_.
+     */
+    void readSamples(ThreadCounters& thread);
+
+    /**
+     * Reports histogram of profileSamples_ by function.
+     */
+    void setProfile();
+
+    /**
+     * Translates syscallSamples_ to counts by syscall name, empty when
+     * architecture of the program is unknown.
+     */
+    std::map<std::string, uint64_t> getSyscallCounts();
+
+    /**
+     * Adds syscallSamples_ to syscall profile file.
+     */
+    void storeSyscallProfile();
+
+    /**
+     * Reports syscallSamples_ by name, most frequent syscalls first.
+     */
+    void setSyscallsHistogram();
+
+    /**
+     * Resolves syscallBudgets_ for architecture of the program, and opens
+     * their counters in threads that already exist.
+     */
+    void setupSyscallBudgets();
+
+    /**
+     * Reads thread's counts of budgeted syscalls, in order of
+     * syscallBudgetsByNumber_.
+     */
+    std::vector<uint64_t> readBudgetCounters(const ThreadCounters& thread);
+
+    /**
+     * Calls of budgeted syscalls, summed over all threads.
+     */
+    std::vector<uint64_t> readBudgetCounters();
+
+    executor::ExecuteAction checkSyscallBudgets();
+
+    // Enough for samples of a few milliseconds between wakeups
+    static const size_t PROFILE_BUFFER_PAGES = 8;
+    // Syscalls can come much more often than instruction samples
+    static const size_t SYSCALL_BUFFER_PAGES = 64;
 
     const uint64_t instructionCountLimit_;
+    const uint64_t threadInstructionCountLimit_;
     const uint64_t samplingFactor_;
-    std::vector<int> perfFds_;
+    const std::string cacheDirectory_;
+    const bool inherit_;
+    // Requested events, followed by ones needed internally which aren't
+    // reported as perf events
+    const std::vector<std::string> events_;
+    const size_t reportedEventsCount_;
+    uint64_t samplePeriod_{};
+    const uint64_t profilePeriod_;
+    const size_t profileEntries_;
+    const bool rearmPeriod_;
+    const std::string syscallProfilePath_;
+    const SyscallStats syscallStats_;
+    const std::map<std::string, uint64_t> syscallBudgets_;
+    // Whether syscalls are recorded, for syscall profile or histogram
+    const bool recordSyscalls_;
+
+    // In order of threads creation
+    std::vector<ThreadCounters> threads_;
+    // Ring buffers are watched with epoll of their own, so that counters of
+    // new threads can be added while executor is polling
+    int epollFd_{-1};
+    size_t pageSize_{};
     pid_t childPid_{};
 
-    // Barrier used for synchronization
-    pthread_barrier_t* barrier_{};
+    // Number of samples by instruction pointer
+    std::map<uint64_t, uint64_t> profileSamples_;
+    uint64_t profileLostSamples_{};
+    // Symbols of executed program, with address ranges of its code and its
+    // load bias when position independent
+    std::unique_ptr<ElfSymbols> symbols_;
+    std::vector<std::pair<uint64_t, uint64_t>> executableMappings_;
+    uint64_t loadBias_{};
+
+    // Number of calls by syscall number of executed program's architecture
+    std::map<uint32_t, uint64_t> syscallSamples_;
+    uint64_t syscallLostSamples_{};
+    tracer::Arch syscallArch_{tracer::Arch::UNKNOWN};
+    // Budgets by syscall number of executed program's architecture, with
+    // syscall names
+    std::map<uint32_t, std::pair<std::string, uint64_t>>
+            syscallBudgetsByNumber_;
 };
 
 } // namespace perf
@@ -7,6 +7,13 @@ namespace printer {
 
 const std::string HumanReadableOIOutputBuilder::FORMAT_NAME = "human";
 
+OutputBuilder& HumanReadableOIOutputBuilder::setTimeLimitOvershoot(
+        uint64_t overshootUs) {
+    hasTimeLimitOvershoot_ = true;
+    timeLimitOvershootUs_ = overshootUs;
+    return *this;
+}
+
 std::string HumanReadableOIOutputBuilder::dump() const {
     // This is inspired by the oiejq script
     std::stringstream ss;
@@ -16,6 +23,11 @@ std::string HumanReadableOIOutputBuilder::dump() const {
        << "Time used: " << static_cast<float>(milliSecondsElapsed_) / 1000
        << "s" << std::endl
        << "Memory used: " << memoryPeakKb_ / 1024 << "MiB" << std::endl;
+    if (hasTimeLimitOvershoot_) {
+        ss << "Time limit overshoot: "
+           << static_cast<float>(timeLimitOvershootUs_) / 1000 << "ms"
+           << std::endl;
+    }
     return ss.str();
 }
 
@@ -2,14 +2,21 @@
 
 #include "OIModelOutputBuilder.h"
 
+#include <cstdint>
+
 namespace s2j {
 namespace printer {
 
 class HumanReadableOIOutputBuilder : public OIModelOutputBuilder {
 public:
+    OutputBuilder& setTimeLimitOvershoot(uint64_t overshootUs) override;
     std::string dump() const override;
 
     const static std::string FORMAT_NAME;
+
+private:
+    bool hasTimeLimitOvershoot_ = false;
+    uint64_t timeLimitOvershootUs_ = 0;
 };
 
 } // namespace printer
@@ -0,0 +1,111 @@
+#include "JSONOutputBuilder.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+std::string escape(const std::string& str) {
+    std::stringstream ss;
+    ss << '"';
+    for (char c: str) {
+        if (c == '"' || c == '\\') {
+            ss << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+               << static_cast<int>(c) << std::dec;
+        }
+        else {
+            ss << c;
+        }
+    }
+    ss << '"';
+    return ss.str();
+}
+
+} // namespace
+
+namespace s2j {
+namespace printer {
+
+const std::string JSONOutputBuilder::FORMAT_NAME = "json";
+
+OutputBuilder& JSONOutputBuilder::setCyclesUsed(uint64_t cyclesUsed) {
+    instructionsUsed_ = cyclesUsed;
+    return OIModelOutputBuilder::setCyclesUsed(cyclesUsed);
+}
+
+OutputBuilder& JSONOutputBuilder::setThreadsInstructionsUsed(
+        const std::vector<uint64_t>& instructionsUsed) {
+    threadsInstructionsUsed_ = instructionsUsed;
+    return *this;
+}
+
+OutputBuilder& JSONOutputBuilder::setPerfEventCount(
+        const std::string& event,
+        uint64_t count) {
+    perfEventCounts_.emplace_back(event, count);
+    return *this;
+}
+
+OutputBuilder& JSONOutputBuilder::setSyscallsHistogram(
+        const std::vector<std::pair<std::string, uint64_t>>& histogram) {
+    syscallsHistogram_ = histogram;
+    return *this;
+}
+
+OutputBuilder& JSONOutputBuilder::setTracedStops(
+        uint64_t stopsCount,
+        uint64_t stopsTimeMicroseconds) {
+    tracedStopsCount_ = stopsCount;
+    tracedStopsTimeMicroseconds_ = stopsTimeMicroseconds;
+    return *this;
+}
+
+std::string JSONOutputBuilder::dump() const {
+    KillReason reason = killReason_;
+    if (reason == KillReason::NONE) {
+        if (killSignal_ > 0 || exitStatus_ > 0) {
+            reason = KillReason::RE;
+        }
+    }
+
+    std::stringstream status;
+    dumpStatus(status);
+
+    std::stringstream ss;
+    ss << "{\"status\": " << escape(killReasonName(reason))
+       << ", \"message\": " << escape(status.str())
+       << ", \"exit_status\": " << exitStatus_
+       << ", \"kill_signal\": " << killSignal_
+       << ", \"time_ms\": " << milliSecondsElapsed_
+       << ", \"real_time_ms\": " << realMilliSecondsElapsed_
+       << ", \"user_time_ms\": " << userMilliSecondsElapsed_
+       << ", \"sys_time_ms\": " << sysMilliSecondsElapsed_
+       << ", \"memory_kb\": " << memoryPeakKb_
+       << ", \"syscalls\": " << syscallsCounter_
+       << ", \"instructions\": " << instructionsUsed_
+       << ", \"threads_instructions\": [";
+    for (size_t index = 0; index < threadsInstructionsUsed_.size(); ++index) {
+        ss << (index > 0 ? ", " : "") << threadsInstructionsUsed_[index];
+    }
+    ss << "], \"perf_events\": {";
+    for (size_t index = 0; index < perfEventCounts_.size(); ++index) {
+        ss << (index > 0 ? ", " : "") << escape(perfEventCounts_[index].first)
+           << ": " << perfEventCounts_[index].second;
+    }
+    ss << "}, \"syscalls_histogram\": {";
+    for (size_t index = 0; index < syscallsHistogram_.size(); ++index) {
+        ss << (index > 0 ? ", " : "")
+           << escape(syscallsHistogram_[index].first) << ": "
+           << syscallsHistogram_[index].second;
+    }
+    ss << "}, \"traced_stops\": " << tracedStopsCount_
+       << ", \"traced_stops_time_us\": " << tracedStopsTimeMicroseconds_
+       << "}" << std::endl;
+    return ss.str();
+}
+
+} // namespace printer
+} // namespace s2j
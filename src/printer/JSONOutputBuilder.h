@@ -0,0 +1,44 @@
+#pragma once
+
+#include "OIModelOutputBuilder.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace s2j {
+namespace printer {
+
+/**
+ * Reports all collected measurements as a single line JSON object, including
+ * counts of additional perf events and syscall statistics.
+ */
+class JSONOutputBuilder : public OIModelOutputBuilder {
+public:
+    OutputBuilder& setCyclesUsed(uint64_t cyclesUsed) override;
+    OutputBuilder& setThreadsInstructionsUsed(
+            const std::vector<uint64_t>& instructionsUsed) override;
+    OutputBuilder& setPerfEventCount(const std::string& event, uint64_t count)
+            override;
+    OutputBuilder& setSyscallsHistogram(
+            const std::vector<std::pair<std::string, uint64_t>>& histogram)
+            override;
+    OutputBuilder& setTracedStops(
+            uint64_t stopsCount,
+            uint64_t stopsTimeMicroseconds) override;
+    std::string dump() const override;
+
+    const static std::string FORMAT_NAME;
+
+private:
+    uint64_t instructionsUsed_ = 0;
+    std::vector<uint64_t> threadsInstructionsUsed_;
+    std::vector<std::pair<std::string, uint64_t>> perfEventCounts_;
+    std::vector<std::pair<std::string, uint64_t>> syscallsHistogram_;
+    uint64_t tracedStopsCount_ = 0;
+    uint64_t tracedStopsTimeMicroseconds_ = 0;
+};
+
+} // namespace printer
+} // namespace s2j
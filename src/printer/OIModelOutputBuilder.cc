@@ -7,15 +7,24 @@ namespace s2j {
 namespace printer {
 
 OIModelOutputBuilder::OIModelOutputBuilder()
-        : milliSecondsElapsed_(0)
+        : cyclesPerSecond_(CYCLES_PER_SECOND)
+        , milliSecondsElapsed_(0)
         , realMilliSecondsElapsed_(0)
+        , userMilliSecondsElapsed_(0)
+        , sysMilliSecondsElapsed_(0)
         , memoryPeakKb_(0)
         , syscallsCounter_(0)
         , exitStatus_(0)
         , killSignal_(0) {}
 
 OutputBuilder& OIModelOutputBuilder::setCyclesUsed(uint64_t cyclesUsed) {
-    milliSecondsElapsed_ = cyclesUsed * 1'000 / CYCLES_PER_SECOND;
+    milliSecondsElapsed_ = cyclesUsed * 1'000 / cyclesPerSecond_;
+    return *this;
+}
+
+OutputBuilder& OIModelOutputBuilder::setCyclesPerSecond(
+        uint64_t cyclesPerSecond) {
+    cyclesPerSecond_ = cyclesPerSecond;
     return *this;
 }
 
@@ -39,6 +48,11 @@ OutputBuilder& OIModelOutputBuilder::setMemoryPeak(uint64_t memoryPeakKb) {
     return *this;
 }
 
+OutputBuilder& OIModelOutputBuilder::setSyscallsCount(uint64_t syscallsCount) {
+    syscallsCounter_ = syscallsCount;
+    return *this;
+}
+
 OutputBuilder& OIModelOutputBuilder::setExitStatus(uint32_t exitStatus) {
     if (exitStatus_ == 0) {
         exitStatus_ = exitStatus;
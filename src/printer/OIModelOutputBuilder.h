@@ -9,21 +9,25 @@ namespace printer {
 
 class OIModelOutputBuilder : public OutputBuilder {
 public:
+    // Speed assumed unless host's calibration profile is given
+    static const uint64_t CYCLES_PER_SECOND = 2'000'000'000;
+
     OIModelOutputBuilder();
 
     OutputBuilder& setCyclesUsed(uint64_t cyclesUsed) override;
+    OutputBuilder& setCyclesPerSecond(uint64_t cyclesPerSecond) override;
     OutputBuilder& setRealTimeMicroseconds(uint64_t time) override;
     OutputBuilder& setUserTimeMicroseconds(uint64_t time) override;
     OutputBuilder& setSysTimeMicroseconds(uint64_t time) override;
     OutputBuilder& setMemoryPeak(uint64_t memoryPeakKb) override;
+    OutputBuilder& setSyscallsCount(uint64_t syscallsCount) override;
     OutputBuilder& setExitStatus(uint32_t exitStatus) override;
     OutputBuilder& setKillSignal(uint32_t killSignal) override;
     OutputBuilder& setKillReason(KillReason reason, const std::string& comment)
             override;
 
 protected:
-    static const uint64_t CYCLES_PER_SECOND = 2'000'000'000;
-
+    uint64_t cyclesPerSecond_;
     uint64_t milliSecondsElapsed_;
     uint64_t realMilliSecondsElapsed_;
     uint64_t userMilliSecondsElapsed_;
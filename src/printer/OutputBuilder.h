@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace s2j {
 namespace printer {
@@ -33,6 +35,9 @@ public:
     virtual OutputBuilder& setCyclesUsed(uint64_t cyclesUsed) {
         return *this;
     }
+    virtual OutputBuilder& setCyclesPerSecond(uint64_t cyclesPerSecond) {
+        return *this;
+    }
     virtual OutputBuilder& setRealTimeMicroseconds(uint64_t time) {
         return *this;
     }
@@ -45,6 +50,35 @@ public:
     virtual OutputBuilder& setMemoryPeak(uint64_t memoryPeakKb) {
         return *this;
     }
+    virtual OutputBuilder& setTimeLimitOvershoot(uint64_t overshootUs) {
+        return *this;
+    }
+    virtual OutputBuilder& setThreadsInstructionsUsed(
+            const std::vector<uint64_t>& instructionsUsed) {
+        return *this;
+    }
+    virtual OutputBuilder& setPerfEventCount(
+            const std::string& event,
+            uint64_t count) {
+        return *this;
+    }
+    virtual OutputBuilder& setProfile(
+            const std::vector<std::pair<std::string, uint64_t>>& profile,
+            uint64_t samplesCount) {
+        return *this;
+    }
+    virtual OutputBuilder& setSyscallsCount(uint64_t syscallsCount) {
+        return *this;
+    }
+    virtual OutputBuilder& setSyscallsHistogram(
+            const std::vector<std::pair<std::string, uint64_t>>& histogram) {
+        return *this;
+    }
+    virtual OutputBuilder& setTracedStops(
+            uint64_t stopsCount,
+            uint64_t stopsTimeMicroseconds) {
+        return *this;
+    }
     virtual OutputBuilder& setExitStatus(uint32_t exitStatus) {
         return *this;
     }
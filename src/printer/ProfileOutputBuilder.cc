@@ -0,0 +1,48 @@
+#include "ProfileOutputBuilder.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace s2j {
+namespace printer {
+
+const std::string ProfileOutputBuilder::FORMAT_NAME = "profile";
+
+OutputBuilder& ProfileOutputBuilder::setProfile(
+        const std::vector<std::pair<std::string, uint64_t>>& profile,
+        uint64_t samplesCount) {
+    profile_ = profile;
+    samplesCount_ = samplesCount;
+    return *this;
+}
+
+OutputBuilder& ProfileOutputBuilder::setSyscallsHistogram(
+        const std::vector<std::pair<std::string, uint64_t>>& histogram) {
+    syscallsHistogram_ = histogram;
+    return *this;
+}
+
+std::string ProfileOutputBuilder::dump() const {
+    std::stringstream ss;
+    ss << HumanReadableOIOutputBuilder::dump();
+    ss << "Profile samples: " << samplesCount_ << std::endl;
+    for (const auto& entry: profile_) {
+        ss << std::fixed << std::setprecision(2) << std::setw(7)
+           << static_cast<double>(entry.second) * 100 /
+                        std::max<uint64_t>(1, samplesCount_)
+           << "% " << std::setw(10) << entry.second << "  " << entry.first
+           << std::endl;
+    }
+    if (!syscallsHistogram_.empty()) {
+        ss << "Syscalls: " << syscallsCounter_ << std::endl;
+        for (const auto& entry: syscallsHistogram_) {
+            ss << std::setw(18) << entry.second << "  " << entry.first
+               << std::endl;
+        }
+    }
+    return ss.str();
+}
+
+} // namespace printer
+} // namespace s2j
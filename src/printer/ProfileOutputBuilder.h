@@ -0,0 +1,37 @@
+#pragma once
+
+#include "HumanReadableOIOutputBuilder.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace s2j {
+namespace printer {
+
+/**
+ * Human readable result followed by histogram of sampled instruction
+ * pointers, most frequent functions first, and histogram of syscalls when
+ * it was collected.
+ */
+class ProfileOutputBuilder : public HumanReadableOIOutputBuilder {
+public:
+    OutputBuilder& setProfile(
+            const std::vector<std::pair<std::string, uint64_t>>& profile,
+            uint64_t samplesCount) override;
+    OutputBuilder& setSyscallsHistogram(
+            const std::vector<std::pair<std::string, uint64_t>>& histogram)
+            override;
+    std::string dump() const override;
+
+    const static std::string FORMAT_NAME;
+
+private:
+    std::vector<std::pair<std::string, uint64_t>> profile_;
+    uint64_t samplesCount_ = 0;
+    std::vector<std::pair<std::string, uint64_t>> syscallsHistogram_;
+};
+
+} // namespace printer
+} // namespace s2j
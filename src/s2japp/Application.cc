@@ -1,6 +1,7 @@
 #include "Application.h"
 #include "ApplicationException.h"
 
+#include "cgroup/CgroupListener.h"
 #include "executor/Executor.h"
 #include "files/FilesListener.h"
 #include "limits/MemoryLimitListener.h"
@@ -16,18 +17,77 @@
 #include "ns/PIDNamespaceListener.h"
 #include "ns/UTSNamespaceListener.h"
 #include "ns/UserNamespaceListener.h"
+#include "perf/Calibration.h"
+#include "perf/PerfEventConfig.h"
 #include "perf/PerfListener.h"
 #include "priv/PrivListener.h"
 #include "seccomp/SeccompListener.h"
 #include "seccomp/TimeRandomizerListener.h"
+#include "seccomp/action/ActionBudget.h"
 #include "seccomp/policy/DefaultPolicy.h"
 #include "tracer/TraceExecutor.h"
 
+#include <csignal>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <list>
+#include <map>
 #include <utility>
 
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// Set by SIGTERM or SIGINT, serve mode stops after the current job
+volatile sig_atomic_t stopServing = 0;
+
+void handleStopSignal(int /* signal */) {
+    stopServing = 1;
+}
+
+/**
+ * Reads one line from fd, buffering data past the line end in buffer.
+ * Returns false on end of file, or when serving is stopped.
+ */
+bool readLine(int fd, std::string& buffer, std::string& line) {
+    char chunk[4096];
+    for (;;) {
+        auto end = buffer.find('\n');
+        if (end != std::string::npos) {
+            line = buffer.substr(0, end);
+            buffer.erase(0, end + 1);
+            return true;
+        }
+
+        ssize_t bytesRead = s2j::withErrnoCheck(
+                "read job description",
+                {EINTR},
+                read,
+                fd,
+                chunk,
+                sizeof(chunk));
+        if (bytesRead == 0) {
+            line = std::move(buffer);
+            buffer.clear();
+            return !line.empty();
+        }
+        if (bytesRead > 0) {
+            buffer.append(chunk, bytesRead);
+        }
+        else if (stopServing) {
+            return false;
+        }
+    }
+}
+
+} // namespace
+
 namespace s2j {
 namespace app {
 
@@ -43,6 +103,12 @@ Application::ExitCode Application::main() {
     if (settings_.action == ApplicationSettings::Action::RUN) {
         return handleRun();
     }
+    if (settings_.action == ApplicationSettings::Action::SERVE) {
+        return handleServe();
+    }
+    if (settings_.action == ApplicationSettings::Action::CALIBRATE) {
+        return handleCalibrate();
+    }
     if (settings_.action == ApplicationSettings::Action::PRINT_HELP) {
         return handleHelp();
     }
@@ -66,6 +132,22 @@ Application::ExitCode Application::handleVersion() {
     return ExitCode::OK;
 }
 
+Application::ExitCode Application::handleCalibrate() {
+    TRACE();
+
+    auto profile = perf::calibrate(settings_.perfCacheDirectory);
+    if (settings_.calibrationProfilePath.empty()) {
+        std::cout << profile.dump();
+    }
+    else {
+        profile.store(settings_.calibrationProfilePath);
+        logger::info(
+                "Calibration profile stored at ",
+                settings_.calibrationProfilePath);
+    }
+    return ExitCode::OK;
+}
+
 Application::ExitCode Application::handleRun() {
     TRACE();
 
@@ -77,14 +159,54 @@ Application::ExitCode Application::handleRun() {
 
     auto traceExecutor = createListener<tracer::TraceExecutor>();
 
+    bool fakeTime = settings_.features.count(Feature::FAKE_TIME) > 0;
+    auto seccompPolicy = fakeTime
+            ? std::make_shared<seccomp::policy::DefaultPolicy>(true)
+            : settings_.syscallPolicyFactory();
 
     uint64_t perfSamplingFactor = settings_.perfOversamplingFactor;
     if (settings_.threadsLimit > 0) {
         perfSamplingFactor *= static_cast<uint64_t>(settings_.threadsLimit);
     }
 
+    // Seccomp kills child on fork and, without threads support, on clone.
+    // Threads are then reported by tracer, so each one can get its own
+    // counters instead of inherited ones.
+    bool perfInherit = settings_.features.count(Feature::SECCOMP) == 0 ||
+            (settings_.threadsLimit >= 0 && traceExecutor == nullptr);
+    auto syscallStats = perf::PerfListener::SyscallStats::OFF;
+    if (settings_.syscallStats == ApplicationSettings::SyscallStats::COUNT) {
+        syscallStats = perf::PerfListener::SyscallStats::COUNT;
+    }
+    else if (
+            settings_.syscallStats ==
+            ApplicationSettings::SyscallStats::HISTOGRAM) {
+        syscallStats = perf::PerfListener::SyscallStats::HISTOGRAM;
+    }
+    // Budgets that kill are enforced from recorded syscalls when possible,
+    // so that their calls don't stop the program. Recorded syscalls are
+    // resolved once tracer reports the executed program.
+    std::map<std::string, uint64_t> syscallBudgets;
+    if (settings_.features.count(Feature::PERF) > 0 && !perfInherit &&
+        traceExecutor != nullptr && perf::PerfListener::canRecordSyscalls()) {
+        syscallBudgets =
+                seccomp::action::ActionBudget::countKillingBudgetsExternally(
+                        seccompPolicy->getRules());
+    }
     auto perfListener = createListener<perf::PerfListener>(
-            settings_.instructionCountLimit, perfSamplingFactor);
+            settings_.instructionCountLimit,
+            perfSamplingFactor,
+            settings_.perfCacheDirectory,
+            perfInherit,
+            settings_.perfEvents,
+            settings_.threadInstructionCountLimit,
+            settings_.perfProfileEntries > 0 ? settings_.perfProfilePeriod
+                                             : 0,
+            settings_.perfProfileEntries,
+            settings_.perfExactLimits,
+            settings_.seccompProfileRecordPath,
+            syscallStats,
+            syscallBudgets);
     auto userNsListener = createListener<ns::UserNamespaceListener>();
     auto utsNsListener = createListener<ns::UTSNamespaceListener>();
     auto ipcNsListener = createListener<ns::IPCNamespaceListener>();
@@ -97,26 +219,46 @@ Application::ExitCode Application::handleRun() {
     auto privListener = createListener<priv::PrivListener>();
     auto timeRandomizer = createListener<seccomp::TimeRandomizerListener>(
             settings_.timeMode == ApplicationSettings::TimeMode::ZERO);
-
-    bool fakeTime = settings_.features.count(Feature::FAKE_TIME) > 0;
-    auto seccompPolicy = fakeTime
-            ? std::make_shared<seccomp::policy::DefaultPolicy>(true)
-            : settings_.syscallPolicyFactory();
-    auto seccompListener =
-            createListener<seccomp::SeccompListener>(seccompPolicy);
+    auto seccompCompiler = settings_.seccompCompiler ==
+                    ApplicationSettings::SeccompCompiler::LIBSECCOMP
+            ? seccomp::SeccompContext::Compiler::LIBSECCOMP
+            : seccomp::SeccompContext::Compiler::BUILTIN;
+    auto seccompListener = createListener<seccomp::SeccompListener>(
+            seccompPolicy,
+            settings_.seccompCacheDirectory,
+            settings_.features.count(Feature::SECCOMP_NOTIFY) > 0,
+            seccompCompiler,
+            settings_.seccompProfilePath);
+    std::shared_ptr<cgroup::CgroupListener> cgroupListener;
+    bool cgroupMemory = settings_.memoryAccounting ==
+            ApplicationSettings::MemoryAccounting::CGROUP;
+    bool cgroupTime = settings_.timeAccounting ==
+            ApplicationSettings::TimeAccounting::CGROUP;
+    if (cgroupMemory || cgroupTime) {
+        cgroupListener =
+                std::make_shared<cgroup::CgroupListener>(settings_.cgroupPath);
+    }
     auto memoryLimitListener = std::make_shared<limits::MemoryLimitListener>(
-            settings_.memoryLimitKb);
+            settings_.memoryLimitKb,
+            cgroupMemory ? cgroupListener : nullptr,
+            settings_.features.count(Feature::SECCOMP_NOTIFY) > 0);
     auto outputLimitListener = std::make_shared<limits::OutputLimitListener>(
             settings_.outputLimitB);
     auto timeLimitListener = std::make_shared<limits::TimeLimitListener>(
             settings_.rTimelimitUs,
             settings_.uTimelimitUs,
             settings_.sTimelimitUs,
-            settings_.usTimelimitUs);
+            settings_.usTimelimitUs,
+            settings_.timerMinIntervalUs,
+            settings_.timerMaxIntervalUs,
+            cgroupTime ? cgroupListener : nullptr,
+            settings_.features.count(Feature::CPU_CLOCK_TIMER) > 0);
     auto threadsLimitListener = std::make_shared<limits::ThreadsLimitListener>(
             settings_.threadsLimit);
-    auto filesListener =
-            std::make_shared<files::FilesListener>(settings_.suppressStderr);
+    auto filesListener = std::make_shared<files::FilesListener>(
+            settings_.suppressStderr,
+            settings_.stdinPath,
+            settings_.stdoutPath);
     auto loggerListener = std::make_shared<logger::LoggerListener>();
 
     auto resultsFD = FD(settings_.resultsFD, false);
@@ -126,6 +268,9 @@ Application::ExitCode Application::handleRun() {
 
     // Some listeners can return output
     auto outputBuilder = settings_.outputBuilderFactory();
+    if (settings_.instructionsPerSecond != 0) {
+        outputBuilder->setCyclesPerSecond(settings_.instructionsPerSecond);
+    }
     forEachListener<s2j::printer::OutputSource>(
             [outputBuilder](auto listener) {
                 listener->setOutputBuilder(outputBuilder);
@@ -143,6 +288,7 @@ Application::ExitCode Application::handleRun() {
     forEachListener<executor::ExecuteEventListener>(
             [executor](auto listener) { executor->addEventListener(listener); },
             loggerListener,
+            cgroupListener,
             memoryLimitListener,
             outputLimitListener,
             timeLimitListener,
@@ -169,6 +315,7 @@ Application::ExitCode Application::handleRun() {
                 loggerListener,
                 memoryLimitListener,
                 threadsLimitListener,
+                perfListener,
                 timeRandomizer,
                 seccompListener);
     }
@@ -196,6 +343,270 @@ Application::ExitCode Application::handleRun() {
     return ExitCode::OK;
 }
 
+Application::ExitCode Application::handleServe() {
+    TRACE();
+
+    // Job workers are forked from this process, so perf events discovered
+    // here are inherited by all of them instead of discovered per job.
+    if (settings_.features.count(Feature::PERF) > 0) {
+        try {
+            perf::getInstructionsEventConfigs(settings_.perfCacheDirectory);
+        }
+        catch (const Exception& ex) {
+            logger::warn("Can't discover perf events: ", ex.what());
+        }
+    }
+
+    // Workers only pass results back, so compiled filters are shared
+    // through a cache directory, a private one unless given. Each job still
+    // parses its arguments and sets up listeners and namespaces.
+    bool privateCacheDirectory = settings_.seccompCacheDirectory.empty();
+    jobsSeccompCacheDirectory_ = privateCacheDirectory
+            ? createTemporaryDirectory()
+            : settings_.seccompCacheDirectory;
+
+    // Accept and read are interrupted rather than restarted, so that
+    // serving can be stopped cleanly
+    struct sigaction stopAction {};
+    stopAction.sa_handler = handleStopSignal;
+    sigemptyset(&stopAction.sa_mask);
+    for (int stopSignal: {SIGTERM, SIGINT}) {
+        withErrnoCheck(
+                "sigaction", sigaction, stopSignal, &stopAction, nullptr);
+    }
+
+    try {
+        if (settings_.serveSocketPath.empty()) {
+            serveJobs(settings_.serveFD, settings_.resultsFD);
+        }
+        else {
+            serveSocket();
+        }
+    }
+    catch (...) {
+        if (privateCacheDirectory) {
+            removeTemporaryDirectory(jobsSeccompCacheDirectory_);
+        }
+        throw;
+    }
+    if (privateCacheDirectory) {
+        removeTemporaryDirectory(jobsSeccompCacheDirectory_);
+    }
+    return ExitCode::OK;
+}
+
+void Application::serveSocket() {
+    TRACE();
+
+    struct sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (settings_.serveSocketPath.size() >= sizeof(address.sun_path)) {
+        throw InvalidConfigurationException("serve socket path is too long");
+    }
+    strncpy(address.sun_path,
+            settings_.serveSocketPath.c_str(),
+            sizeof(address.sun_path) - 1);
+
+    FD socket(
+            withErrnoCheck(
+                    "create serve socket",
+                    ::socket,
+                    AF_UNIX,
+                    SOCK_STREAM | SOCK_CLOEXEC,
+                    0),
+            true);
+
+    // Socket may be left by a server that didn't stop cleanly, unless it is
+    // still accepting connections
+    struct stat socketStat {};
+    if (lstat(address.sun_path, &socketStat) == 0 &&
+        S_ISSOCK(socketStat.st_mode)) {
+        FD probe(
+                withErrnoCheck(
+                        "create serve socket",
+                        ::socket,
+                        AF_UNIX,
+                        SOCK_STREAM | SOCK_CLOEXEC,
+                        0),
+                true);
+        if (connect(probe,
+                    reinterpret_cast<struct sockaddr*>(&address),
+                    sizeof(address)) == 0) {
+            throw InvalidConfigurationException(
+                    "serve socket " + settings_.serveSocketPath +
+                    " is in use");
+        }
+        withErrnoCheck("remove stale serve socket", unlink, address.sun_path);
+    }
+    withErrnoCheck(
+            "bind serve socket",
+            bind,
+            socket,
+            reinterpret_cast<struct sockaddr*>(&address),
+            sizeof(address));
+
+    try {
+        withErrnoCheck("listen on serve socket", listen, socket, SOMAXCONN);
+        logger::info("Serving on ", settings_.serveSocketPath);
+
+        // Clients may disconnect at any time, don't die writing to them
+        signal(SIGPIPE, SIG_IGN);
+
+        while (!stopServing) {
+            int connectionFD = withErrnoCheck(
+                    "accept serve connection",
+                    {EINTR, ECONNABORTED},
+                    accept4,
+                    socket,
+                    nullptr,
+                    nullptr,
+                    SOCK_CLOEXEC);
+            if (connectionFD < 0) {
+                continue;
+            }
+
+            FD connection(connectionFD, true);
+            try {
+                serveJobs(connection, connection);
+            }
+            catch (const SystemException& ex) {
+                logger::warn("Serve connection failed: ", ex.what());
+            }
+        }
+    }
+    catch (...) {
+        unlink(address.sun_path);
+        throw;
+    }
+    logger::info("Stopped serving on ", settings_.serveSocketPath);
+    unlink(address.sun_path);
+}
+
+void Application::serveJobs(int jobsFD, int resultsFD) {
+    TRACE(jobsFD, resultsFD);
+
+    FD results(resultsFD, false);
+    if (!results.good()) {
+        throw InvalidConfigurationException("invalid results file descriptor");
+    }
+
+    std::string buffer;
+    std::string line;
+    uint64_t jobId = 0;
+    while (!stopServing && readLine(jobsFD, buffer, line)) {
+        std::string output;
+        ExitCode status;
+        try {
+            auto arguments = splitArguments(line);
+            if (arguments.empty() || arguments[0][0] == '#') {
+                continue;
+            }
+            status = runJob(jobsFD, arguments, output);
+        }
+        catch (const SystemException&) {
+            throw;
+        }
+        catch (const Exception& ex) {
+            // Malformed job description, report it and carry on
+            status = ExitCode::PARSE_ERROR;
+            output = ex.what();
+        }
+        ++jobId;
+        logger::debug("Job ", jobId, " finished with status ", status);
+
+        // Each result is prefixed with a header, so that results of any
+        // output format can be told apart
+        results << "__JOB__ " + std::to_string(jobId) + " " +
+                        std::to_string(status) + " " +
+                        std::to_string(output.size()) + "\n" + output;
+    }
+}
+
+Application::ExitCode Application::runJob(
+        int jobsFD,
+        const std::vector<std::string>& arguments,
+        std::string& output) {
+    TRACE();
+
+    std::vector<const char*> argv{"sio2jail"};
+    for (const auto& argument: arguments) {
+        argv.push_back(argument.c_str());
+    }
+    ApplicationSettings settings(argv.size(), argv.data());
+    if (settings.action != ApplicationSettings::Action::RUN) {
+        output = settings.parsingError.empty()
+                ? "job description must specify a program to run"
+                : settings.parsingError;
+        return ExitCode::PARSE_ERROR;
+    }
+
+    int resultsPipe[2];
+    withErrnoCheck("create job results pipe", pipe2, resultsPipe, O_CLOEXEC);
+    FD resultsReader(resultsPipe[0], true);
+    FD resultsWriter(resultsPipe[1], true);
+    settings.resultsFD = resultsWriter;
+    if (settings.seccompCacheDirectory.empty()) {
+        settings.seccompCacheDirectory = jobsSeccompCacheDirectory_;
+    }
+
+    // Each job runs in a fresh worker, as namespaces and listeners are set up
+    // per run. Only process startup, perf events discovery and compiled
+    // seccomp filters are shared by jobs.
+    pid_t worker = withErrnoCheck("fork job worker", fork);
+    if (worker == 0) {
+        // Don't let the job descriptions stream leak to supervised program
+        if (jobsFD == 0) {
+            dup2(FD::open("/dev/null", O_RDONLY), 0);
+        }
+        else {
+            close(jobsFD);
+        }
+        signal(SIGPIPE, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+
+        ExitCode status;
+        try {
+            status = Application(std::move(settings)).main();
+        }
+        catch (const std::exception& ex) {
+            FD(resultsPipe[1]) << std::string("Exception occurred: ") +
+                            ex.what() + "\n";
+            status = ExitCode::FATAL_ERROR;
+        }
+        _exit(status);
+    }
+    resultsWriter.close();
+
+    char chunk[4096];
+    ssize_t bytesRead;
+    while ((bytesRead = withErrnoCheck(
+                    "read job results",
+                    {EINTR},
+                    read,
+                    resultsReader,
+                    chunk,
+                    sizeof(chunk))) != 0) {
+        if (bytesRead > 0) {
+            output.append(chunk, bytesRead);
+        }
+    }
+
+    int workerStatus = 0;
+    while (withErrnoCheck(
+                   "wait for job worker",
+                   {EINTR},
+                   waitpid,
+                   worker,
+                   &workerStatus,
+                   0) < 0) {
+    }
+    if (WIFEXITED(workerStatus)) {
+        return static_cast<ExitCode>(WEXITSTATUS(workerStatus));
+    }
+    return ExitCode::FATAL_ERROR;
+}
+
 void Application::initializeLogger() {
     if (settings_.loggerPath == "-") {
         logger_ = std::make_shared<s2j::logger::FDLogger>(2 /* stderr */);
@@ -5,6 +5,9 @@
 #include "logger/Logger.h"
 #include "printer/OutputBuilder.h"
 
+#include <string>
+#include <vector>
+
 namespace s2j {
 namespace app {
 
@@ -25,10 +28,22 @@ private:
     ExitCode handleHelp();
     ExitCode handleVersion();
     ExitCode handleRun();
+    ExitCode handleServe();
+    ExitCode handleCalibrate();
+
+    void serveSocket();
+    void serveJobs(int jobsFD, int resultsFD);
+    ExitCode runJob(
+            int jobsFD,
+            const std::vector<std::string>& arguments,
+            std::string& output);
 
     const ApplicationSettings settings_;
     std::shared_ptr<logger::Logger> logger_;
 
+    // Directory where serve mode jobs share compiled seccomp filters
+    std::string jobsSeccompCacheDirectory_;
+
     void initializeLogger();
 
     template<typename Listener, typename... Args>
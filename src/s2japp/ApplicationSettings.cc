@@ -3,12 +3,20 @@
 #include "ApplicationException.h"
 
 #include "common/Utils.h"
+#include "common/Version.h"
+#include "limits/TimeLimitListener.h"
+#include "perf/Calibration.h"
+#include "perf/PerfListener.h"
 #include "printer/AugmentedOIOutputBuilder.h"
 #include "printer/HumanReadableOIOutputBuilder.h"
+#include "printer/JSONOutputBuilder.h"
+#include "printer/OIModelOutputBuilder.h"
 #include "printer/OITimeToolOutputBuilder.h"
+#include "printer/ProfileOutputBuilder.h"
 #include "printer/RealTimeOIOutputBuilder.h"
 #include "printer/UserTimeOIOutputBuilder.h"
 #include "seccomp/policy/DefaultPolicy.h"
+#include "seccomp/policy/FilePolicy.h"
 #include "seccomp/policy/PermissivePolicy.h"
 
 #include <cstdint>
@@ -84,7 +92,7 @@ private:
 namespace s2j {
 namespace app {
 
-const std::string ApplicationSettings::VERSION = "1.5.4";
+const std::string ApplicationSettings::VERSION = s2j::VERSION;
 
 const std::string ApplicationSettings::DESCRIPTION =
         "SIO2jail, a sandbox for programming contests.";
@@ -100,7 +108,10 @@ const FactoryMap<s2j::printer::OutputBuilder>
                  {"oiuser",
                   std::make_shared<s2j::printer::UserTimeOIOutputBuilder>},
                  {"oireal",
-                  std::make_shared<s2j::printer::RealTimeOIOutputBuilder>}});
+                  std::make_shared<s2j::printer::RealTimeOIOutputBuilder>},
+                 {"json", std::make_shared<s2j::printer::JSONOutputBuilder>},
+                 {"profile",
+                  std::make_shared<s2j::printer::ProfileOutputBuilder>}});
 const std::string ApplicationSettings::DEFAULT_OUTPUT_FORMAT = "oitt";
 
 const FactoryMap<s2j::seccomp::policy::BaseSyscallPolicy>
@@ -130,11 +141,77 @@ const FactoryMap<ApplicationSettings::TimeModeHolder>
                   }}});
 const std::string ApplicationSettings::DEFAULT_FAKE_TIME_MODE = "off";
 
+const FactoryMap<ApplicationSettings::MemoryAccountingHolder>
+        ApplicationSettings::MEMORY_ACCOUNTING_MODES(
+                {{"address-space",
+                  []() {
+                      return std::make_shared<MemoryAccountingHolder>(
+                              MemoryAccountingHolder{
+                                      MemoryAccounting::ADDRESS_SPACE});
+                  }},
+                 {"cgroup",
+                  []() {
+                      return std::make_shared<MemoryAccountingHolder>(
+                              MemoryAccountingHolder{
+                                      MemoryAccounting::CGROUP});
+                  }}});
+const std::string ApplicationSettings::DEFAULT_MEMORY_ACCOUNTING_MODE =
+        "address-space";
+
+const FactoryMap<ApplicationSettings::TimeAccountingHolder>
+        ApplicationSettings::TIME_ACCOUNTING_MODES(
+                {{"procfs",
+                  []() {
+                      return std::make_shared<TimeAccountingHolder>(
+                              TimeAccountingHolder{TimeAccounting::PROCFS});
+                  }},
+                 {"cgroup",
+                  []() {
+                      return std::make_shared<TimeAccountingHolder>(
+                              TimeAccountingHolder{TimeAccounting::CGROUP});
+                  }}});
+const std::string ApplicationSettings::DEFAULT_TIME_ACCOUNTING_MODE = "procfs";
+
+const FactoryMap<ApplicationSettings::SeccompCompilerHolder>
+        ApplicationSettings::SECCOMP_COMPILERS(
+                {{"builtin",
+                  []() {
+                      return std::make_shared<SeccompCompilerHolder>(
+                              SeccompCompilerHolder{SeccompCompiler::BUILTIN});
+                  }},
+                 {"libseccomp",
+                  []() {
+                      return std::make_shared<SeccompCompilerHolder>(
+                              SeccompCompilerHolder{
+                                      SeccompCompiler::LIBSECCOMP});
+                  }}});
+const std::string ApplicationSettings::DEFAULT_SECCOMP_COMPILER = "libseccomp";
+
+const FactoryMap<ApplicationSettings::SyscallStatsHolder>
+        ApplicationSettings::SYSCALL_STATS_MODES(
+                {{"off",
+                  []() {
+                      return std::make_shared<SyscallStatsHolder>(
+                              SyscallStatsHolder{SyscallStats::OFF});
+                  }},
+                 {"count",
+                  []() {
+                      return std::make_shared<SyscallStatsHolder>(
+                              SyscallStatsHolder{SyscallStats::COUNT});
+                  }},
+                 {"histogram",
+                  []() {
+                      return std::make_shared<SyscallStatsHolder>(
+                              SyscallStatsHolder{SyscallStats::HISTOGRAM});
+                  }}});
+const std::string ApplicationSettings::DEFAULT_SYSCALL_STATS_MODE = "off";
+
 const std::map<std::string, std::pair<Feature, bool>>
         ApplicationSettings::FEATURE_BY_NAME(
                 {{"ptrace", {Feature::PTRACE, true}},
                  {"perf", {Feature::PERF, true}},
                  {"seccomp", {Feature::SECCOMP, true}},
+                 {"seccomp-notify", {Feature::SECCOMP_NOTIFY, false}},
                  {"pid-namespace", {Feature::PID_NAMESPACE, true}},
                  {"net-namespace", {Feature::NET_NAMESPACE, true}},
                  {"ipc-namespace", {Feature::IPC_NAMESPACE, true}},
@@ -142,7 +219,8 @@ const std::map<std::string, std::pair<Feature, bool>>
                  {"user-namespace", {Feature::USER_NAMESPACE, true}},
                  {"mount-namespace", {Feature::MOUNT_NAMESPACE, true}},
                  {"procfs", {Feature::MOUNT_PROCFS, false}},
-                 {"capability-drop", {Feature::CAPABILITY_DROP, true}}});
+                 {"capability-drop", {Feature::CAPABILITY_DROP, true}},
+                 {"cpu-clock-timer", {Feature::CPU_CLOCK_TIMER, false}}});
 
 const std::vector<std::string> ApplicationSettings::FLAGS_ON(
         {"on", "yes", "1"});
@@ -157,6 +235,11 @@ ApplicationSettings::ApplicationSettings()
 ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
         : ApplicationSettings() {
     StringOutputGenerator outputGenerator(*this);
+
+    // TCLAP tracks optional unlabeled arguments globally, reset it so that
+    // settings can be parsed more than once per process (i.e. in serve mode).
+    TCLAP::OptionalUnlabeledTracker::alreadyOptional() = false;
+
     try {
         TCLAP::CmdLine cmd(DESCRIPTION, ' ', VERSION, false);
         cmd.setExceptionHandling(true);
@@ -211,6 +294,59 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
                 &syscallPolicy,
                 cmd);
 
+        TCLAP::ValueArg<std::string> argPolicyFile(
+                "",
+                "policy-file",
+                "Syscall policy file, used instead of --policy",
+                false,
+                "",
+                "file",
+                cmd);
+
+        TCLAP::ValueArg<std::string> argSeccompCacheDirectory(
+                "",
+                "seccomp-cache-dir",
+                "Directory to cache compiled seccomp filters in",
+                false,
+                "",
+                "dir",
+                cmd);
+
+        args::ImplementationNameArgument<SeccompCompilerHolder>
+                seccompCompilerName(
+                        "seccomp filter compiler",
+                        DEFAULT_SECCOMP_COMPILER,
+                        SECCOMP_COMPILERS);
+        TCLAP::ValueArg<decltype(seccompCompilerName)> argSeccompCompiler(
+                "",
+                "seccomp-compiler",
+                "Compiler of seccomp filters: builtin one, which dispatches "
+                "syscalls with binary search, or libseccomp",
+                false,
+                seccompCompilerName,
+                &seccompCompilerName,
+                cmd);
+
+        TCLAP::ValueArg<std::string> argSeccompProfile(
+                "",
+                "seccomp-profile",
+                "Syscall profile whose most frequent syscalls are matched "
+                "first by seccomp filter",
+                false,
+                "",
+                "file",
+                cmd);
+
+        TCLAP::ValueArg<std::string> argSeccompProfileRecord(
+                "",
+                "seccomp-profile-record",
+                "Count syscalls of the program and add them to syscall "
+                "profile in given file",
+                false,
+                "",
+                "file",
+                cmd);
+
         TCLAP::ValueArg<args::MemoryArgument> argMemoryLimit(
                 "m",
                 "memory-limit",
@@ -222,6 +358,30 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
                 "string",
                 cmd);
 
+        args::ImplementationNameArgument<MemoryAccountingHolder>
+                memoryAccountingMode(
+                        "memory accounting mode",
+                        DEFAULT_MEMORY_ACCOUNTING_MODE,
+                        MEMORY_ACCOUNTING_MODES);
+        TCLAP::ValueArg<decltype(memoryAccountingMode)> argMemoryAccounting(
+                "",
+                "memory-accounting",
+                "How memory usage is measured: address space size polled from "
+                "procfs or resident memory charged to a cgroup",
+                false,
+                memoryAccountingMode,
+                &memoryAccountingMode,
+                cmd);
+
+        TCLAP::ValueArg<std::string> argCgroupPath(
+                "",
+                "cgroup-path",
+                "Delegated cgroup v2 directory to create per-run cgroups in",
+                false,
+                "",
+                "dir",
+                cmd);
+
         TCLAP::ValueArg<args::MemoryArgument> argOutputLimit(
                 "",
                 "output-limit",
@@ -244,6 +404,47 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
                 "fd",
                 cmd);
 
+        TCLAP::ValueArg<std::string> argStdinPath(
+                "",
+                "stdin",
+                "File to redirect stdin of the program from",
+                false,
+                "",
+                "path",
+                cmd);
+        TCLAP::ValueArg<std::string> argStdoutPath(
+                "",
+                "stdout",
+                "File to redirect stdout of the program to",
+                false,
+                "",
+                "path",
+                cmd);
+
+        // Serve mode arguments are xor'ed with program path below
+        TCLAP::SwitchArg argServe(
+                "",
+                "serve",
+                "Run many programs in one sio2jail process, reading job "
+                "descriptions (lines of sio2jail arguments) from --serve-fd",
+                false);
+        TCLAP::ValueArg<std::string> argServeSocket(
+                "",
+                "serve-socket",
+                "Run in serve mode, accepting connections on unix socket at "
+                "given path. Results are written back to the connection",
+                false,
+                "",
+                "path");
+        TCLAP::ValueArg<int> argServeFD(
+                "",
+                "serve-fd",
+                "File descriptor to read job descriptions from in serve mode",
+                false,
+                0 /* stdin */,
+                "fd",
+                cmd);
+
         TCLAP::ValueArg<args::AmountArgument> argInstructionCountLimit(
                 "",
                 "instruction-count-limit",
@@ -254,6 +455,29 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
                 "amount specifier",
                 cmd);
 
+        TCLAP::ValueArg<args::AmountArgument> argThreadInstructionCountLimit(
+                "",
+                "thread-instruction-count-limit",
+                "Instruction count limit of every single thread. Use with "
+                "k,m,g sufixes for 10**{3,6,9} respectively. Use 0 for no "
+                "limit",
+                false,
+                args::AmountArgument(),
+                "amount specifier",
+                cmd);
+
+        TCLAP::ValueArg<args::TimeArgument> argInstructionTimeLimit(
+                "",
+                "instruction-time-limit",
+                "Instruction count limit given as time, converted with "
+                "host's speed from --calibration-profile. Use with "
+                "u,ms,s,m,h,d sufixes (case-insensitive). Defaults to "
+                "microseconds. Use 0 for no limit",
+                false,
+                args::TimeArgument(),
+                "time limit",
+                cmd);
+
         TCLAP::ValueArg<args::TimeArgument> argRtimelimit(
                 "",
                 "rtimelimit",
@@ -305,6 +529,46 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
                 "time limit",
                 cmd);
 
+        TCLAP::ValueArg<args::TimeArgument> argTimerMinInterval(
+                "",
+                "timer-min-interval",
+                "Minimal interval between process time limit checks. Use "
+                "with u,ms,s,m,h,d sufixes (case-insensitive). Defaults to "
+                "microseconds",
+                false,
+                args::TimeArgument(
+                        limits::TimeLimitListener::DEFAULT_TIMER_MIN_INTERVAL_US),
+                "interval",
+                cmd);
+
+        TCLAP::ValueArg<args::TimeArgument> argTimerMaxInterval(
+                "",
+                "timer-max-interval",
+                "Maximal interval between process time limit checks. Use "
+                "with u,ms,s,m,h,d sufixes (case-insensitive). Defaults to "
+                "microseconds",
+                false,
+                args::TimeArgument(
+                        limits::TimeLimitListener::DEFAULT_TIMER_MAX_INTERVAL_US),
+                "interval",
+                cmd);
+
+        args::ImplementationNameArgument<TimeAccountingHolder>
+                timeAccountingMode(
+                        "time accounting mode",
+                        DEFAULT_TIME_ACCOUNTING_MODE,
+                        TIME_ACCOUNTING_MODES);
+        TCLAP::ValueArg<decltype(timeAccountingMode)> argTimeAccounting(
+                "",
+                "time-accounting",
+                "How user and system time is measured: clock ticks of the "
+                "main process read from procfs or microseconds of all "
+                "processes and threads read from cgroup's cpu.stat",
+                false,
+                timeAccountingMode,
+                &timeAccountingMode,
+                cmd);
+
         TCLAP::MultiArg<std::string> argBindMounts(
                 "b",
                 "bind",
@@ -358,6 +622,87 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
                 "factor",
                 cmd);
 
+        TCLAP::SwitchArg argPerfExactLimits(
+                "",
+                "perf-exact-limits",
+                "Re-arm instruction counters with remaining budget after "
+                "every wakeup, instead of oversampling instruction count "
+                "limits",
+                cmd,
+                false);
+
+        TCLAP::ValueArg<std::string> argPerfEvents(
+                "",
+                "perf-events",
+                "Comma separated list of additional perf events to count",
+                false,
+                "",
+                "events",
+                cmd);
+
+        args::ImplementationNameArgument<SyscallStatsHolder>
+                syscallStatsModeName(
+                        "syscall statistics",
+                        DEFAULT_SYSCALL_STATS_MODE,
+                        SYSCALL_STATS_MODES);
+        TCLAP::ValueArg<decltype(syscallStatsModeName)> argSyscallStats(
+                "",
+                "syscall-stats",
+                "Syscall statistics to report: off, count of all syscalls, "
+                "or histogram with counts of each syscall",
+                false,
+                syscallStatsModeName,
+                &syscallStatsModeName,
+                cmd);
+
+        TCLAP::ValueArg<size_t> argPerfProfile(
+                "",
+                "perf-profile",
+                "Sample instruction pointer and report given number of most "
+                "frequent functions of the program, use 0 to disable",
+                false,
+                0,
+                "entries",
+                cmd);
+
+        TCLAP::ValueArg<args::AmountArgument> argPerfProfilePeriod(
+                "",
+                "perf-profile-period",
+                "Number of instructions between profile samples. Use with "
+                "k,m,g sufixes for 10**{3,6,9} respectively",
+                false,
+                args::AmountArgument(
+                        perf::PerfListener::DEFAULT_PROFILE_PERIOD),
+                "amount specifier",
+                cmd);
+
+        TCLAP::ValueArg<std::string> argPerfCacheDirectory(
+                "",
+                "perf-cache-dir",
+                "Directory to cache discovered perf events in",
+                false,
+                "",
+                "dir",
+                cmd);
+
+        TCLAP::ValueArg<std::string> argCalibrationProfile(
+                "",
+                "calibration-profile",
+                "Host's calibration profile, used to convert instruction "
+                "counts to time. Written to by --calibrate",
+                false,
+                "",
+                "path",
+                cmd);
+
+        // Also xor'ed with program path below
+        TCLAP::SwitchArg argCalibrate(
+                "",
+                "calibrate",
+                "Measure speed of this host by running reference programs "
+                "and print calibration profile, or store it at "
+                "--calibration-profile",
+                false);
 
         args::ImplementationNameArgument<TimeModeHolder> fakeTimeMode(
                 "fake time mode", DEFAULT_FAKE_TIME_MODE, FAKE_TIME_MODES);
@@ -371,7 +716,10 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
                 cmd);
 
         TCLAP::UnlabeledValueArg<std::string> argProgramName(
-                "path", "Name of program to run", true, "", "path", cmd);
+                "path", "Name of program to run", true, "", "path");
+        std::vector<TCLAP::Arg*> argsProgramOrServe{
+                &argProgramName, &argServe, &argServeSocket, &argCalibrate};
+        cmd.xorAdd(argsProgramOrServe);
         TCLAP::UnlabeledMultiArg<std::string> argProgramArgv(
                 "argv", "Arguments of supervised program", false, "argv", cmd);
 
@@ -394,7 +742,15 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
             action = Action::PRINT_VERSION;
         }
         else if (!outputGenerator.hasFailure()) {
-            action = Action::RUN;
+            if (argServe.isSet() || argServeSocket.isSet()) {
+                action = Action::SERVE;
+            }
+            else if (argCalibrate.isSet()) {
+                action = Action::CALIBRATE;
+            }
+            else {
+                action = Action::RUN;
+            }
         }
 
 
@@ -405,9 +761,23 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
         programName = argProgramName.getValue();
         programArgv = argProgramArgv.getValue();
         programWorkingDir = argProgramWorkingDir.getValue();
+        stdinPath = argStdinPath.getValue();
+        stdoutPath = argStdoutPath.getValue();
+
+        serveFD = argServeFD.getValue();
+        serveSocketPath = argServeSocket.getValue();
 
         outputBuilderFactory = argOutputFormat.getValue().getFactory();
         syscallPolicyFactory = argSyscallPolicy.getValue().getFactory();
+        seccompCacheDirectory = argSeccompCacheDirectory.getValue();
+        seccompCompiler =
+                argSeccompCompiler.getValue().getFactory()()->compiler;
+        seccompProfilePath = argSeccompProfile.getValue();
+        syscallStats = argSyscallStats.getValue().getFactory()()->mode;
+        seccompProfileRecordPath = argSeccompProfileRecord.getValue();
+        perfCacheDirectory = argPerfCacheDirectory.getValue();
+        calibrationProfilePath = argCalibrationProfile.getValue();
+        cgroupPath = argCgroupPath.getValue();
 
         loggerPath = argLoggerPath.getValue();
 
@@ -446,21 +816,189 @@ ApplicationSettings::ApplicationSettings(int argc, const char* argv[])
                     "enabled");
         }
 
+        if (argInstructionTimeLimit.isSet()) {
+            if (features.count(Feature::PERF) == 0U) {
+                throw InvalidConfigurationException(
+                        "Instruction time limit can only be used if PERF is "
+                        "enabled");
+            }
+            if (argInstructionCountLimit.isSet()) {
+                throw InvalidConfigurationException(
+                        "Instruction count and time limits can't be used "
+                        "together");
+            }
+        }
+
+        // Profile is written, not read when calibrating
+        if (!calibrationProfilePath.empty() && action == Action::RUN) {
+            instructionsPerSecond =
+                    perf::CalibrationProfile::load(calibrationProfilePath)
+                            .instructionsPerSecond;
+        }
+
+        if (argThreadInstructionCountLimit.isSet() &&
+            (features.count(Feature::PERF) == 0U ||
+             features.count(Feature::PTRACE) == 0U ||
+             features.count(Feature::SECCOMP) == 0U)) {
+            throw InvalidConfigurationException(
+                    "Thread instruction count limit can only be used if "
+                    "PERF, PTRACE and SECCOMP are enabled");
+        }
+
+        if (!argPerfEvents.getValue().empty()) {
+            if (features.count(Feature::PERF) == 0U) {
+                throw InvalidConfigurationException(
+                        "Perf events can only be used if PERF is enabled");
+            }
+            for (const auto& event: split(argPerfEvents.getValue(), ",")) {
+                if (perf::PerfListener::EVENTS.count(event) == 0) {
+                    throw InvalidConfigurationException(
+                            "No such perf event: " + event);
+                }
+                if (std::find(perfEvents.begin(), perfEvents.end(), event) !=
+                    perfEvents.end()) {
+                    throw InvalidConfigurationException(
+                            "Duplicated perf event: " + event);
+                }
+                perfEvents.push_back(event);
+            }
+        }
+
+        if (argPerfExactLimits.getValue() &&
+            features.count(Feature::PERF) == 0U) {
+            throw InvalidConfigurationException(
+                    "Exact instruction limits can only be used if PERF is "
+                    "enabled");
+        }
+
+        if (argPerfProfile.getValue() > 0 &&
+            (features.count(Feature::PERF) == 0U ||
+             features.count(Feature::PTRACE) == 0U ||
+             features.count(Feature::SECCOMP) == 0U)) {
+            throw InvalidConfigurationException(
+                    "Perf profile can only be used if PERF, PTRACE and "
+                    "SECCOMP are enabled");
+        }
+        if (!argSeccompProfileRecord.getValue().empty() &&
+            (features.count(Feature::PERF) == 0U ||
+             features.count(Feature::PTRACE) == 0U ||
+             features.count(Feature::SECCOMP) == 0U)) {
+            throw InvalidConfigurationException(
+                    "Syscall profile can only be recorded if PERF, PTRACE and "
+                    "SECCOMP are enabled");
+        }
+        if (syscallStats == SyscallStats::COUNT &&
+            features.count(Feature::PERF) == 0U) {
+            throw InvalidConfigurationException(
+                    "Syscall count can only be used if PERF is enabled");
+        }
+        if (syscallStats == SyscallStats::HISTOGRAM &&
+            (features.count(Feature::PERF) == 0U ||
+             features.count(Feature::PTRACE) == 0U ||
+             features.count(Feature::SECCOMP) == 0U)) {
+            throw InvalidConfigurationException(
+                    "Syscall histogram can only be used if PERF, PTRACE and "
+                    "SECCOMP are enabled");
+        }
+        if (!argSeccompProfile.getValue().empty() &&
+            features.count(Feature::SECCOMP) == 0U) {
+            throw InvalidConfigurationException(
+                    "Syscall profile can only be used if SECCOMP is enabled");
+        }
+        if (argPerfProfilePeriod.getValue() == 0) {
+            throw InvalidConfigurationException(
+                    "Perf profile period must be positive");
+        }
+
+        if (features.count(Feature::SECCOMP_NOTIFY) > 0 &&
+            features.count(Feature::SECCOMP) == 0) {
+            throw InvalidConfigurationException(
+                    "Seccomp user notifications can only be used if SECCOMP "
+                    "is enabled");
+        }
+
+        memoryAccounting =
+                argMemoryAccounting.getValue().getFactory()()->mode;
+        timeAccounting = argTimeAccounting.getValue().getFactory()()->mode;
+        if ((memoryAccounting == MemoryAccounting::CGROUP ||
+             timeAccounting == TimeAccounting::CGROUP) &&
+            cgroupPath.empty()) {
+            throw InvalidConfigurationException(
+                    "Cgroup accounting requires --cgroup-path");
+        }
+
         instructionCountLimit = argInstructionCountLimit.getValue();
+        if (argInstructionTimeLimit.isSet()) {
+            uint64_t speed = instructionsPerSecond != 0
+                    ? instructionsPerSecond
+                    : printer::OIModelOutputBuilder::CYCLES_PER_SECOND;
+            instructionCountLimit = static_cast<uint64_t>(
+                    static_cast<long double>(
+                            argInstructionTimeLimit.getValue()) *
+                    speed / 1'000'000);
+        }
+        threadInstructionCountLimit =
+                argThreadInstructionCountLimit.getValue();
         rTimelimitUs = argRtimelimit.getValue();
         uTimelimitUs = argUtimelimit.getValue();
         sTimelimitUs = argStimelimit.getValue();
         usTimelimitUs = argUStimelimit.getValue();
+        timerMinIntervalUs = argTimerMinInterval.getValue();
+        timerMaxIntervalUs = argTimerMaxInterval.getValue();
+        if (timerMinIntervalUs == 0) {
+            throw InvalidConfigurationException(
+                    "Timer min interval must be positive");
+        }
+        if (timerMinIntervalUs > timerMaxIntervalUs) {
+            // A default bound gives way to an explicit one
+            if (!argTimerMinInterval.isSet()) {
+                timerMinIntervalUs = timerMaxIntervalUs;
+            }
+            else if (!argTimerMaxInterval.isSet()) {
+                timerMaxIntervalUs = timerMinIntervalUs;
+            }
+            else {
+                throw InvalidConfigurationException(
+                        "Timer intervals must satisfy min <= max");
+            }
+        }
 
         suppressStderr = !argShowStderr.getValue();
         resultsFD = argResultsFD.getValue();
         threadsLimit = argThreadsLimit.getValue();
         perfOversamplingFactor = argPerfOversamplingFactor.getValue();
+        perfExactLimits = argPerfExactLimits.getValue();
+        perfProfileEntries = argPerfProfile.getValue();
+        perfProfilePeriod = argPerfProfilePeriod.getValue();
 
         timeMode = argFakeTime.getValue().getFactory()()->mode;
         if (timeMode != TimeMode::OFF) {
             features.insert(Feature::FAKE_TIME);
         }
+
+        if (!argPolicyFile.getValue().empty()) {
+            if (features.count(Feature::SECCOMP) == 0U) {
+                throw InvalidConfigurationException(
+                        "Policy file can only be used if SECCOMP is enabled");
+            }
+            if (timeMode != TimeMode::OFF) {
+                throw InvalidConfigurationException(
+                        "Policy file can't be used with fake time");
+            }
+
+            // Policy is loaded for each run, as its trace actions keep state
+            std::string policyPath = argPolicyFile.getValue();
+            try {
+                seccomp::policy::FilePolicy{policyPath};
+            }
+            catch (const Exception& ex) {
+                throw InvalidConfigurationException(ex.what());
+            }
+            syscallPolicyFactory = [policyPath]() {
+                return std::make_shared<seccomp::policy::FilePolicy>(
+                        policyPath);
+            };
+        }
     }
     catch (const TCLAP::ArgException& ex) {
         outputGenerator.failure(ex);
@@ -17,11 +17,27 @@ namespace s2j {
 namespace app {
 
 struct ApplicationSettings : public ns::MountNamespaceListener::Settings {
-    enum class Action { PRINT_HELP, PRINT_VERSION, RUN };
+    enum class Action { PRINT_HELP, PRINT_VERSION, RUN, SERVE, CALIBRATE };
     enum class TimeMode { OFF, RANDOM, ZERO };
     struct TimeModeHolder {
         TimeMode mode;
     };
+    enum class MemoryAccounting { ADDRESS_SPACE, CGROUP };
+    struct MemoryAccountingHolder {
+        MemoryAccounting mode;
+    };
+    enum class TimeAccounting { PROCFS, CGROUP };
+    struct TimeAccountingHolder {
+        TimeAccounting mode;
+    };
+    enum class SeccompCompiler { BUILTIN, LIBSECCOMP };
+    struct SeccompCompilerHolder {
+        SeccompCompiler compiler;
+    };
+    enum class SyscallStats { OFF, COUNT, HISTOGRAM };
+    struct SyscallStatsHolder {
+        SyscallStats mode;
+    };
 
     ApplicationSettings();
     ApplicationSettings(int argc, const char* argv[]);
@@ -35,6 +51,14 @@ struct ApplicationSettings : public ns::MountNamespaceListener::Settings {
     static const std::string DEFAULT_SYSCALL_POLICY;
     static const FactoryMap<TimeModeHolder> FAKE_TIME_MODES;
     static const std::string DEFAULT_FAKE_TIME_MODE;
+    static const FactoryMap<MemoryAccountingHolder> MEMORY_ACCOUNTING_MODES;
+    static const std::string DEFAULT_MEMORY_ACCOUNTING_MODE;
+    static const FactoryMap<TimeAccountingHolder> TIME_ACCOUNTING_MODES;
+    static const std::string DEFAULT_TIME_ACCOUNTING_MODE;
+    static const FactoryMap<SeccompCompilerHolder> SECCOMP_COMPILERS;
+    static const std::string DEFAULT_SECCOMP_COMPILER;
+    static const FactoryMap<SyscallStatsHolder> SYSCALL_STATS_MODES;
+    static const std::string DEFAULT_SYSCALL_STATS_MODE;
     static const std::map<std::string, std::pair<Feature, bool>>
             FEATURE_BY_NAME;
 
@@ -44,15 +68,25 @@ struct ApplicationSettings : public ns::MountNamespaceListener::Settings {
     uint64_t memoryLimitKb{};
     uint64_t outputLimitB{};
     uint64_t instructionCountLimit{};
+    uint64_t threadInstructionCountLimit{};
+    // Host's speed from calibration profile, 0 when not given
+    uint64_t instructionsPerSecond{};
     // [us] - microseconds, 10^(-6) s
     uint64_t rTimelimitUs{};
     uint64_t uTimelimitUs{};
     uint64_t sTimelimitUs{};
     uint64_t usTimelimitUs{};
+    uint64_t timerMinIntervalUs{};
+    uint64_t timerMaxIntervalUs{};
 
     int resultsFD{};
+    int serveFD{};
     int threadsLimit{};
     uint32_t perfOversamplingFactor{};
+    bool perfExactLimits{};
+    // Number of reported profile entries, 0 when profiling is off
+    size_t perfProfileEntries{};
+    uint64_t perfProfilePeriod{};
 
     std::string parsingError;
     std::string helpMessage;
@@ -61,12 +95,27 @@ struct ApplicationSettings : public ns::MountNamespaceListener::Settings {
     std::string programName;
     std::vector<std::string> programArgv;
     std::string programWorkingDir;
+    std::string stdinPath;
+    std::string stdoutPath;
+
+    std::string serveSocketPath;
+    std::string seccompCacheDirectory;
+    std::string seccompProfilePath;
+    std::string seccompProfileRecordPath;
+    std::string perfCacheDirectory;
+    std::string calibrationProfilePath;
+    std::string cgroupPath;
 
     Factory<s2j::printer::OutputBuilder> outputBuilderFactory;
     Factory<s2j::seccomp::policy::BaseSyscallPolicy> syscallPolicyFactory;
     std::set<Feature> features;
+    std::vector<std::string> perfEvents;
 
     TimeMode timeMode{TimeMode::OFF};
+    MemoryAccounting memoryAccounting{MemoryAccounting::ADDRESS_SPACE};
+    TimeAccounting timeAccounting{TimeAccounting::PROCFS};
+    SeccompCompiler seccompCompiler{SeccompCompiler::LIBSECCOMP};
+    SyscallStats syscallStats{SyscallStats::OFF};
     bool suppressStderr{};
 
 private:
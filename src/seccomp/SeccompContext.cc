@@ -1,10 +1,36 @@
 #include "SeccompContext.h"
 #include "SeccompException.h"
+#include "bpf/Compiler.h"
+#include "bpf/Disassembler.h"
+#include "bpf/Verifier.h"
 
 #include "common/FD.h"
+#include "common/Utils.h"
+#include "common/Version.h"
+#include "common/WithErrnoCheck.h"
+#include "logger/Logger.h"
+
+#include <fcntl.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+#ifndef SECCOMP_RET_USER_NOTIF
+#define SECCOMP_RET_USER_NOTIF 0x7fc00000U
+#endif
+
+#ifndef SECCOMP_FILTER_FLAG_NEW_LISTENER
+#define SECCOMP_FILTER_FLAG_NEW_LISTENER (1UL << 3)
+#endif
 
 namespace s2j {
 namespace seccomp {
@@ -16,29 +42,76 @@ const std::map<tracer::Arch, uint32_t>
 
 const uint32_t SeccompContext::SECCOMP_TRACE_MSG_NUM_SHIFT = 3;
 
-SeccompContext::Builder::Builder() {
-    for (const auto arch: SECCOMP_FILTER_ARCHITECTURES) {
-        scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_TRACE(0));
-        if (ctx == nullptr) {
-            throw Exception("Can't create a seccomp context");
-        }
-        if (seccomp_arch_remove(ctx, SCMP_ARCH_NATIVE) < 0) {
-            throw Exception("Can't remove native architecture");
-        }
-        if (seccomp_arch_add(ctx, arch.second) < 0) {
-            throw Exception("Can't add architecture to seccomp context");
+const uint32_t SeccompContext::CACHE_FORMAT_VERSION = 1;
+
+uint64_t SeccompContext::cacheHits_ = 0;
+uint64_t SeccompContext::cacheMisses_ = 0;
+
+namespace {
+
+const uint32_t DEFAULT_ACTION = SCMP_ACT_TRACE(0);
+
+// Libseccomp's default action for syscalls of architectures not in filter
+const uint32_t BAD_ARCH_ACTION = SCMP_ACT_KILL;
+
+/**
+ * Libseccomp resolves names of syscalls multiplexed on x86 by socketcall and
+ * ipc to pseudo numbers, counted down from these bases by call number passed
+ * to the multiplexer as its first argument.
+ */
+struct Multiplexer {
+    int base;
+    int last;
+    const char* name;
+};
+
+const std::vector<Multiplexer> MULTIPLEXERS{
+        {-100, -120, "socketcall"},
+        {-200, -224, "ipc"}};
+
+const int MAX_SYSCALL_NUMBER = 1024;
+
+// Libseccomp's priorities are hints from 0 to 255
+const uint8_t MAX_SYSCALL_PRIORITY = 255;
+
+// Syscall numbers by name
+using SyscallNumbers = std::map<std::string, int>;
+
+/**
+ * Maps names of all syscalls of given architecture to their own numbers,
+ * including multiplexed ones that got separate syscalls in newer kernels.
+ */
+SyscallNumbers resolveSyscallNumbers(uint32_t arch) {
+    SyscallNumbers numbers;
+    for (int syscall = 0; syscall < MAX_SYSCALL_NUMBER; ++syscall) {
+        char* name = seccomp_syscall_resolve_num_arch(arch, syscall);
+        if (name != nullptr) {
+            numbers.emplace(name, syscall);
+            free(name);
         }
-        ctx_.emplace(arch.first, ctx);
     }
+    return numbers;
 }
 
-SeccompContext::Builder::~Builder() {
-    std::for_each(ctx_.begin(), ctx_.end(), [](auto ctx) {
-        seccomp_release(ctx.second);
-    });
-    ctx_.clear();
+/**
+ * Whether file could be written only by us, so that a filter loaded from it
+ * is the one we stored.
+ */
+bool isWritableOnlyByUs(const struct stat& fileStat) {
+    return fileStat.st_uid == geteuid() &&
+            (fileStat.st_mode & (S_IWGRP | S_IWOTH)) == 0;
 }
 
+} // namespace
+
+SeccompContext::Builder::Builder(
+        std::string cacheDirectory,
+        bool userNotification,
+        Compiler compiler)
+        : cacheDirectory_(std::move(cacheDirectory))
+        , userNotification_(userNotification)
+        , compiler_(compiler) {}
+
 SeccompContext SeccompContext::Builder::build() && {
     TRACE();
 
@@ -66,8 +139,6 @@ void SeccompContext::Builder::addRule(
             action = SCMP_ACT_TRACE(ruleId);
         }
 
-        int res;
-
         /**
          * XXX
          * Libseccomp seems to optimize cases when there is an action without
@@ -76,53 +147,157 @@ void SeccompContext::Builder::addRule(
          * filter condition.
          */
         if (!filter.empty()) {
-            res = seccomp_rule_add_array(
-                    ctx_[arch.first],
-                    action,
-                    rule.syscall,
-                    filter.size(),
-                    &filter[0]);
+            rules_.push_back({arch.first, action, rule.syscall, filter});
         }
         else {
-            res = seccomp_rule_add(
-                    ctx_[arch.first],
-                    action,
-                    rule.syscall,
-                    1,
-                    SCMP_CMP(0, SCMP_CMP_GE, 0));
-            if (res > 0) {
-                res = seccomp_rule_add(
-                        ctx_[arch.first],
-                        action,
-                        rule.syscall,
-                        1,
-                        SCMP_CMP(0, SCMP_CMP_LT, 0));
-            }
+            rules_.push_back({arch.first,
+                              action,
+                              rule.syscall,
+                              {SCMP_CMP(0, SCMP_CMP_GE, 0)}});
+        }
+    }
+}
+
+void SeccompContext::Builder::setSyscallProfile(SyscallProfile profile) {
+    TRACE(profile.counts.size());
+
+    syscallProfile_ = std::move(profile);
+}
+
+std::string SeccompContext::Builder::getCacheKey() const {
+    // FNV-1a, fed with every value passed to libseccomp and versions of
+    // code turning them into a program
+    uint64_t hash = 14695981039346656037ULL;
+    auto update = [&hash](auto value) {
+        for (size_t index = 0; index < sizeof(value); ++index) {
+            hash ^= reinterpret_cast<const uint8_t*>(&value)[index];
+            hash *= 1099511628211ULL;
         }
-        if (res < 0) {
-            throw SystemException("Can't add rule to seccomp filter", -res);
+    };
+
+    update(CACHE_FORMAT_VERSION);
+    for (const char* character = VERSION; *character != '\0'; ++character) {
+        update(*character);
+    }
+    const struct scmp_version* version = seccomp_version();
+    update(version->major);
+    update(version->minor);
+    update(version->micro);
+    update(DEFAULT_ACTION);
+    update(BAD_ARCH_ACTION);
+    update(userNotification_);
+    update(compiler_);
+    for (const auto& arch: SECCOMP_FILTER_ARCHITECTURES) {
+        update(arch.first);
+        update(arch.second);
+    }
+
+    for (const auto& rule: rules_) {
+        update(rule.arch);
+        update(rule.action);
+        update(rule.syscall);
+        update(rule.filter.size());
+        for (const auto& condition: rule.filter) {
+            update(condition.arg);
+            update(condition.op);
+            update(condition.datum_a);
+            update(condition.datum_b);
         }
     }
+
+    for (const auto& syscall: syscallProfile_.counts) {
+        update(syscall.first.size());
+        for (char character: syscall.first) {
+            update(character);
+        }
+        update(syscall.second);
+    }
+
+    std::stringstream key;
+    key << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return key.str();
 }
 
-SeccompContext::SeccompContext(Builder&& builder) {
-    if (builder.ctx_.empty()) {
-        ctx_ = seccomp_init(SCMP_ACT_KILL);
-        if (ctx_ == nullptr) {
-            throw Exception("Can't create a seccomp context");
+SeccompContext::SeccompContext(Builder&& builder)
+        : userNotification_(builder.userNotification_) {
+    bool useCache = !builder.cacheDirectory_.empty();
+    if (useCache) {
+        struct stat cacheDirectoryStat {};
+        auto statResult = withErrnoCheck(
+                "stat seccomp cache directory",
+                {ENOENT},
+                stat,
+                builder.cacheDirectory_.c_str(),
+                &cacheDirectoryStat);
+        if (statResult.getErrnoCode() == ENOENT) {
+            logger::warn(
+                    "Seccomp cache directory ",
+                    builder.cacheDirectory_,
+                    " doesn't exist");
+            useCache = false;
+        }
+        else if (!isWritableOnlyByUs(cacheDirectoryStat)) {
+            logger::warn(
+                    "Ignoring seccomp cache directory ",
+                    builder.cacheDirectory_,
+                    " writable by other users");
+            useCache = false;
         }
     }
-    else {
-        ctx_ = builder.ctx_.begin()->second;
-        builder.ctx_.erase(builder.ctx_.begin());
 
-        for (auto it = builder.ctx_.begin(); it != builder.ctx_.end();
-             it = builder.ctx_.erase(it)) {
-            if (seccomp_merge(ctx_, it->second) < 0) {
-                throw Exception("Can't merge libseccomp filters");
+    if (!useCache) {
+        compile(builder);
+        if (userNotification_) {
+            if (ctx_ != nullptr) {
+                exportProgram();
             }
+            convertTraceToNotify();
+        }
+        return;
+    }
+
+    std::string cachePath =
+            builder.cacheDirectory_ + "/" + builder.getCacheKey() + ".bpf";
+    if (loadFromCache(cachePath)) {
+        ++cacheHits_;
+        logger::debug(
+                "Seccomp filter cache hit ",
+                cachePath,
+                " (hits: ",
+                cacheHits_,
+                ", misses: ",
+                cacheMisses_,
+                ")");
+        return;
+    }
+
+    ++cacheMisses_;
+    logger::debug(
+            "Seccomp filter cache miss ",
+            cachePath,
+            " (hits: ",
+            cacheHits_,
+            ", misses: ",
+            cacheMisses_,
+            ")");
+    compile(builder);
+    try {
+        if (ctx_ != nullptr) {
+            exportProgram();
+        }
+    }
+    catch (const Exception& ex) {
+        if (userNotification_) {
+            throw;
         }
+        logger::warn("Can't export seccomp filter: ", ex.what());
+        program_.clear();
+        return;
     }
+    if (userNotification_) {
+        convertTraceToNotify();
+    }
+    storeInCache(cachePath);
 }
 
 SeccompContext::~SeccompContext() {
@@ -132,15 +307,365 @@ SeccompContext::~SeccompContext() {
     }
 }
 
+void SeccompContext::compile(const Builder& builder) {
+    if (builder.compiler_ == Compiler::LIBSECCOMP) {
+        compileLibSeccomp(builder);
+    }
+    else {
+        compileBuiltin(builder);
+    }
+}
+
+void SeccompContext::compileBuiltin(const Builder& builder) {
+    TRACE();
+
+    bpf::Compiler compiler;
+    for (const auto& arch: SECCOMP_FILTER_ARCHITECTURES) {
+        compiler.addArchitecture(
+                arch.second, SCMP_ACT_TRACE(static_cast<uint8_t>(arch.first)));
+    }
+
+    std::map<uint32_t, SyscallNumbers> syscallNumbers;
+    auto getSyscallNumbers =
+            [&syscallNumbers](uint32_t arch) -> const SyscallNumbers& {
+        if (syscallNumbers.find(arch) == syscallNumbers.end()) {
+            syscallNumbers.emplace(arch, resolveSyscallNumbers(arch));
+        }
+        return syscallNumbers.at(arch);
+    };
+
+    for (const auto& rule: builder.rules_) {
+        // Rules have native syscall numbers, libseccomp translates them to
+        // other architectures by name.
+        uint32_t arch = SECCOMP_FILTER_ARCHITECTURES.at(rule.arch);
+        char* resolvedName = seccomp_syscall_resolve_num_arch(
+                SCMP_ARCH_NATIVE, rule.syscall);
+        if (resolvedName == nullptr) {
+            throw Exception(
+                    "Can't resolve the name of syscall number " +
+                    std::to_string(rule.syscall));
+        }
+        std::string name(resolvedName);
+        free(resolvedName);
+
+        int syscall = seccomp_syscall_resolve_name_arch(arch, name.c_str());
+        if (syscall >= 0) {
+            compiler.addRule(arch, syscall, rule.action, rule.filter);
+            continue;
+        }
+
+        auto multiplexer = std::find_if(
+                MULTIPLEXERS.begin(),
+                MULTIPLEXERS.end(),
+                [syscall](const Multiplexer& multiplexer) {
+                    return syscall < multiplexer.base &&
+                           syscall >= multiplexer.last;
+                });
+        if (multiplexer == MULTIPLEXERS.end()) {
+            // Architecture doesn't have this syscall
+            logger::debug(
+                    "Skipping seccomp rule for ",
+                    name,
+                    " on ",
+                    to_string(rule.arch));
+            continue;
+        }
+
+        // As libseccomp does, match both the syscall itself and its call
+        // through multiplexer, with first argument replaced by call number.
+        const auto& numbers = getSyscallNumbers(arch);
+        auto direct = numbers.find(name);
+        if (direct != numbers.end()) {
+            compiler.addRule(arch, direct->second, rule.action, rule.filter);
+        }
+
+        uint64_t call = multiplexer->base - syscall;
+        std::vector<struct scmp_arg_cmp> conditions{
+                SCMP_CMP(0, SCMP_CMP_EQ, call)};
+        std::copy_if(
+                rule.filter.begin(),
+                rule.filter.end(),
+                std::back_inserter(conditions),
+                [](const struct scmp_arg_cmp& condition) {
+                    return condition.arg != 0;
+                });
+        compiler.addRule(
+                arch,
+                seccomp_syscall_resolve_name_arch(arch, multiplexer->name),
+                rule.action,
+                conditions);
+    }
+
+    // Multiplexed syscalls are weighted by their own numbers, calls of
+    // multiplexers are profiled as such.
+    for (const auto& arch: SECCOMP_FILTER_ARCHITECTURES) {
+        for (const auto& syscall: builder.syscallProfile_.counts) {
+            int number = seccomp_syscall_resolve_name_arch(
+                    arch.second, syscall.first.c_str());
+            if (number < 0) {
+                const auto& numbers = getSyscallNumbers(arch.second);
+                auto direct = numbers.find(syscall.first);
+                if (direct == numbers.end()) {
+                    continue;
+                }
+                number = direct->second;
+            }
+            compiler.addWeight(arch.second, number, syscall.second);
+        }
+    }
+
+    program_ = compiler.compile(BAD_ARCH_ACTION);
+    bpf::verify(program_);
+}
+
+void SeccompContext::compileLibSeccomp(const Builder& builder) {
+    TRACE();
+
+    std::map<tracer::Arch, scmp_filter_ctx> contexts;
+    try {
+        for (const auto arch: SECCOMP_FILTER_ARCHITECTURES) {
+            scmp_filter_ctx ctx = seccomp_init(DEFAULT_ACTION);
+            if (ctx == nullptr) {
+                throw Exception("Can't create a seccomp context");
+            }
+            contexts.emplace(arch.first, ctx);
+            if (seccomp_arch_remove(ctx, SCMP_ARCH_NATIVE) < 0) {
+                throw Exception("Can't remove native architecture");
+            }
+            if (seccomp_arch_add(ctx, arch.second) < 0) {
+                throw Exception("Can't add architecture to seccomp context");
+            }
+        }
+
+        for (const auto& rule: builder.rules_) {
+            int res = seccomp_rule_add_array(
+                    contexts[rule.arch],
+                    rule.action,
+                    rule.syscall,
+                    rule.filter.size(),
+                    rule.filter.data());
+            if (res < 0) {
+                throw SystemException("Can't add rule to seccomp filter", -res);
+            }
+        }
+
+        // Libseccomp puts syscalls with higher priority first, ones without
+        // priority after all of them.
+        std::vector<std::pair<std::string, uint64_t>> profile(
+                builder.syscallProfile_.counts.begin(),
+                builder.syscallProfile_.counts.end());
+        std::stable_sort(
+                profile.begin(),
+                profile.end(),
+                [](const std::pair<std::string, uint64_t>& lhs,
+                   const std::pair<std::string, uint64_t>& rhs) {
+                    return lhs.second > rhs.second;
+                });
+        for (size_t rank = 0;
+             rank < profile.size() && rank < MAX_SYSCALL_PRIORITY;
+             ++rank) {
+            int syscall =
+                    seccomp_syscall_resolve_name(profile[rank].first.c_str());
+            if (syscall == __NR_SCMP_ERROR) {
+                continue;
+            }
+            for (const auto& ctx: contexts) {
+                int res = seccomp_syscall_priority(
+                        ctx.second, syscall, MAX_SYSCALL_PRIORITY - rank);
+                if (res < 0) {
+                    logger::debug(
+                            "Can't set priority of ",
+                            profile[rank].first,
+                            " on ",
+                            to_string(ctx.first));
+                }
+            }
+        }
+
+        // Merged contexts are released by libseccomp
+        ctx_ = contexts.begin()->second;
+        contexts.erase(contexts.begin());
+        for (auto it = contexts.begin(); it != contexts.end();
+             it = contexts.erase(it)) {
+            if (seccomp_merge(ctx_, it->second) < 0) {
+                throw Exception("Can't merge libseccomp filters");
+            }
+        }
+    }
+    catch (...) {
+        for (auto& ctx: contexts) {
+            seccomp_release(ctx.second);
+        }
+        if (ctx_ != nullptr) {
+            seccomp_release(ctx_);
+            ctx_ = nullptr;
+        }
+        throw;
+    }
+}
+
+bool SeccompContext::loadFromCache(const std::string& path) {
+    TRACE(path);
+
+    int fd = withErrnoCheck(
+            "open seccomp cache file " + path,
+            {ENOENT},
+            open,
+            path.c_str(),
+            O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    FD cacheFile(fd, true);
+
+    struct stat cacheFileStat {};
+    withErrnoCheck("stat seccomp cache file", fstat, cacheFile, &cacheFileStat);
+    if (!isWritableOnlyByUs(cacheFileStat)) {
+        logger::warn(
+                "Ignoring seccomp cache file ",
+                path,
+                " writable by other users");
+        return false;
+    }
+    size_t size = cacheFileStat.st_size;
+    if (size == 0 || size % sizeof(struct sock_filter) != 0 ||
+        size / sizeof(struct sock_filter) > BPF_MAXINSNS) {
+        logger::warn("Ignoring malformed seccomp cache file ", path);
+        return false;
+    }
+
+    program_.resize(size / sizeof(struct sock_filter));
+    for (size_t bytesRead = 0; bytesRead < size;) {
+        ssize_t res = withErrnoCheck(
+                "read seccomp cache file",
+                {EINTR},
+                read,
+                cacheFile,
+                reinterpret_cast<char*>(program_.data()) + bytesRead,
+                size - bytesRead);
+        if (res == 0) {
+            logger::warn("Seccomp cache file ", path, " was truncated");
+            program_.clear();
+            return false;
+        }
+        if (res > 0) {
+            bytesRead += res;
+        }
+    }
+
+    try {
+        bpf::verify(program_);
+    }
+    catch (const SeccompException& ex) {
+        logger::warn(
+                "Ignoring invalid seccomp cache file ", path, ": ", ex.what());
+        program_.clear();
+        return false;
+    }
+    return true;
+}
+
+void SeccompContext::exportProgram() {
+    TRACE();
+
+    // Export filter...
+    FD fd(withErrnoCheck("memfd_create", syscall, __NR_memfd_create, "", 0),
+          true);
+    if (seccomp_export_bpf(ctx_, fd) < 0) {
+        throw Exception("Can't export libseccomp filter");
+    }
+
+    // ... and read it back.
+    size_t size = withErrnoCheck("lseek on memfd file", lseek, fd, 0, SEEK_CUR);
+    program_.resize(size / sizeof(struct sock_filter));
+    withErrnoCheck("lseek on memfd file", lseek, fd, 0, SEEK_SET);
+    for (size_t bytesRead = 0; bytesRead < size;) {
+        ssize_t res = withErrnoCheck(
+                "read",
+                read,
+                fd,
+                reinterpret_cast<char*>(program_.data()) + bytesRead,
+                size - bytesRead);
+        if (res == 0) {
+            throw Exception("Exported seccomp filter was truncated");
+        }
+        bytesRead += res;
+    }
+}
+
+void SeccompContext::convertTraceToNotify() {
+    TRACE();
+
+    // Converted programs are cached, bump CACHE_FORMAT_VERSION when this
+    // changes.
+
+    for (auto& instruction: program_) {
+        if (BPF_CLASS(instruction.code) == BPF_RET &&
+            BPF_RVAL(instruction.code) == BPF_K &&
+            (instruction.k & SECCOMP_RET_ACTION_FULL) == SECCOMP_RET_TRACE) {
+            instruction.k =
+                    SECCOMP_RET_USER_NOTIF | (instruction.k & SECCOMP_RET_DATA);
+        }
+    }
+}
+
+void SeccompContext::storeInCache(const std::string& path) {
+    TRACE(path);
+
+    try {
+        writeFileAtomically(
+                path,
+                std::string(
+                        reinterpret_cast<const char*>(program_.data()),
+                        program_.size() * sizeof(struct sock_filter)));
+    }
+    catch (const SystemException& ex) {
+        logger::warn("Can't store seccomp filter in cache: ", ex.what());
+    }
+}
+
 void SeccompContext::loadFilter() {
     TRACE();
 
+    if (!program_.empty()) {
+        struct sock_fprog program {
+            static_cast<unsigned short>(program_.size()), program_.data()
+        };
+        if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+            throw SeccompException("Filter load failed");
+        }
+        if (userNotification_) {
+            // Listener fd can only be obtained with seccomp syscall
+            notifyFd_ = syscall(
+                    __NR_seccomp,
+                    SECCOMP_SET_MODE_FILTER,
+                    SECCOMP_FILTER_FLAG_NEW_LISTENER,
+                    &program);
+            if (notifyFd_ < 0) {
+                throw SeccompException("Filter load failed");
+            }
+        }
+        else if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) < 0) {
+            throw SeccompException("Filter load failed");
+        }
+        return;
+    }
+
     if (seccomp_load(ctx_) < 0) {
         throw SeccompException("Filter load failed");
     }
 }
 
+int SeccompContext::getNotifyFd() const {
+    return notifyFd_;
+}
+
 std::string SeccompContext::exportFilter() const {
+    if (ctx_ == nullptr) {
+        return std::to_string(program_.size()) + " bpf instructions\n" +
+                bpf::disassemble(program_);
+    }
+
     FD fd(withErrnoCheck("memfd_create", syscall, __NR_memfd_create, "", 0));
     withErrnoCheck("truncate memfd_created file", ftruncate, fd, 1024 * 1024);
 
@@ -1,24 +1,41 @@
 #pragma once
 
 #include "SeccompRule.h"
+#include "SyscallProfile.h"
 
 #include "tracer/Tracee.h"
 
+#include <linux/filter.h>
 #include <seccomp.h>
 
 #include <cstdint>
 #include <list>
 #include <map>
+#include <string>
+#include <vector>
 
 namespace s2j {
 namespace seccomp {
 
 class SeccompContext {
 public:
+    /**
+     * Compiler of filters, in-tree one or libseccomp's.
+     */
+    enum class Compiler { BUILTIN, LIBSECCOMP };
+
     class Builder {
     public:
-        Builder();
-        ~Builder();
+        /**
+         * When cacheDirectory is not empty compiled filters are stored there
+         * and reused by subsequent runs with the same set of rules. When
+         * userNotification is set traced syscalls are reported through seccomp
+         * user notifications instead of ptrace.
+         */
+        Builder(
+                std::string cacheDirectory = "",
+                bool userNotification = false,
+                Compiler compiler = Compiler::LIBSECCOMP);
 
         /**
          * Adds new rule to filter, it won't be active until @loadFilter is
@@ -26,6 +43,12 @@ public:
          */
         void addRule(const SeccompRule& rule, uint32_t actionGroupId);
 
+        /**
+         * Makes most frequent syscalls of profile the first ones to be
+         * matched by filter. It doesn't change which syscalls are allowed.
+         */
+        void setSyscallProfile(SyscallProfile profile);
+
         /**
          * Consumes builder and creates seccomp context.
          */
@@ -35,11 +58,26 @@ public:
         friend class SeccompContext;
 
         /**
-         * Mantain two separate contexts, one for x86 and one for i386
-         * architecture. In laodFilter merge them. This allows to distuinguish
-         * syscalls architectures
+         * Rule as passed to libseccomp, kept until filter is built so that
+         * it can be looked up in cache without touching libseccomp at all.
          */
-        std::map<tracer::Arch, scmp_filter_ctx> ctx_;
+        struct LibSeccompRule {
+            tracer::Arch arch;
+            uint32_t action;
+            uint32_t syscall;
+            std::vector<struct scmp_arg_cmp> filter;
+        };
+
+        /**
+         * Hash of everything that affects the compiled filter.
+         */
+        std::string getCacheKey() const;
+
+        std::string cacheDirectory_;
+        bool userNotification_;
+        Compiler compiler_;
+        std::vector<LibSeccompRule> rules_;
+        SyscallProfile syscallProfile_;
     };
 
     SeccompContext(Builder&& builder);
@@ -51,7 +89,14 @@ public:
     void loadFilter();
 
     /**
-     * Exports filter in human-readable pseudocode.
+     * Returns seccomp user notification fd, valid after loadFilter in the
+     * process that loaded the filter, -1 if notifications aren't used.
+     */
+    int getNotifyFd() const;
+
+    /**
+     * Exports filter in human-readable pseudocode, or disassembled when
+     * it wasn't compiled by libseccomp.
      */
     std::string exportFilter() const;
 
@@ -66,12 +111,66 @@ public:
      */
     static const uint32_t SECCOMP_TRACE_MSG_NUM_SHIFT;
 
+    /**
+     * Part of cache keys, to be bumped whenever the same rules would compile
+     * to a different program, e.g. on changes of bpf::Compiler or
+     * convertTraceToNotify.
+     */
+    static const uint32_t CACHE_FORMAT_VERSION;
 
 private:
     /**
-     * Libseccomp's context of created filter.
+     * Compiles builder's rules with chosen compiler, into program_ or ctx_.
+     */
+    void compile(const Builder& builder);
+
+    /**
+     * Compiles rules with bpf::Compiler. Default action of every
+     * architecture is traced with the architecture in its data, so that
+     * tracer always knows it.
+     */
+    void compileBuiltin(const Builder& builder);
+
+    /**
+     * Creates libseccomp's context from builder's rules. Mantain two separate
+     * contexts, one for x86 and one for i386 architecture and merge them.
+     * This allows to distuinguish syscalls architectures.
+     */
+    void compileLibSeccomp(const Builder& builder);
+
+    /**
+     * Exports compiled libseccomp's filter into program_.
+     */
+    void exportProgram();
+
+    /**
+     * Libseccomp refuses rules with the same action as default one, so
+     * filter is compiled with trace actions and their return instructions
+     * are rewritten afterwards. Kernel ignores data of user notification
+     * action.
      */
-    scmp_filter_ctx ctx_;
+    void convertTraceToNotify();
+
+    bool loadFromCache(const std::string& path);
+    void storeInCache(const std::string& path);
+
+    /**
+     * Libseccomp's context of created filter, null if filter was loaded from
+     * cache.
+     */
+    scmp_filter_ctx ctx_{nullptr};
+
+    /**
+     * Compiled bpf program, filled unless filter was compiled by libseccomp
+     * and neither cache nor user notifications are in use.
+     */
+    std::vector<struct sock_filter> program_;
+
+    const bool userNotification_;
+    int notifyFd_{-1};
+
+    static uint64_t cacheHits_;
+    static uint64_t cacheMisses_;
 };
 
 } // namespace seccomp
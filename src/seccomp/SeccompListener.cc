@@ -1,5 +1,6 @@
 #include "SeccompListener.h"
 #include "action/ActionAllow.h"
+#include "action/ActionBudget.h"
 #include "action/ActionTrace.h"
 
 #include "common/Exception.h"
@@ -7,15 +8,23 @@
 #include "logger/Logger.h"
 
 #include <fcntl.h>
+#include <linux/seccomp.h>
 #include <seccomp.h>
 #include <sys/ptrace.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <cerrno>
 #include <csignal>
 #include <cstdint>
+#include <cstring>
 #include <utility>
 
+#ifndef SECCOMP_USER_NOTIF_FLAG_CONTINUE
+#define SECCOMP_USER_NOTIF_FLAG_CONTINUE (1UL << 0)
+#endif
+
 namespace s2j {
 namespace seccomp {
 
@@ -26,13 +35,62 @@ SeccompListener::SeccompListener()
         : SeccompListener(std::make_shared<policy::DefaultPolicy>()) {}
 
 SeccompListener::SeccompListener(
-        std::shared_ptr<policy::BaseSyscallPolicy> basePolicy)
+        std::shared_ptr<policy::BaseSyscallPolicy> basePolicy,
+        std::string cacheDirectory,
+        bool userNotification,
+        SeccompContext::Compiler compiler,
+        std::string syscallProfilePath)
         : basePolicy_(std::move(basePolicy))
-        , lastSyscallArch_(tracer::Arch::X86) {}
+        , cacheDirectory_(std::move(cacheDirectory))
+        , compiler_(compiler)
+        , syscallProfilePath_(std::move(syscallProfilePath))
+        , lastSyscallArch_(tracer::Arch::X86)
+        , userNotification_(userNotification) {
+#ifndef SCMP_ACT_NOTIFY
+    if (userNotification_) {
+        throw Exception(
+                "Libseccomp was built without user notification support");
+    }
+#endif
+}
+
+SeccompListener::~SeccompListener() {
+    for (int fd: {notifySockets_[0], notifySockets_[1], notifyFd_}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#ifdef SCMP_ACT_NOTIFY
+    if (notifyRequest_ != nullptr) {
+        seccomp_notify_free(notifyRequest_, notifyResponse_);
+    }
+#endif
+}
 
 void SeccompListener::onPreFork() {
     TRACE();
 
+    if (userNotification_) {
+        // Child passes notification fd through this socket right after
+        // loading the filter, so this one sendmsg must be allowed. The rule
+        // stays in the filter after exec, but the socket is close on exec,
+        // so the program can only use it on a socket it created and moved to
+        // this fd itself. Its policy must allow creating sockets for that,
+        // and such socket can reach nothing outside of the sandbox that
+        // write on it couldn't.
+        withErrnoCheck(
+                "create seccomp notification socket",
+                socketpair,
+                AF_UNIX,
+                SOCK_SEQPACKET | SOCK_CLOEXEC,
+                0,
+                notifySockets_);
+        addRule(SeccompRule(
+                "sendmsg",
+                action::ActionAllow(),
+                filter::SyscallArg(0) == notifySockets_[1]));
+    }
+
     // Now current syscalls are frozen, and we can add default ones from syscall
     // policy.
     addPolicy(*basePolicy_);
@@ -42,7 +100,12 @@ void SeccompListener::onPreFork() {
     uint32_t ruleId = TRACE_EVENT_ID_BASE;
 
     // Create context builder
-    SeccompContext::Builder contextBuilder;
+    SeccompContext::Builder contextBuilder(
+            cacheDirectory_, userNotification_, compiler_);
+    if (!syscallProfilePath_.empty()) {
+        contextBuilder.setSyscallProfile(
+                SyscallProfile::load(syscallProfilePath_));
+    }
 
     // Add rules in order
     for (auto ruleIter = rules_.begin(); ruleIter != rules_.end(); ++ruleIter) {
@@ -62,6 +125,24 @@ void SeccompListener::onPreFork() {
                 });
 
         rulesById_[++ruleId] = ruleIter;
+        if (userNotification_) {
+            char* name = seccomp_syscall_resolve_num_arch(
+                    SCMP_ARCH_NATIVE, ruleIter->first);
+            if (name == NULL) {
+                throw Exception(
+                        "Can't resolve the name of syscall number " +
+                        std::to_string(ruleIter->first));
+            }
+            for (const auto& arch:
+                 SeccompContext::SECCOMP_FILTER_ARCHITECTURES) {
+                int syscall =
+                        seccomp_syscall_resolve_name_arch(arch.second, name);
+                if (syscall >= 0) {
+                    rulesBySyscall_[{arch.first, syscall}] = ruleIter;
+                }
+            }
+            free(name);
+        }
         for (auto rule = ruleIter->second.rbegin();
              rule != ruleIter->second.rend();
              ++rule) {
@@ -88,6 +169,182 @@ void SeccompListener::onPostForkChild() {
 
     assert(context_ != nullptr, "seccomp filter is configured");
     context_->loadFilter();
+
+    if (userNotification_) {
+        sendNotifyFd();
+    }
+}
+
+void SeccompListener::onPostForkParent(pid_t /* childPid */) {
+    TRACE();
+
+    if (userNotification_) {
+        receiveNotifyFd();
+    }
+}
+
+void SeccompListener::sendNotifyFd() {
+    int notifyFd = context_->getNotifyFd();
+
+    char control[CMSG_SPACE(sizeof(notifyFd))]{};
+    char data = 0;
+    struct iovec iov {
+        &data, sizeof(data)
+    };
+    struct msghdr message {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(notifyFd));
+    memcpy(CMSG_DATA(cmsg), &notifyFd, sizeof(notifyFd));
+
+    // Both fds are close on exec, sandboxed program never gets them
+    withErrnoCheck(
+            "send seccomp notification fd",
+            sendmsg,
+            notifySockets_[1],
+            &message,
+            0);
+}
+
+void SeccompListener::receiveNotifyFd() {
+    withErrnoCheck("close child socket", close, notifySockets_[1]);
+    notifySockets_[1] = -1;
+
+    char control[CMSG_SPACE(sizeof(notifyFd_))]{};
+    char data = 0;
+    struct iovec iov {
+        &data, sizeof(data)
+    };
+    struct msghdr message {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t bytesReceived{-1};
+    do {
+        bytesReceived = withErrnoCheck(
+                "receive seccomp notification fd",
+                {EINTR},
+                recvmsg,
+                notifySockets_[0],
+                &message,
+                MSG_CMSG_CLOEXEC);
+    } while (bytesReceived < 0);
+
+    withErrnoCheck("close parent socket", close, notifySockets_[0]);
+    notifySockets_[0] = -1;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    if (bytesReceived == 0 || cmsg == nullptr ||
+        cmsg->cmsg_type != SCM_RIGHTS) {
+        // Child failed before loading the filter, executor will see it exit
+        logger::warn("Child didn't send seccomp notification fd");
+        return;
+    }
+    memcpy(&notifyFd_, CMSG_DATA(cmsg), sizeof(notifyFd_));
+    logger::debug("Received seccomp notification fd ", notifyFd_);
+
+#ifdef SCMP_ACT_NOTIFY
+    if (notifyRequest_ == nullptr &&
+        seccomp_notify_alloc(&notifyRequest_, &notifyResponse_) < 0) {
+        throw Exception("Can't allocate seccomp notification");
+    }
+#endif
+}
+
+std::vector<int> SeccompListener::getPollFds() {
+    if (notifyFd_ < 0) {
+        return {};
+    }
+    return {notifyFd_};
+}
+
+executor::ExecuteAction SeccompListener::onPollEvent(int /* fd */) {
+    TRACE();
+
+#ifdef SCMP_ACT_NOTIFY
+    // Kernel requires request to be zeroed
+    memset(notifyRequest_, 0, sizeof(*notifyRequest_));
+    int res = seccomp_notify_receive(notifyFd_, notifyRequest_);
+    if (res < 0) {
+        // Notifying process was killed before we got to it
+        logger::debug("Can't receive seccomp notification: ", strerror(-res));
+        return executor::ExecuteAction::CONTINUE;
+    }
+
+    const auto& data = notifyRequest_->data;
+    tracer::Arch arch = tracer::Arch::UNKNOWN;
+    for (const auto& filterArch: SeccompContext::SECCOMP_FILTER_ARCHITECTURES) {
+        if (filterArch.second == data.arch) {
+            arch = filterArch.first;
+        }
+    }
+    uint64_t arguments[6];
+    std::copy(std::begin(data.args), std::end(data.args), arguments);
+    tracer::Tracee tracee(
+            tracer::ProcessInfo::makeProcessInfo(notifyRequest_->pid, nullptr),
+            arch,
+            data.nr,
+            arguments);
+    tracer::TraceEvent traceEvent{};
+    traceEvent.executeEvent.pid = notifyRequest_->pid;
+
+    std::string syscallName = describeSyscall(tracee);
+    logger::debug("Seccomp notification for ", syscallName);
+
+    std::shared_ptr<action::SeccompAction> seccompAction = nullptr;
+    auto ruleSetIter = rulesBySyscall_.find({arch, data.nr});
+    if (ruleSetIter != rulesBySyscall_.end()) {
+        seccompAction = findAction(
+                traceEvent, tracee, ruleSetIter->second->second, nullptr);
+    }
+    if (seccompAction == nullptr) {
+        logger::debug(
+                "Default syscall filter action after syscall ", syscallName);
+        seccompAction = basePolicy_->getDefaultAction();
+    }
+
+    if (executeAction(seccompAction, tracee, syscallName) ==
+        tracer::TraceAction::KILL) {
+        // Leave syscall unanswered, process must not continue it.
+        withErrnoCheck(
+                "kill notifying process",
+                {ESRCH},
+                kill,
+                notifyRequest_->pid,
+                SIGKILL);
+        return executor::ExecuteAction::KILL;
+    }
+
+    notifyResponse_->id = notifyRequest_->id;
+    notifyResponse_->val = 0;
+    notifyResponse_->error = 0;
+    notifyResponse_->flags = 0;
+    if (!tracee.isSyscallCancelled()) {
+        notifyResponse_->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+    }
+    else if (
+            static_cast<int64_t>(tracee.getSyscallReturnValue()) < 0 &&
+            static_cast<int64_t>(tracee.getSyscallReturnValue()) > -4096) {
+        notifyResponse_->error = tracee.getSyscallReturnValue();
+    }
+    else {
+        notifyResponse_->val = tracee.getSyscallReturnValue();
+    }
+
+    res = seccomp_notify_respond(notifyFd_, notifyResponse_);
+    if (res < 0 && res != -ENOENT) {
+        throw SystemException("Can't respond to seccomp notification", -res);
+    }
+#endif
+    return executor::ExecuteAction::CONTINUE;
 }
 
 tracer::TraceAction SeccompListener::onTraceEvent(
@@ -107,33 +364,29 @@ tracer::TraceAction SeccompListener::onTraceEvent(
         return tracer::TraceAction::CONTINUE;
     }
 
-    uint32_t traceEventMsg = tracee.getEventMsg();
+    uint32_t traceEventMsg;
+    if (tracee.fetchSeccompStopInfo()) {
+        // Kernel told us exact syscall architecture
+        traceEventMsg = tracee.getSeccompData();
+        lastSyscallArch_ = tracee.getSyscallArch();
+    }
+    else {
+        traceEventMsg = tracee.getEventMsg();
 
-    /* Sadly we can't distinguish architecture on default action,
-     * because libseccomp doesn't allow to merge multiple contexts
-     * with different default actions. Later, when we create
-     * custom seccomp bpf compiler we will change this.
-     */
-    if (traceEventMsg != 0) {
-        lastSyscallArch_ = static_cast<tracer::Arch>(
+        /* Libseccomp doesn't allow to merge multiple contexts with
+         * different default actions, so its filters don't tell
+         * architecture on default action. Builtin compiler's do.
+         */
+        auto arch = static_cast<tracer::Arch>(
                 traceEventMsg &
                 ((1 << SeccompContext::SECCOMP_TRACE_MSG_NUM_SHIFT) - 1));
-    }
-    tracee.setSyscallArch(lastSyscallArch_);
-
-    /* Pretty-print syscall name. */
-    std::string syscallName =
-            resolveSyscallNumber(
-                    tracee.getSyscallNumber(), tracee.getSyscallArch()) +
-            "(" + std::to_string(tracee.getSyscallNumber()) + ") (";
-    for (size_t i = 0; i < 6; ++i) {
-        if (i > 0) {
-            syscallName += ", ";
+        if (arch != tracer::Arch::UNKNOWN) {
+            lastSyscallArch_ = arch;
         }
-        syscallName += std::to_string(tracee.getSyscallArgument(i));
+        tracee.setSyscallArch(lastSyscallArch_);
     }
-    syscallName += ")";
 
+    std::string syscallName = describeSyscall(tracee);
     logger::debug(
             "Detected syscall architecture ",
             to_string(lastSyscallArch_),
@@ -143,7 +396,8 @@ tracer::TraceAction SeccompListener::onTraceEvent(
             syscallName);
 
     std::shared_ptr<action::SeccompAction> seccompAction = nullptr;
-    if (traceEventMsg == 0) {
+    if ((traceEventMsg >> SeccompContext::SECCOMP_TRACE_MSG_NUM_SHIFT) ==
+        TRACE_EVENT_ID_BASE) {
         logger::debug(
                 "Default syscall filter action after syscall ", syscallName);
         seccompAction = basePolicy_->getDefaultAction();
@@ -152,23 +406,68 @@ tracer::TraceAction SeccompListener::onTraceEvent(
     auto ruleSetIter = rulesById_.find(
             traceEventMsg >> SeccompContext::SECCOMP_TRACE_MSG_NUM_SHIFT);
     if (ruleSetIter != rulesById_.end()) {
-        for (auto& rule: ruleSetIter->second->second) {
-            if (rule.filter->match(traceEvent, tracee)) {
-                if (seccompAction == nullptr ||
-                    rule.action->getType() > seccompAction->getType()) {
-                    seccompAction = rule.action;
-                }
+        seccompAction = findAction(
+                traceEvent, tracee, ruleSetIter->second->second, seccompAction);
+    }
+
+    return executeAction(seccompAction, tracee, syscallName);
+}
+
+std::string SeccompListener::describeSyscall(tracer::Tracee& tracee) {
+    std::string syscallName =
+            resolveSyscallNumber(
+                    tracee.getSyscallNumber(), tracee.getSyscallArch()) +
+            "(" + std::to_string(tracee.getSyscallNumber()) + ") (";
+    for (size_t i = 0; i < 6; ++i) {
+        if (i > 0) {
+            syscallName += ", ";
+        }
+        syscallName += std::to_string(tracee.getSyscallArgument(i));
+    }
+    syscallName += ")";
+    return syscallName;
+}
+
+std::shared_ptr<action::SeccompAction> SeccompListener::findAction(
+        const tracer::TraceEvent& traceEvent,
+        tracer::Tracee& tracee,
+        const std::vector<SeccompRule>& rules,
+        std::shared_ptr<action::SeccompAction> seccompAction) {
+    for (auto& rule: rules) {
+        if (rule.filter->match(traceEvent, tracee)) {
+            if (seccompAction == nullptr ||
+                rule.action->getType() > seccompAction->getType()) {
+                seccompAction = rule.action;
             }
         }
     }
+    return seccompAction;
+}
 
+tracer::TraceAction SeccompListener::executeAction(
+        const std::shared_ptr<action::SeccompAction>& seccompAction,
+        tracer::Tracee& tracee,
+        const std::string& syscallName) {
     assert(seccompAction != nullptr,
            "trace triggered rule is handled by some rule");
 
     logger::debug(
             "Returning with action " + to_string(seccompAction->getType()));
     tracer::TraceAction traceAction = seccompAction->execute(tracee);
-    if (traceAction == tracer::TraceAction::KILL) {
+    auto budget =
+            std::dynamic_pointer_cast<action::ActionBudget>(seccompAction);
+    if (traceAction == tracer::TraceAction::KILL && budget != nullptr &&
+        budget->isExceeded()) {
+        // Same verdict as when budget is counted by perf
+        outputBuilder_->setKillReason(
+                printer::OutputBuilder::KillReason::RV,
+                "syscall budget of " +
+                        resolveSyscallNumber(
+                                tracee.getSyscallNumber(),
+                                tracee.getSyscallArch()) +
+                        " exceeded");
+    }
+    else if (traceAction == tracer::TraceAction::KILL) {
         outputBuilder_->setKillReason(
                 printer::OutputBuilder::KillReason::RV,
                 "intercepted forbidden syscall " + syscallName);
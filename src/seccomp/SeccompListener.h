@@ -17,8 +17,13 @@
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
+struct seccomp_notif;
+struct seccomp_notif_resp;
+
 namespace s2j {
 namespace seccomp {
 
@@ -30,7 +35,19 @@ public:
     using syscall_t = int;
 
     SeccompListener();
-    SeccompListener(std::shared_ptr<policy::BaseSyscallPolicy> basePolicy);
+
+    /**
+     * When syscallProfilePath is not empty, syscalls most frequent in that
+     * profile are matched first by filter.
+     */
+    SeccompListener(
+            std::shared_ptr<policy::BaseSyscallPolicy> basePolicy,
+            std::string cacheDirectory = "",
+            bool userNotification = false,
+            SeccompContext::Compiler compiler =
+                    SeccompContext::Compiler::LIBSECCOMP,
+            std::string syscallProfilePath = "");
+    ~SeccompListener();
 
     /* Create seccomp context and build syscall filter. */
     void onPreFork() override;
@@ -38,6 +55,13 @@ public:
     /* Load syscall filter into kernel. */
     void onPostForkChild() override;
 
+    /* Receive seccomp notification fd from child. */
+    void onPostForkParent(pid_t childPid) override;
+
+    /* Handle syscalls reported through seccomp user notifications. */
+    std::vector<int> getPollFds() override;
+    executor::ExecuteAction onPollEvent(int fd) override;
+
     /* Inform any rules about event that have occured. */
     tracer::TraceAction onTraceEvent(
             const tracer::TraceEvent& traceEvent,
@@ -61,16 +85,49 @@ private:
             uint32_t syscallNumber,
             const tracer::Arch& arch);
 
+    /* Pretty-print syscall name with arguments. */
+    static std::string describeSyscall(tracer::Tracee& tracee);
+
+    /* Finds most restrictive action of matching rules from given set. */
+    std::shared_ptr<action::SeccompAction> findAction(
+            const tracer::TraceEvent& traceEvent,
+            tracer::Tracee& tracee,
+            const std::vector<SeccompRule>& rules,
+            std::shared_ptr<action::SeccompAction> seccompAction);
+
+    tracer::TraceAction executeAction(
+            const std::shared_ptr<action::SeccompAction>& seccompAction,
+            tracer::Tracee& tracee,
+            const std::string& syscallName);
+
+    void sendNotifyFd();
+    void receiveNotifyFd();
+
     const static uint32_t TRACE_EVENT_ID_BASE;
 
     std::unique_ptr<SeccompContext> context_;
 
     std::shared_ptr<policy::BaseSyscallPolicy> basePolicy_;
+    const std::string cacheDirectory_;
+    const SeccompContext::Compiler compiler_;
+    const std::string syscallProfilePath_;
 
     std::map<syscall_t, std::vector<SeccompRule>> rules_;
     std::map<uint16_t, decltype(rules_)::iterator> rulesById_;
 
     tracer::Arch lastSyscallArch_;
+
+    /**
+     * User notifications carry no rule id, so rules are looked up by syscall
+     * number of given architecture.
+     */
+    const bool userNotification_;
+    std::map<std::pair<tracer::Arch, uint32_t>, decltype(rules_)::iterator>
+            rulesBySyscall_;
+    int notifySockets_[2]{-1, -1};
+    int notifyFd_{-1};
+    struct seccomp_notif* notifyRequest_{nullptr};
+    struct seccomp_notif_resp* notifyResponse_{nullptr};
 };
 
 } // namespace seccomp
@@ -67,7 +67,6 @@ public:
     std::shared_ptr<action::SeccompAction> action;
     std::shared_ptr<filter::SyscallFilter> filter;
 
-private:
     static uint32_t resolveSyscallName(const std::string& name);
 };
 
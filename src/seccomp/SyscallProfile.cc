@@ -0,0 +1,56 @@
+#include "SyscallProfile.h"
+
+#include "common/Exception.h"
+#include "common/Utils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace s2j {
+namespace seccomp {
+
+SyscallProfile SyscallProfile::load(const std::string& path) {
+    std::ifstream profileFile(path);
+    if (!profileFile.is_open()) {
+        throw Exception("can't open syscall profile " + path);
+    }
+
+    SyscallProfile profile;
+    std::string syscall;
+    uint64_t count;
+    while (profileFile >> syscall >> count) {
+        profile.counts[syscall] += count;
+    }
+    if (!profileFile.eof()) {
+        throw Exception("malformed syscall profile " + path);
+    }
+    return profile;
+}
+
+void SyscallProfile::store(const std::string& path) const {
+    writeFileAtomically(path, dump());
+}
+
+std::string SyscallProfile::dump() const {
+    std::vector<std::pair<std::string, uint64_t>> syscalls(
+            counts.begin(), counts.end());
+    std::stable_sort(
+            syscalls.begin(),
+            syscalls.end(),
+            [](const std::pair<std::string, uint64_t>& lhs,
+               const std::pair<std::string, uint64_t>& rhs) {
+                return lhs.second > rhs.second;
+            });
+
+    std::stringstream ss;
+    for (const auto& syscall: syscalls) {
+        ss << syscall.first << " " << syscall.second << std::endl;
+    }
+    return ss.str();
+}
+
+} // namespace seccomp
+} // namespace s2j
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace s2j {
+namespace seccomp {
+
+/**
+ * Number of calls of each syscall, by name, so that the same profile applies
+ * to programs of every architecture.
+ *
+ * Profile file holds "syscall count" lines, most frequent syscalls first.
+ */
+struct SyscallProfile {
+    std::map<std::string, uint64_t> counts;
+
+    static SyscallProfile load(const std::string& path);
+
+    /**
+     * Replaces file atomically, so that concurrent runs recording into the
+     * same profile never read a partially written one.
+     */
+    void store(const std::string& path) const;
+    std::string dump() const;
+};
+
+} // namespace seccomp
+} // namespace s2j
@@ -0,0 +1,90 @@
+#include "ActionBudget.h"
+
+#include "logger/Logger.h"
+#include "seccomp/filter/LibSeccompFilter.h"
+
+#include <seccomp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace s2j {
+namespace seccomp {
+namespace action {
+
+ActionBudget::ActionBudget(
+        uint64_t budget,
+        std::shared_ptr<SeccompAction> exceededAction)
+        : budget_(budget), exceededAction_(std::move(exceededAction)) {}
+
+SeccompAction::Type ActionBudget::getType() const {
+    return countedExternally_ ? SeccompAction::Type::ALLOW
+                              : SeccompAction::Type::TRACE;
+}
+
+tracer::TraceAction ActionBudget::execute(tracer::Tracee& tracee) {
+    if (countedExternally_ || ++callsCount_ <= budget_) {
+        return tracer::TraceAction::CONTINUE;
+    }
+    if (callsCount_ == budget_ + 1) {
+        logger::debug("Syscall budget of ", budget_, " calls exceeded");
+    }
+    return exceededAction_->execute(tracee);
+}
+
+uint64_t ActionBudget::getBudget() const {
+    return budget_;
+}
+
+bool ActionBudget::isExceeded() const {
+    return callsCount_ > budget_;
+}
+
+const std::shared_ptr<SeccompAction>& ActionBudget::getExceededAction()
+        const {
+    return exceededAction_;
+}
+
+void ActionBudget::setCountedExternally() {
+    countedExternally_ = true;
+}
+
+uint32_t ActionBudget::createLibSeccompAction() const {
+    return countedExternally_ ? SCMP_ACT_ALLOW : SCMP_ACT_TRACE(getRuleId());
+}
+
+std::map<std::string, uint64_t> ActionBudget::countKillingBudgetsExternally(
+        const std::vector<SeccompRule>& rules) {
+    std::map<std::string, uint64_t> budgets;
+    for (const auto& rule: rules) {
+        auto budget = std::dynamic_pointer_cast<ActionBudget>(rule.action);
+        auto filter =
+                std::dynamic_pointer_cast<filter::LibSeccompFilter>(rule.filter);
+        if (budget == nullptr ||
+            budget->getExceededAction()->getType() != Type::KILL ||
+            filter == nullptr || filter->hasConditions()) {
+            continue;
+        }
+
+        // Counter identifies syscalls by name, as architecture of the
+        // program isn't known yet
+        char* name =
+                seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, rule.syscall);
+        if (name == nullptr) {
+            continue;
+        }
+        auto inserted = budgets.emplace(name, budget->getBudget());
+        if (!inserted.second) {
+            inserted.first->second =
+                    std::min(inserted.first->second, budget->getBudget());
+        }
+        free(name);
+        budget->setCountedExternally();
+    }
+    return budgets;
+}
+
+} // namespace action
+} // namespace seccomp
+} // namespace s2j
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "SeccompAction.h"
+#include "seccomp/SeccompRule.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace s2j {
+namespace seccomp {
+namespace action {
+
+/**
+ * Allows syscall budget times in a run, and executes exceededAction on its
+ * further calls, e.g. to make them fail or kill the program.
+ *
+ * Seccomp filter can't count, so calls are counted by tracer, or by seccomp
+ * user notifications when they are enabled. Budget that is counted
+ * externally, without stopping the program, is just allowed by the filter
+ * instead.
+ */
+class ActionBudget : public SeccompAction {
+public:
+    ActionBudget(
+            uint64_t budget,
+            std::shared_ptr<SeccompAction> exceededAction);
+
+    Type getType() const override;
+
+    tracer::TraceAction execute(tracer::Tracee& tracee) override;
+
+    uint64_t getBudget() const;
+    bool isExceeded() const;
+    const std::shared_ptr<SeccompAction>& getExceededAction() const;
+
+    void setCountedExternally();
+
+    /**
+     * Makes budgets of rules without conditions that kill once exceeded
+     * counted externally, and returns them by syscall name. Must be called
+     * before rules are compiled.
+     */
+    static std::map<std::string, uint64_t> countKillingBudgetsExternally(
+            const std::vector<SeccompRule>& rules);
+
+protected:
+    uint32_t createLibSeccompAction() const override;
+
+private:
+    const uint64_t budget_;
+    const std::shared_ptr<SeccompAction> exceededAction_;
+    uint64_t callsCount_{};
+    bool countedExternally_{false};
+};
+
+} // namespace action
+} // namespace seccomp
+} // namespace s2j
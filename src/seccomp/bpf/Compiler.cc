@@ -0,0 +1,473 @@
+#include "Compiler.h"
+
+#include "seccomp/SeccompException.h"
+
+#include <linux/audit.h>
+#include <linux/seccomp.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+// Programs compiled here are cached, bump SeccompContext::CACHE_FORMAT_VERSION
+// when they change.
+
+namespace {
+
+// Syscalls of x32 ABI come with x86_64 architecture, but have this bit set.
+const uint32_t X32_SYSCALL_BIT = 0x40000000;
+
+// Syscall -1, e.g. set by tracer to skip a syscall, isn't an x32 one.
+const uint32_t INVALID_SYSCALL = 0xffffffff;
+
+// Up to this many syscalls are compared one by one, binary search isn't
+// shorter for them.
+const size_t LINEAR_SEARCH_MAX_SIZE = 4;
+
+// Offsets of seccomp_data fields, arguments are little endian.
+const uint32_t NR_OFFSET = offsetof(struct seccomp_data, nr);
+const uint32_t ARCH_OFFSET = offsetof(struct seccomp_data, arch);
+
+uint32_t argumentLowOffset(unsigned int argument) {
+    return offsetof(struct seccomp_data, args) + argument * sizeof(uint64_t);
+}
+
+uint32_t argumentHighOffset(unsigned int argument) {
+    return argumentLowOffset(argument) + sizeof(uint32_t);
+}
+
+// Position of labels that weren't bound yet
+const size_t UNBOUND = std::numeric_limits<size_t>::max();
+
+/**
+ * Builds program from instructions with jumps to labels instead of offsets.
+ * Conditional jumps can only skip 255 instructions, longer ones go through an
+ * additional unconditional jump.
+ */
+class Assembler {
+public:
+    // Jump target meaning the next instruction
+    static const int NEXT = -1;
+
+    int newLabel() {
+        labels_.push_back(UNBOUND);
+        return labels_.size() - 1;
+    }
+
+    /**
+     * Binds label to the next emitted instruction.
+     */
+    void bind(int label) {
+        bind(label, instructions_.size());
+    }
+
+    void load(uint32_t offset) {
+        emit(BPF_LD | BPF_W | BPF_ABS, offset);
+    }
+
+    void andWith(uint32_t value) {
+        emit(BPF_ALU | BPF_AND | BPF_K, value);
+    }
+
+    void jump(uint16_t operation, uint32_t value, int jt, int jf) {
+        emit(BPF_JMP | operation | BPF_K, value, jt, jf);
+    }
+
+    void ret(uint32_t action) {
+        emit(BPF_RET | BPF_K, action);
+    }
+
+    std::vector<struct sock_filter> assemble() {
+        // Added jumps make other ones longer, so this is repeated until all
+        // of them fit.
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t index = 0; index < instructions_.size(); ++index) {
+                if (BPF_CLASS(instructions_[index].code) != BPF_JMP ||
+                    instructions_[index].code == (BPF_JMP | BPF_JA)) {
+                    continue;
+                }
+                for (int Instruction::*target:
+                     {&Instruction::jt, &Instruction::jf}) {
+                    int label = instructions_[index].*target;
+                    if (label == NEXT ||
+                        offset(label, index) <=
+                                std::numeric_limits<uint8_t>::max()) {
+                        continue;
+                    }
+                    // Instruction that follows is moved behind the new jump
+                    for (int Instruction::*other:
+                         {&Instruction::jt, &Instruction::jf}) {
+                        if (instructions_[index].*other == NEXT) {
+                            instructions_[index].*other = newLabel();
+                            bind(instructions_[index].*other, index + 1);
+                        }
+                    }
+                    insertJump(index + 1, label);
+                    instructions_[index].*target = newLabel();
+                    bind(instructions_[index].*target, index + 1);
+                    changed = true;
+                }
+            }
+        }
+
+        std::vector<struct sock_filter> program;
+        for (size_t index = 0; index < instructions_.size(); ++index) {
+            const Instruction& instruction = instructions_[index];
+            struct sock_filter filter {
+                instruction.code, 0, 0, instruction.k
+            };
+            if (instruction.code == (BPF_JMP | BPF_JA)) {
+                filter.k = offset(instruction.jt, index);
+            }
+            else if (BPF_CLASS(instruction.code) == BPF_JMP) {
+                filter.jt = offset(instruction.jt, index);
+                filter.jf = offset(instruction.jf, index);
+            }
+            program.push_back(filter);
+        }
+        return program;
+    }
+
+private:
+    struct Instruction {
+        uint16_t code;
+        uint32_t k;
+        // Labels of jump targets, only jt is used by unconditional jumps
+        int jt;
+        int jf;
+    };
+
+    void bind(int label, size_t position) {
+        labels_[label] = position;
+    }
+
+    void emit(uint16_t code, uint32_t k, int jt = NEXT, int jf = NEXT) {
+        instructions_.push_back(Instruction{code, k, jt, jf});
+    }
+
+    void insertJump(size_t position, int label) {
+        instructions_.insert(
+                instructions_.begin() + position,
+                Instruction{BPF_JMP | BPF_JA, 0, label, NEXT});
+        for (size_t& boundPosition: labels_) {
+            if (boundPosition != UNBOUND && boundPosition >= position) {
+                ++boundPosition;
+            }
+        }
+    }
+
+    size_t resolve(int label) const {
+        if (labels_[label] == UNBOUND ||
+            labels_[label] >= instructions_.size()) {
+            throw s2j::seccomp::SeccompException(
+                    "Bpf jump to a label without instruction");
+        }
+        return labels_[label];
+    }
+
+    /**
+     * Number of instructions skipped by jump at index.
+     */
+    size_t offset(int label, size_t index) const {
+        if (label == NEXT) {
+            return 0;
+        }
+        size_t target = resolve(label);
+        if (target <= index) {
+            throw s2j::seccomp::SeccompException("Bpf jump backwards");
+        }
+        return target - index - 1;
+    }
+
+    std::vector<Instruction> instructions_;
+    // Instruction index of every label
+    std::vector<size_t> labels_;
+};
+
+/**
+ * Emits comparison of syscall argument that falls through when condition is
+ * met, and jumps to fail label otherwise.
+ */
+void compileCondition(
+        Assembler& assembler,
+        const struct scmp_arg_cmp& condition,
+        bool is64Bit,
+        int fail) {
+    const int NEXT = Assembler::NEXT;
+    uint32_t low = condition.datum_a;
+    uint32_t high = condition.datum_a >> 32;
+    uint32_t lowOffset = argumentLowOffset(condition.arg);
+    uint32_t highOffset = argumentHighOffset(condition.arg);
+    int pass = assembler.newLabel();
+
+    switch (condition.op) {
+    case SCMP_CMP_EQ:
+        if (is64Bit) {
+            assembler.load(highOffset);
+            assembler.jump(BPF_JEQ, high, NEXT, fail);
+        }
+        assembler.load(lowOffset);
+        assembler.jump(BPF_JEQ, low, NEXT, fail);
+        break;
+    case SCMP_CMP_NE:
+        if (is64Bit) {
+            assembler.load(highOffset);
+            assembler.jump(BPF_JEQ, high, NEXT, pass);
+        }
+        assembler.load(lowOffset);
+        assembler.jump(BPF_JEQ, low, fail, NEXT);
+        break;
+    case SCMP_CMP_GT:
+    case SCMP_CMP_GE:
+        // Higher halves decide unless they are equal
+        if (is64Bit) {
+            assembler.load(highOffset);
+            assembler.jump(BPF_JGT, high, pass, NEXT);
+            assembler.jump(BPF_JEQ, high, NEXT, fail);
+        }
+        assembler.load(lowOffset);
+        assembler.jump(
+                condition.op == SCMP_CMP_GT ? BPF_JGT : BPF_JGE,
+                low,
+                NEXT,
+                fail);
+        break;
+    case SCMP_CMP_LT:
+    case SCMP_CMP_LE:
+        // Negations of GE and GT
+        if (is64Bit) {
+            assembler.load(highOffset);
+            assembler.jump(BPF_JGT, high, fail, NEXT);
+            assembler.jump(BPF_JEQ, high, NEXT, pass);
+        }
+        assembler.load(lowOffset);
+        assembler.jump(
+                condition.op == SCMP_CMP_LT ? BPF_JGE : BPF_JGT,
+                low,
+                fail,
+                NEXT);
+        break;
+    case SCMP_CMP_MASKED_EQ:
+        // Mask is in datum_a, compared value in datum_b
+        if (is64Bit) {
+            assembler.load(highOffset);
+            assembler.andWith(high);
+            assembler.jump(BPF_JEQ, condition.datum_b >> 32, NEXT, fail);
+        }
+        assembler.load(lowOffset);
+        assembler.andWith(low);
+        assembler.jump(
+                BPF_JEQ, static_cast<uint32_t>(condition.datum_b), NEXT, fail);
+        break;
+    default:
+        throw s2j::seccomp::SeccompException(
+                "Unsupported seccomp comparison " +
+                std::to_string(condition.op));
+    }
+    assembler.bind(pass);
+}
+
+/**
+ * Whether condition holds for every argument, like the one SeccompContext
+ * adds to rules without conditions for libseccomp.
+ */
+bool isAlwaysMet(const struct scmp_arg_cmp& condition) {
+    return condition.op == SCMP_CMP_GE && condition.datum_a == 0;
+}
+
+/**
+ * Emits binary search of syscall number, loaded to accumulator, among
+ * candidates, which are indices of sorted syscalls, jumping to label of the
+ * found one.
+ *
+ * Syscalls that weigh at least half of all candidates are compared first.
+ * Remaining candidates are split in halves of equal weight, or of equal size
+ * when they weigh nothing.
+ */
+void compileSearch(
+        Assembler& assembler,
+        const std::vector<uint32_t>& syscalls,
+        const std::vector<uint64_t>& weights,
+        const std::vector<int>& syscallLabels,
+        std::vector<size_t> candidates,
+        uint32_t defaultAction) {
+    const int NEXT = Assembler::NEXT;
+    auto lighter = [&weights](size_t lhs, size_t rhs) {
+        return weights[lhs] < weights[rhs];
+    };
+
+    uint64_t totalWeight = 0;
+    for (size_t candidate: candidates) {
+        totalWeight += weights[candidate];
+    }
+    while (!candidates.empty()) {
+        auto heaviest =
+                std::max_element(candidates.begin(), candidates.end(), lighter);
+        if (totalWeight == 0 || weights[*heaviest] * 2 < totalWeight) {
+            break;
+        }
+        assembler.jump(
+                BPF_JEQ, syscalls[*heaviest], syscallLabels[*heaviest], NEXT);
+        totalWeight -= weights[*heaviest];
+        candidates.erase(heaviest);
+    }
+
+    if (candidates.size() <= LINEAR_SEARCH_MAX_SIZE) {
+        std::stable_sort(
+                candidates.begin(),
+                candidates.end(),
+                [&lighter](size_t lhs, size_t rhs) {
+                    return lighter(rhs, lhs);
+                });
+        for (size_t candidate: candidates) {
+            assembler.jump(
+                    BPF_JEQ,
+                    syscalls[candidate],
+                    syscallLabels[candidate],
+                    NEXT);
+        }
+        assembler.ret(defaultAction);
+        return;
+    }
+
+    size_t middle = candidates.size() / 2;
+    if (totalWeight != 0) {
+        // First candidate that takes lower half's weight over half of total
+        uint64_t lowerWeight = 0;
+        for (middle = 0; lowerWeight * 2 < totalWeight; ++middle) {
+            lowerWeight += weights[candidates[middle]];
+        }
+        middle = std::max<size_t>(
+                1, std::min(middle, candidates.size() - 1));
+    }
+
+    std::vector<size_t> lower(candidates.begin(), candidates.begin() + middle);
+    std::vector<size_t> upper(candidates.begin() + middle, candidates.end());
+    int upperHalf = assembler.newLabel();
+    assembler.jump(BPF_JGE, syscalls[upper.front()], upperHalf, NEXT);
+    compileSearch(
+            assembler, syscalls, weights, syscallLabels, lower, defaultAction);
+    assembler.bind(upperHalf);
+    compileSearch(
+            assembler, syscalls, weights, syscallLabels, upper, defaultAction);
+}
+
+} // namespace
+
+namespace s2j {
+namespace seccomp {
+namespace bpf {
+
+void Compiler::addArchitecture(uint32_t arch, uint32_t defaultAction) {
+    architectures_[arch].defaultAction = defaultAction;
+}
+
+void Compiler::addWeight(uint32_t arch, uint32_t syscall, uint64_t weight) {
+    auto architecture = architectures_.find(arch);
+    if (architecture == architectures_.end()) {
+        throw SeccompException(
+                "Seccomp syscall weight for architecture not in filter " +
+                std::to_string(arch));
+    }
+    architecture->second.weights[syscall] += weight;
+}
+
+void Compiler::addRule(
+        uint32_t arch,
+        uint32_t syscall,
+        uint32_t action,
+        const std::vector<struct scmp_arg_cmp>& conditions) {
+    auto architecture = architectures_.find(arch);
+    if (architecture == architectures_.end()) {
+        throw SeccompException(
+                "Seccomp rule for architecture not in filter " +
+                std::to_string(arch));
+    }
+    architecture->second.rules[syscall].push_back(Rule{action, conditions});
+}
+
+std::vector<struct sock_filter> Compiler::compile(
+        uint32_t badArchAction) const {
+    const int NEXT = Assembler::NEXT;
+    Assembler assembler;
+
+    std::vector<int> architectureLabels;
+    assembler.load(ARCH_OFFSET);
+    for (const auto& architecture: architectures_) {
+        architectureLabels.push_back(assembler.newLabel());
+        assembler.jump(
+                BPF_JEQ, architecture.first, architectureLabels.back(), NEXT);
+    }
+    assembler.ret(badArchAction);
+
+    auto architectureLabel = architectureLabels.begin();
+    for (const auto& architecture: architectures_) {
+        bool is64Bit = (architecture.first & __AUDIT_ARCH_64BIT) != 0;
+        uint32_t defaultAction = architecture.second.defaultAction;
+        const auto& rules = architecture.second.rules;
+
+        assembler.bind(*architectureLabel++);
+        assembler.load(NR_OFFSET);
+        if (architecture.first == AUDIT_ARCH_X86_64) {
+            int dispatch = assembler.newLabel();
+            assembler.jump(BPF_JGE, X32_SYSCALL_BIT, NEXT, dispatch);
+            // As in libseccomp, -1 is dispatched like any other syscall
+            assembler.jump(BPF_JEQ, INVALID_SYSCALL, dispatch, NEXT);
+            assembler.ret(badArchAction);
+            assembler.bind(dispatch);
+        }
+
+        std::vector<uint32_t> syscalls;
+        std::vector<uint64_t> weights;
+        std::vector<int> syscallLabels;
+        std::vector<size_t> candidates;
+        for (const auto& syscallRules: rules) {
+            auto weight = architecture.second.weights.find(syscallRules.first);
+            candidates.push_back(syscalls.size());
+            syscalls.push_back(syscallRules.first);
+            weights.push_back(
+                    weight != architecture.second.weights.end() ? weight->second
+                                                                : 0);
+            syscallLabels.push_back(assembler.newLabel());
+        }
+        compileSearch(
+                assembler,
+                syscalls,
+                weights,
+                syscallLabels,
+                candidates,
+                defaultAction);
+
+        auto syscallLabel = syscallLabels.begin();
+        for (const auto& syscallRules: rules) {
+            assembler.bind(*syscallLabel++);
+            bool unconditional = false;
+            for (auto rule = syscallRules.second.rbegin();
+                 rule != syscallRules.second.rend() && !unconditional;
+                 ++rule) {
+                int nextRule = assembler.newLabel();
+                unconditional = true;
+                for (const auto& condition: rule->conditions) {
+                    if (!isAlwaysMet(condition)) {
+                        compileCondition(
+                                assembler, condition, is64Bit, nextRule);
+                        unconditional = false;
+                    }
+                }
+                assembler.ret(rule->action);
+                assembler.bind(nextRule);
+            }
+            // Rules after an unconditional one are never checked
+            if (!unconditional) {
+                assembler.ret(defaultAction);
+            }
+        }
+    }
+
+    return assembler.assemble();
+}
+
+} // namespace bpf
+} // namespace seccomp
+} // namespace s2j
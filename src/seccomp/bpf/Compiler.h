@@ -0,0 +1,76 @@
+#pragma once
+
+#include <linux/filter.h>
+#include <seccomp.h>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace s2j {
+namespace seccomp {
+namespace bpf {
+
+/**
+ * Compiles seccomp rules into a bpf program. Unlike libseccomp, which checks
+ * syscall numbers one after another, it dispatches on syscall number of each
+ * architecture with a binary search, so every syscall is matched in
+ * logarithmic number of instructions.
+ *
+ * Rules of each syscall are checked in reverse order of adding, as libseccomp
+ * does, and the first one with all conditions met gives the action.
+ *
+ * When syscalls are given weights, the search is skewed so that the heavier
+ * ones are found in fewer instructions.
+ */
+class Compiler {
+public:
+    /**
+     * Adds architecture, given by its AUDIT_ARCH_* value, to the filter.
+     * Syscalls without matching rules return defaultAction.
+     */
+    void addArchitecture(uint32_t arch, uint32_t defaultAction);
+
+    /**
+     * Adds rule for syscall number of given architecture. Conditions compare
+     * whole 64 bit arguments on 64 bit architectures and their lower halves
+     * otherwise.
+     */
+    void addRule(
+            uint32_t arch,
+            uint32_t syscall,
+            uint32_t action,
+            const std::vector<struct scmp_arg_cmp>& conditions);
+
+    /**
+     * Adds to weight of syscall number of given architecture, e.g. number of
+     * its calls in a profile. Weights of syscalls without rules are ignored.
+     */
+    void addWeight(uint32_t arch, uint32_t syscall, uint64_t weight);
+
+    /**
+     * Creates program, syscalls of architectures that weren't added (or x32
+     * syscalls on x86_64) return badArchAction.
+     */
+    std::vector<struct sock_filter> compile(uint32_t badArchAction) const;
+
+private:
+    struct Rule {
+        uint32_t action;
+        std::vector<struct scmp_arg_cmp> conditions;
+    };
+
+    struct Architecture {
+        uint32_t defaultAction;
+        // Rules of every syscall, in order of adding
+        std::map<uint32_t, std::vector<Rule>> rules;
+        std::map<uint32_t, uint64_t> weights;
+    };
+
+    // Architectures are checked in order of their AUDIT_ARCH_* values
+    std::map<uint32_t, Architecture> architectures_;
+};
+
+} // namespace bpf
+} // namespace seccomp
+} // namespace s2j
@@ -0,0 +1,179 @@
+#include "Disassembler.h"
+
+#include <linux/seccomp.h>
+
+#include <cstddef>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+#ifndef SECCOMP_RET_KILL_PROCESS
+#define SECCOMP_RET_KILL_PROCESS 0x80000000U
+#endif
+
+#ifndef SECCOMP_RET_ACTION_FULL
+#define SECCOMP_RET_ACTION_FULL 0xffff0000U
+#endif
+
+#ifndef SECCOMP_RET_USER_NOTIF
+#define SECCOMP_RET_USER_NOTIF 0x7fc00000U
+#endif
+
+#ifndef SECCOMP_RET_LOG
+#define SECCOMP_RET_LOG 0x7ffc0000U
+#endif
+
+namespace {
+
+const std::map<uint16_t, std::string> ALU_OPERATIONS{
+        {BPF_ADD, "add"},
+        {BPF_SUB, "sub"},
+        {BPF_MUL, "mul"},
+        {BPF_DIV, "div"},
+        {BPF_OR, "or"},
+        {BPF_AND, "and"},
+        {BPF_LSH, "lsh"},
+        {BPF_RSH, "rsh"},
+        {BPF_NEG, "neg"},
+        {BPF_MOD, "mod"},
+        {BPF_XOR, "xor"}};
+
+const std::map<uint16_t, std::string> JUMP_OPERATIONS{
+        {BPF_JEQ, "jeq"},
+        {BPF_JGT, "jgt"},
+        {BPF_JGE, "jge"},
+        {BPF_JSET, "jset"}};
+
+std::string hex(uint32_t value) {
+    std::stringstream ss;
+    ss << "#0x" << std::hex << value;
+    return ss.str();
+}
+
+std::string describeField(uint32_t offset) {
+    const uint32_t argsOffset = offsetof(struct seccomp_data, args);
+    if (offset == offsetof(struct seccomp_data, nr)) {
+        return "[nr]";
+    }
+    if (offset == offsetof(struct seccomp_data, arch)) {
+        return "[arch]";
+    }
+    if (offset == offsetof(struct seccomp_data, instruction_pointer)) {
+        return "[ip.lo]";
+    }
+    if (offset == offsetof(struct seccomp_data, instruction_pointer) + 4) {
+        return "[ip.hi]";
+    }
+    if (offset >= argsOffset && offset < sizeof(struct seccomp_data) &&
+        offset % sizeof(uint32_t) == 0) {
+        uint32_t word = (offset - argsOffset) / sizeof(uint32_t);
+        return "[args[" + std::to_string(word / 2) + "]." +
+                (word % 2 == 0 ? "lo" : "hi") + "]";
+    }
+    return "[" + std::to_string(offset) + "]";
+}
+
+std::string describeAction(uint32_t value) {
+    uint32_t data = value & SECCOMP_RET_DATA;
+    switch (value & SECCOMP_RET_ACTION_FULL) {
+    case SECCOMP_RET_KILL_PROCESS:
+        return "KILL_PROCESS";
+    case SECCOMP_RET_KILL:
+        return "KILL";
+    case SECCOMP_RET_TRAP:
+        return "TRAP(" + std::to_string(data) + ")";
+    case SECCOMP_RET_ERRNO:
+        return "ERRNO(" + std::to_string(data) + ")";
+    case SECCOMP_RET_USER_NOTIF:
+        return "NOTIFY";
+    case SECCOMP_RET_TRACE:
+        return "TRACE(" + hex(data).substr(1) + ")";
+    case SECCOMP_RET_LOG:
+        return "LOG";
+    case SECCOMP_RET_ALLOW:
+        return "ALLOW";
+    }
+    return hex(value);
+}
+
+std::string disassembleInstruction(
+        const struct sock_filter& instruction,
+        size_t index) {
+    const uint32_t k = instruction.k;
+    const std::string source =
+            BPF_SRC(instruction.code) == BPF_X ? "x" : hex(k);
+
+    switch (BPF_CLASS(instruction.code)) {
+    case BPF_LD:
+    case BPF_LDX: {
+        std::string name = BPF_CLASS(instruction.code) == BPF_LD ? "ld" : "ldx";
+        switch (BPF_MODE(instruction.code)) {
+        case BPF_ABS:
+            return name + " " + describeField(k);
+        case BPF_LEN:
+            return name + " #len";
+        case BPF_IMM:
+            return name + " " + hex(k);
+        case BPF_MEM:
+            return name + " M[" + std::to_string(k) + "]";
+        }
+        break;
+    }
+    case BPF_ST:
+        return "st M[" + std::to_string(k) + "]";
+    case BPF_STX:
+        return "stx M[" + std::to_string(k) + "]";
+    case BPF_ALU: {
+        auto operation = ALU_OPERATIONS.find(BPF_OP(instruction.code));
+        if (operation == ALU_OPERATIONS.end()) {
+            break;
+        }
+        if (BPF_OP(instruction.code) == BPF_NEG) {
+            return operation->second;
+        }
+        return operation->second + " " + source;
+    }
+    case BPF_JMP: {
+        if (BPF_OP(instruction.code) == BPF_JA) {
+            return "ja " + std::to_string(index + 1 + k);
+        }
+        auto operation = JUMP_OPERATIONS.find(BPF_OP(instruction.code));
+        if (operation == JUMP_OPERATIONS.end()) {
+            break;
+        }
+        return operation->second + " " + source + ", " +
+                std::to_string(index + 1 + instruction.jt) + ", " +
+                std::to_string(index + 1 + instruction.jf);
+    }
+    case BPF_RET:
+        if (BPF_RVAL(instruction.code) == BPF_A) {
+            return "ret a";
+        }
+        return "ret " + describeAction(k);
+    case BPF_MISC:
+        return BPF_MISCOP(instruction.code) == BPF_TAX ? "tax" : "txa";
+    }
+
+    std::stringstream ss;
+    ss << "unknown code 0x" << std::hex << instruction.code;
+    return ss.str();
+}
+
+} // namespace
+
+namespace s2j {
+namespace seccomp {
+namespace bpf {
+
+std::string disassemble(const std::vector<struct sock_filter>& program) {
+    std::stringstream ss;
+    for (size_t index = 0; index < program.size(); ++index) {
+        ss << std::setw(5) << index << ": "
+           << disassembleInstruction(program[index], index) << std::endl;
+    }
+    return ss.str();
+}
+
+} // namespace bpf
+} // namespace seccomp
+} // namespace s2j
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <linux/filter.h>
+
+#include <string>
+#include <vector>
+
+namespace s2j {
+namespace seccomp {
+namespace bpf {
+
+/**
+ * Prints program one instruction per line, with seccomp_data fields and
+ * filter return values named, e.g.:
+ *
+ *      0: ld [arch]
+ *      1: jeq #0xc000003e, 3, 2
+ *      2: ret KILL
+ */
+std::string disassemble(const std::vector<struct sock_filter>& program);
+
+} // namespace bpf
+} // namespace seccomp
+} // namespace s2j
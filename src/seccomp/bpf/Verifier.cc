@@ -0,0 +1,115 @@
+#include "Verifier.h"
+
+#include "seccomp/SeccompException.h"
+
+#include <linux/seccomp.h>
+
+#include <string>
+
+namespace {
+
+void fail(size_t index, const std::string& reason) {
+    throw s2j::seccomp::SeccompException(
+            "Invalid bpf instruction " + std::to_string(index) + ": " +
+            reason);
+}
+
+} // namespace
+
+namespace s2j {
+namespace seccomp {
+namespace bpf {
+
+void verify(const std::vector<struct sock_filter>& program) {
+    if (program.empty() || program.size() > BPF_MAXINSNS) {
+        throw SeccompException(
+                "Invalid bpf program size " + std::to_string(program.size()));
+    }
+
+    for (size_t index = 0; index < program.size(); ++index) {
+        const struct sock_filter& instruction = program[index];
+        // Instructions that can follow this one
+        size_t remaining = program.size() - index - 1;
+
+        switch (instruction.code) {
+        case BPF_LD | BPF_W | BPF_ABS:
+            if (instruction.k >= sizeof(struct seccomp_data) ||
+                instruction.k % sizeof(uint32_t) != 0) {
+                fail(index, "load outside of seccomp_data");
+            }
+            break;
+        case BPF_LD | BPF_W | BPF_LEN:
+        case BPF_LDX | BPF_W | BPF_LEN:
+        case BPF_LD | BPF_IMM:
+        case BPF_LDX | BPF_IMM:
+        case BPF_MISC | BPF_TAX:
+        case BPF_MISC | BPF_TXA:
+        case BPF_RET | BPF_K:
+        case BPF_RET | BPF_A:
+        case BPF_ALU | BPF_NEG:
+            break;
+        case BPF_LD | BPF_MEM:
+        case BPF_LDX | BPF_MEM:
+        case BPF_ST:
+        case BPF_STX:
+            if (instruction.k >= BPF_MEMWORDS) {
+                fail(index, "scratch memory index out of range");
+            }
+            break;
+        case BPF_ALU | BPF_ADD | BPF_K:
+        case BPF_ALU | BPF_ADD | BPF_X:
+        case BPF_ALU | BPF_SUB | BPF_K:
+        case BPF_ALU | BPF_SUB | BPF_X:
+        case BPF_ALU | BPF_MUL | BPF_K:
+        case BPF_ALU | BPF_MUL | BPF_X:
+        case BPF_ALU | BPF_DIV | BPF_X:
+        case BPF_ALU | BPF_AND | BPF_K:
+        case BPF_ALU | BPF_AND | BPF_X:
+        case BPF_ALU | BPF_OR | BPF_K:
+        case BPF_ALU | BPF_OR | BPF_X:
+        case BPF_ALU | BPF_XOR | BPF_K:
+        case BPF_ALU | BPF_XOR | BPF_X:
+        case BPF_ALU | BPF_LSH | BPF_X:
+        case BPF_ALU | BPF_RSH | BPF_X:
+            break;
+        case BPF_ALU | BPF_DIV | BPF_K:
+            if (instruction.k == 0) {
+                fail(index, "division by zero");
+            }
+            break;
+        case BPF_ALU | BPF_LSH | BPF_K:
+        case BPF_ALU | BPF_RSH | BPF_K:
+            if (instruction.k >= 32) {
+                fail(index, "shift out of range");
+            }
+            break;
+        case BPF_JMP | BPF_JA:
+            if (instruction.k >= remaining) {
+                fail(index, "jump out of program");
+            }
+            break;
+        case BPF_JMP | BPF_JEQ | BPF_K:
+        case BPF_JMP | BPF_JEQ | BPF_X:
+        case BPF_JMP | BPF_JGE | BPF_K:
+        case BPF_JMP | BPF_JGE | BPF_X:
+        case BPF_JMP | BPF_JGT | BPF_K:
+        case BPF_JMP | BPF_JGT | BPF_X:
+        case BPF_JMP | BPF_JSET | BPF_K:
+        case BPF_JMP | BPF_JSET | BPF_X:
+            if (instruction.jt >= remaining || instruction.jf >= remaining) {
+                fail(index, "jump out of program");
+            }
+            break;
+        default:
+            fail(index, "opcode not allowed in seccomp filters");
+        }
+    }
+
+    if (BPF_CLASS(program.back().code) != BPF_RET) {
+        fail(program.size() - 1, "program doesn't end with return");
+    }
+}
+
+} // namespace bpf
+} // namespace seccomp
+} // namespace s2j
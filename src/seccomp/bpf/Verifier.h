@@ -0,0 +1,24 @@
+#pragma once
+
+#include <linux/filter.h>
+
+#include <vector>
+
+namespace s2j {
+namespace seccomp {
+namespace bpf {
+
+/**
+ * Checks program against rules of kernel's seccomp filter checker: only
+ * instructions allowed in seccomp filters, aligned loads within seccomp_data,
+ * forward jumps within the program and a return at its end. Throws
+ * SeccompException describing the first violation.
+ *
+ * Kernel would refuse such programs too, but only when loading them in the
+ * child, where errors are much harder to report.
+ */
+void verify(const std::vector<struct sock_filter>& program);
+
+} // namespace bpf
+} // namespace seccomp
+} // namespace s2j
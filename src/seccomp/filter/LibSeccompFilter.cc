@@ -21,6 +21,10 @@ bool LibSeccompFilter::match(
             [&](auto& filter) { return filter(event, tracee); });
 }
 
+bool LibSeccompFilter::hasConditions() const {
+    return !libSeccompFilterConditions_.empty();
+}
+
 const std::vector<struct scmp_arg_cmp>&
 LibSeccompFilter::createLibSeccompFilter() const {
     return libSeccompFilterConditions_;
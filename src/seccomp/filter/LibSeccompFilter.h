@@ -26,6 +26,8 @@ public:
     bool match(const tracer::TraceEvent& event, tracer::Tracee& tracee)
             const override;
 
+    bool hasConditions() const;
+
     /* Filters can be joined tohegher. */
     LibSeccompFilter operator&&(const LibSeccompFilter& filter) const;
 
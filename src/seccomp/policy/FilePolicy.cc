@@ -0,0 +1,277 @@
+#include "FilePolicy.h"
+#include "DefaultPolicy.h"
+#include "PermissivePolicy.h"
+
+#include "common/Exception.h"
+#include "seccomp/action/ActionAllow.h"
+#include "seccomp/action/ActionBudget.h"
+#include "seccomp/action/ActionErrno.h"
+#include "seccomp/action/ActionKill.h"
+#include "seccomp/action/ActionTrace.h"
+#include "seccomp/filter/LibSeccompFilter.h"
+
+#include <cerrno>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace {
+
+// Names of errors that policies usually return
+const std::map<std::string, uint64_t> ERRNO_NUMBERS{
+        {"EPERM", EPERM},
+        {"ENOENT", ENOENT},
+        {"EBADF", EBADF},
+        {"EAGAIN", EAGAIN},
+        {"ENOMEM", ENOMEM},
+        {"EACCES", EACCES},
+        {"EFAULT", EFAULT},
+        {"EEXIST", EEXIST},
+        {"EINVAL", EINVAL},
+        {"ENOTTY", ENOTTY},
+        {"ESPIPE", ESPIPE},
+        {"EROFS", EROFS},
+        {"ENOSYS", ENOSYS},
+};
+
+const uint8_t SYSCALL_ARGUMENTS_COUNT = 6;
+
+} // namespace
+
+namespace s2j {
+namespace seccomp {
+namespace policy {
+
+const int FilePolicy::MAX_INCLUDE_DEPTH = 16;
+
+FilePolicy::FilePolicy(const std::string& path) : FilePolicy(load(path, 0)) {}
+
+FilePolicy::FilePolicy(Policy policy)
+        : BaseSyscallPolicy(
+                  policy.defaultAction != nullptr
+                          ? policy.defaultAction
+                          : std::make_shared<action::ActionKill>())
+        , rules_(std::move(policy.rules)) {}
+
+const std::vector<SeccompRule>& FilePolicy::getRules() const {
+    return rules_;
+}
+
+FilePolicy::Policy FilePolicy::load(const std::string& path, int depth) {
+    if (depth > MAX_INCLUDE_DEPTH) {
+        throw Exception("policy includes are nested too deeply");
+    }
+
+    std::ifstream policyFile(path);
+    if (!policyFile.is_open()) {
+        throw Exception("can't open policy file " + path);
+    }
+
+    Policy included;
+    Policy policy;
+    std::set<uint32_t> overriddenSyscalls;
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(policyFile, line); ++lineNumber) {
+        std::stringstream lineStream(line.substr(0, line.find('#')));
+        std::vector<std::string> tokens;
+        for (std::string token; lineStream >> token;) {
+            tokens.push_back(token);
+        }
+        if (tokens.empty()) {
+            continue;
+        }
+
+        try {
+            if (tokens[0] == "include") {
+                if (tokens.size() != 2) {
+                    throw Exception("include needs a single policy");
+                }
+                auto includedPolicy = loadInclude(tokens[1], path, depth);
+                if (includedPolicy.defaultAction != nullptr) {
+                    included.defaultAction = includedPolicy.defaultAction;
+                }
+                included.rules.insert(
+                        included.rules.end(),
+                        includedPolicy.rules.begin(),
+                        includedPolicy.rules.end());
+            }
+            else if (tokens[0] == "default") {
+                size_t index = 1;
+                policy.defaultAction = parseAction(tokens, index);
+                if (index != tokens.size()) {
+                    throw Exception("default action can't have conditions");
+                }
+            }
+            else if (tokens[0] == "drop") {
+                for (size_t index = 1; index < tokens.size(); ++index) {
+                    overriddenSyscalls.insert(
+                            SeccompRule::resolveSyscallName(tokens[index]));
+                }
+            }
+            else {
+                size_t index = 1;
+                auto action = parseAction(tokens, index);
+                SeccompRule rule(
+                        tokens[0], action, parseConditions(tokens, index));
+                overriddenSyscalls.insert(rule.syscall);
+                policy.rules.push_back(std::move(rule));
+            }
+        }
+        catch (const Exception& ex) {
+            throw Exception(
+                    path + ":" + std::to_string(lineNumber) + ": " +
+                    ex.what());
+        }
+    }
+
+    if (policy.defaultAction == nullptr) {
+        policy.defaultAction = included.defaultAction;
+    }
+    std::vector<SeccompRule> rules;
+    for (auto& rule: included.rules) {
+        if (overriddenSyscalls.count(rule.syscall) == 0) {
+            rules.push_back(std::move(rule));
+        }
+    }
+    rules.insert(rules.end(), policy.rules.begin(), policy.rules.end());
+    policy.rules = std::move(rules);
+    return policy;
+}
+
+FilePolicy::Policy FilePolicy::loadInclude(
+        const std::string& target,
+        const std::string& includingPath,
+        int depth) {
+    if (target == "<default>") {
+        DefaultPolicy defaultPolicy;
+        return {defaultPolicy.getDefaultAction(), defaultPolicy.getRules()};
+    }
+    if (target == "<permissive>") {
+        PermissivePolicy permissivePolicy;
+        return {permissivePolicy.getDefaultAction(),
+                permissivePolicy.getRules()};
+    }
+
+    std::string path = target;
+    size_t directoryEnd = includingPath.rfind('/');
+    if (path.front() != '/' && directoryEnd != std::string::npos) {
+        path = includingPath.substr(0, directoryEnd + 1) + path;
+    }
+    return load(path, depth + 1);
+}
+
+std::shared_ptr<action::SeccompAction> FilePolicy::parseAction(
+        const std::vector<std::string>& tokens,
+        size_t& index) {
+    if (index >= tokens.size()) {
+        throw Exception("missing action");
+    }
+
+    const std::string& action = tokens[index++];
+    if (action == "allow") {
+        return std::make_shared<action::ActionAllow>();
+    }
+    if (action == "kill") {
+        return std::make_shared<action::ActionKill>();
+    }
+    if (action == "trace") {
+        return std::make_shared<action::ActionTrace>();
+    }
+    if (action == "budget") {
+        if (index >= tokens.size()) {
+            throw Exception("missing budget");
+        }
+        uint64_t budget = parseNumber(tokens[index++]);
+        return std::make_shared<action::ActionBudget>(
+                budget, parseAction(tokens, index));
+    }
+    if (action == "errno") {
+        if (index >= tokens.size()) {
+            throw Exception("missing errno value");
+        }
+        const std::string& value = tokens[index++];
+        auto errnoNumber = ERRNO_NUMBERS.find(value);
+        return std::make_shared<action::ActionErrno>(
+                errnoNumber != ERRNO_NUMBERS.end() ? errnoNumber->second
+                                                   : parseNumber(value));
+    }
+    throw Exception("unknown action \"" + action + "\"");
+}
+
+std::shared_ptr<filter::SyscallFilter> FilePolicy::parseConditions(
+        const std::vector<std::string>& tokens,
+        size_t index) {
+    filter::LibSeccompFilter conditions;
+    while (index < tokens.size()) {
+        const std::string& argument = tokens[index];
+        if (argument.size() != 4 || argument.compare(0, 3, "arg") != 0 ||
+            argument[3] < '0' ||
+            argument[3] >= '0' + SYSCALL_ARGUMENTS_COUNT) {
+            throw Exception("expected argument, got \"" + argument + "\"");
+        }
+        filter::SyscallArg syscallArg(argument[3] - '0');
+
+        if (index + 2 >= tokens.size()) {
+            throw Exception("incomplete condition");
+        }
+        if (tokens[index + 1] == "&") {
+            if (index + 4 >= tokens.size() || tokens[index + 3] != "==") {
+                throw Exception("masked argument can only be compared with ==");
+            }
+            conditions = conditions &&
+                    ((syscallArg & parseNumber(tokens[index + 2])) ==
+                     parseNumber(tokens[index + 4]));
+            index += 5;
+            continue;
+        }
+
+        const std::string& op = tokens[index + 1];
+        uint64_t value = parseNumber(tokens[index + 2]);
+        if (op == "==") {
+            conditions = conditions && (syscallArg == value);
+        }
+        else if (op == "!=") {
+            conditions = conditions && (syscallArg != value);
+        }
+        else if (op == "<=") {
+            conditions = conditions && (syscallArg <= value);
+        }
+        else if (op == ">=") {
+            conditions = conditions && (syscallArg >= value);
+        }
+        else if (op == "<") {
+            conditions = conditions && (syscallArg < value);
+        }
+        else if (op == ">") {
+            conditions = conditions && (syscallArg > value);
+        }
+        else {
+            throw Exception("unknown comparison \"" + op + "\"");
+        }
+        index += 3;
+    }
+    return std::make_shared<filter::LibSeccompFilter>(conditions);
+}
+
+uint64_t FilePolicy::parseNumber(const std::string& token) {
+    // Only hex is recognized by prefix, leading zeros don't make it octal.
+    bool hex = token.compare(0, 2, "0x") == 0 || token.compare(0, 2, "0X") == 0;
+    size_t end = 0;
+    uint64_t number = 0;
+    try {
+        number = std::stoull(token, &end, hex ? 16 : 10);
+    }
+    catch (const std::exception&) {
+        end = 0;
+    }
+    if (end == 0 || end != token.size() || token.front() == '-') {
+        throw Exception("invalid number \"" + token + "\"");
+    }
+    return number;
+}
+
+} // namespace policy
+} // namespace seccomp
+} // namespace s2j
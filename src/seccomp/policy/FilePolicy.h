@@ -0,0 +1,82 @@
+#pragma once
+
+#include "SyscallPolicy.h"
+#include "seccomp/SeccompRule.h"
+#include "seccomp/action/SeccompAction.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace s2j {
+namespace seccomp {
+namespace policy {
+
+/**
+ * Syscall policy read from a policy file, so that policies can be tweaked,
+ * e.g. for a single language, without rebuilding sio2jail.
+ *
+ * Each line of the file, with "#" starting a comment, is one of:
+ *
+ *   <syscall> <action> [arg<n> <op> <value> | arg<n> & <mask> == <value>]...
+ *   default <action>
+ *   drop <syscall>...
+ *   include <path>
+ *   include <default>|<permissive>
+ *
+ * where action is "allow", "kill", "trace", "errno <number or name>" or
+ * "budget <calls> <action>", op is one of ==, !=, <=, >=, < and >, and all
+ * conditions of a rule have to be met. Rules of a syscall are checked in
+ * reverse order of lines.
+ *
+ * Included policy, given by path relative to the including file or by name
+ * of a builtin policy, provides rules and default action that the including
+ * file overrides. Rules of a syscall given in a file, or dropped with
+ * "drop", replace all rules of that syscall from its included policies.
+ * Without default action anywhere, syscalls are killed.
+ */
+class FilePolicy : public BaseSyscallPolicy {
+public:
+    explicit FilePolicy(const std::string& path);
+
+    const std::vector<SeccompRule>& getRules() const override;
+
+private:
+    struct Policy {
+        std::shared_ptr<action::SeccompAction> defaultAction;
+        std::vector<SeccompRule> rules;
+    };
+
+    explicit FilePolicy(Policy policy);
+
+    static Policy load(const std::string& path, int depth);
+    static Policy loadInclude(
+            const std::string& target,
+            const std::string& includingPath,
+            int depth);
+
+    /**
+     * Parses action starting at given token, which is advanced past it.
+     */
+    static std::shared_ptr<action::SeccompAction> parseAction(
+            const std::vector<std::string>& tokens,
+            size_t& index);
+
+    /**
+     * Parses conditions from given token to the end of line.
+     */
+    static std::shared_ptr<filter::SyscallFilter> parseConditions(
+            const std::vector<std::string>& tokens,
+            size_t index);
+
+    static uint64_t parseNumber(const std::string& token);
+
+    static const int MAX_INCLUDE_DEPTH;
+
+    std::vector<SeccompRule> rules_;
+};
+
+} // namespace policy
+} // namespace seccomp
+} // namespace s2j
@@ -61,6 +61,7 @@ executor::ExecuteAction TraceExecutor::onExecuteEvent(
         const executor::ExecuteEvent& executeEvent) {
     TRACE();
 
+    auto stopTime = std::chrono::steady_clock::now();
     TraceEvent event{executeEvent};
     auto traceeInfo = rootTraceeInfo_->getProcess(event.executeEvent.pid);
     if (traceeInfo == nullptr) {
@@ -112,6 +113,9 @@ executor::ExecuteAction TraceExecutor::onExecuteEvent(
         action = std::max(action, std::get<0>(handleSignalResult));
 
         continueTracee(action, std::get<1>(handleSignalResult), event, tracee);
+
+        stopsCount_++;
+        stopsTime_ += std::chrono::steady_clock::now() - stopTime;
     }
 
     if (action == TraceAction::KILL) {
@@ -121,6 +125,15 @@ executor::ExecuteAction TraceExecutor::onExecuteEvent(
     return executor::ExecuteAction::CONTINUE;
 }
 
+void TraceExecutor::onPostExecute() {
+    TRACE();
+
+    outputBuilder_->setTracedStops(
+            stopsCount_,
+            std::chrono::duration_cast<std::chrono::microseconds>(stopsTime_)
+                    .count());
+}
+
 TraceAction TraceExecutor::onEventExec(
         const TraceEvent& event,
         Tracee& tracee) {
@@ -156,6 +169,33 @@ TraceAction TraceExecutor::onEventClone(
             nullptr,
             PTRACE_OPTIONS);
 
+    if (setoptsResult.getErrnoCode() == ESRCH) {
+        // Child may be reported before it enters its initial stop, wait for
+        // it instead of leaving it stopped once its stop gets delayed as an
+        // event of unknown process. It may also be killed before the stop,
+        // then it is gone as if the clone failed.
+        siginfo_t waitInfo{};
+        auto waitResult = withErrnoCheck(
+                "waitid for cloned child",
+                {ECHILD},
+                waitid,
+                P_PID,
+                traceeChildPid,
+                &waitInfo,
+                WSTOPPED | WEXITED | __WALL);
+        if (waitResult.getErrnoCode() == 0 &&
+            waitInfo.si_code == CLD_TRAPPED) {
+            setoptsResult = withErrnoCheck(
+                    "ptrace setopts child",
+                    {ESRCH},
+                    ptrace,
+                    PTRACE_SETOPTIONS,
+                    traceeChildPid,
+                    nullptr,
+                    PTRACE_OPTIONS);
+        }
+    }
+
     if (setoptsResult.getErrnoCode() == ESRCH) {
         // Clone syscall failed (e.g. clone3 returned ENOSYS), child doesn't
         // exist. This is expected when glibc falls back from clone3 to clone.
@@ -270,6 +310,7 @@ void TraceExecutor::continueTracee(
         }
     }
 
+    tracee.flushRegisters();
     withErrnoCheck(
             "ptrace cont",
             {ESRCH},
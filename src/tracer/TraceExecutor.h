@@ -10,6 +10,7 @@
 #include "executor/ExecuteEventListener.h"
 #include "printer/OutputSource.h"
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
 #include <tuple>
@@ -29,6 +30,7 @@ public:
     void onPostForkParent(pid_t childPid) override;
     executor::ExecuteAction onExecuteEvent(
             const executor::ExecuteEvent& executeEvent) override;
+    void onPostExecute() override;
 
     const static Feature feature;
 
@@ -52,6 +54,11 @@ private:
 
     std::shared_ptr<ProcessInfo> rootTraceeInfo_;
     bool hasExecved_{false};
+
+    // Number of tracee stops and total time from their reporting until
+    // tracee was resumed
+    uint64_t stopsCount_{};
+    std::chrono::steady_clock::duration stopsTime_{};
 };
 
 } // namespace tracer
@@ -3,35 +3,99 @@
 #include "common/Assert.h"
 #include "common/Exception.h"
 #include "common/WithErrnoCheck.h"
+#include "logger/Logger.h"
 
+#include <linux/audit.h>
 #include <sys/ptrace.h>
 
+#include <algorithm>
 #include <csignal>
 #include <cstdint>
+#include <iterator>
+
+#ifndef PTRACE_GET_SYSCALL_INFO
+#define PTRACE_GET_SYSCALL_INFO 0x420e
+#endif
+
+namespace {
+
+/**
+ * Layout of struct ptrace_syscall_info, defined here as older headers
+ * lack it.
+ */
+struct SyscallInfo {
+    uint8_t op;
+    uint8_t pad[3];
+    uint32_t arch;
+    uint64_t instructionPointer;
+    uint64_t stackPointer;
+    struct {
+        uint64_t nr;
+        uint64_t args[6];
+        uint32_t retData;
+    } seccomp;
+};
+
+const uint8_t SYSCALL_INFO_OP_SECCOMP = 3;
+
+} // namespace
 
 namespace s2j {
 namespace tracer {
 
+bool Tracee::syscallInfoSupported_ = true;
+
 Tracee::Tracee(std::shared_ptr<ProcessInfo> traceeInfo)
         : traceeInfo_{std::move(traceeInfo)}, syscallArch_{Arch::UNKNOWN} {
     assert(traceeInfo_ != nullptr);
+}
 
-    if (isAlive()) {
-        try {
-            withErrnoCheck(
-                    "ptrace getregs",
-                    ptrace,
-                    PTRACE_GETREGS,
-                    getPid(),
-                    nullptr,
-                    &regs_);
-        }
-        catch (const SystemException& e) {
-            if (e.getErrno() != ESRCH) {
-                throw;
-            }
-        }
+Tracee::Tracee(
+        std::shared_ptr<ProcessInfo> traceeInfo,
+        Arch syscallArch,
+        uint64_t syscallNumber,
+        const uint64_t (&syscallArguments)[6])
+        : traceeInfo_{std::move(traceeInfo)}
+        , hasSeccompStopInfo_{true}
+        , syscallNumber_{syscallNumber}
+        , notification_{true}
+        , syscallArch_{syscallArch} {
+    assert(traceeInfo_ != nullptr);
+    std::copy(
+            std::begin(syscallArguments),
+            std::end(syscallArguments),
+            std::begin(syscallArguments_));
+}
+
+user_regs_struct& Tracee::getRegisters() const {
+    if (!regsFetched_) {
+        // Registers of a process that is already gone read as zeros
+        withErrnoCheck(
+                "ptrace getregs",
+                {ESRCH},
+                ptrace,
+                PTRACE_GETREGS,
+                getPid(),
+                nullptr,
+                &regs_);
+        regsFetched_ = true;
+    }
+    return regs_;
+}
+
+void Tracee::flushRegisters() {
+    if (!regsDirty_) {
+        return;
     }
+    regsDirty_ = false;
+    withErrnoCheck(
+            "ptrace setregs",
+            {ESRCH},
+            ptrace,
+            PTRACE_SETREGS,
+            getPid(),
+            nullptr,
+            &regs_);
 }
 
 bool Tracee::isAlive() {
@@ -50,6 +114,53 @@ int64_t Tracee::getEventMsg() {
     return code;
 }
 
+bool Tracee::fetchSeccompStopInfo() {
+    if (!syscallInfoSupported_) {
+        return false;
+    }
+
+    SyscallInfo info{};
+    auto result = withErrnoCheck(
+            "ptrace get syscall info",
+            {EIO, EINVAL},
+            ptrace,
+            static_cast<__ptrace_request>(PTRACE_GET_SYSCALL_INFO),
+            getPid(),
+            sizeof(info),
+            &info);
+    if (result.getErrnoCode() == EIO || result.getErrnoCode() == EINVAL) {
+        logger::debug("PTRACE_GET_SYSCALL_INFO not supported, falling back");
+        syscallInfoSupported_ = false;
+        return false;
+    }
+    if (info.op != SYSCALL_INFO_OP_SECCOMP) {
+        return false;
+    }
+
+    if (info.arch == AUDIT_ARCH_X86_64) {
+        syscallArch_ = Arch::X86_64;
+    }
+    else if (info.arch == AUDIT_ARCH_I386) {
+        syscallArch_ = Arch::X86;
+    }
+    else {
+        syscallArch_ = Arch::UNKNOWN;
+    }
+    syscallNumber_ = info.seccomp.nr;
+    std::copy(
+            std::begin(info.seccomp.args),
+            std::end(info.seccomp.args),
+            std::begin(syscallArguments_));
+    seccompData_ = info.seccomp.retData;
+    hasSeccompStopInfo_ = true;
+    return true;
+}
+
+uint32_t Tracee::getSeccompData() const {
+    assert(hasSeccompStopInfo_, "seccomp stop info was fetched");
+    return seccompData_;
+}
+
 void Tracee::setSyscallArch(Arch arch) {
     syscallArch_ = arch;
 }
@@ -62,79 +173,92 @@ reg_t Tracee::getSyscallNumber() {
     if (syscallArch_ == Arch::UNKNOWN) {
         throw Exception("Can't get syscall number, unknown syscall arch");
     }
+    if (hasSeccompStopInfo_) {
+        return syscallNumber_;
+    }
+    const auto& regs = getRegisters();
 #if defined(__x86_64__)
-    return regs_.orig_rax;
+    return regs.orig_rax;
 #elif defined(__i386__)
-    return regs_.orig_eax;
+    return regs.orig_eax;
 #else
 #error "arch not supported"
 #endif
 }
 
 reg_t Tracee::getSyscallArgument(uint8_t argumentNumber) {
+    if (hasSeccompStopInfo_ && syscallArch_ != Arch::UNKNOWN &&
+        argumentNumber < 6) {
+        if (syscallArch_ == Arch::X86) {
+            return static_cast<uint32_t>(syscallArguments_[argumentNumber]);
+        }
+        return syscallArguments_[argumentNumber];
+    }
+
+    const auto& regs = getRegisters();
 #if defined(__x86_64__)
     if (syscallArch_ == Arch::X86) {
         switch (argumentNumber) {
         case 0:
-            return static_cast<uint32_t>(regs_.rbx);
+            return static_cast<uint32_t>(regs.rbx);
 
         case 1:
-            return static_cast<uint32_t>(regs_.rcx);
+            return static_cast<uint32_t>(regs.rcx);
 
         case 2:
-            return static_cast<uint32_t>(regs_.rdx);
+            return static_cast<uint32_t>(regs.rdx);
 
         case 3:
-            return static_cast<uint32_t>(regs_.rsi);
+            return static_cast<uint32_t>(regs.rsi);
 
         case 4:
-            return static_cast<uint32_t>(regs_.rdi);
+            return static_cast<uint32_t>(regs.rdi);
 
         case 5:
-            return static_cast<uint32_t>(regs_.rbp);
+            return static_cast<uint32_t>(regs.rbp);
         }
     }
     else if (syscallArch_ == Arch::X86_64) {
         switch (argumentNumber) {
         case 0:
-            return regs_.rdi;
+            return regs.rdi;
 
         case 1:
-            return regs_.rsi;
+            return regs.rsi;
 
         case 2:
-            return regs_.rdx;
+            return regs.rdx;
 
         case 3:
-            return regs_.r10;
+            return regs.r10;
 
         case 4:
-            return regs_.r8;
+            return regs.r8;
 
         case 5:
-            return regs_.r9;
+            return regs.r9;
         }
     }
 #elif defined(__i386__)
     if (syscallArch_ == Arch::X86) {
         switch (argumentNumber) {
         case 0:
-            return static_cast<uint32_t>(regs_.ebx);
+            return static_cast<uint32_t>(regs.ebx);
 
         case 1:
-            return static_cast<uint32_t>(regs_.ecx);
+            return static_cast<uint32_t>(regs.ecx);
 
         case 2:
-            return static_cast<uint32_t>(regs_.edx);
+            return static_cast<uint32_t>(regs.edx);
 
         case 3:
-            return static_cast<uint32_t>(regs_.esi);
+            return static_cast<uint32_t>(regs.esi);
 
         case 4:
-            return static_cast<uint32_t>(regs_.edi);
+            return static_cast<uint32_t>(regs.edi);
 
         case 5:
-            return static_cast<uint32_t>(regs_.ebp);
+            return static_cast<uint32_t>(regs.ebp);
         }
     }
     else if (syscallArch_ == Arch::X86_64) {
@@ -178,53 +302,50 @@ std::string Tracee::getMemoryString(
 }
 
 reg_t Tracee::getInstructionPointer() const {
+    const auto& regs = getRegisters();
 #if defined(__x86_64__)
-    return regs_.rip;
+    return regs.rip;
 #elif defined(__i386__)
-    return regs_.eip;
+    return regs.eip;
 #else
 #error "arch not supported"
 #endif
 }
 
 void Tracee::setRegisters(reg_t rip, reg_t rax, reg_t rdx) {
+    auto& regs = getRegisters();
 #if defined(__x86_64__)
-    regs_.rip = rip;
-    regs_.rax = rax;
-    regs_.rdx = rdx;
+    regs.rip = rip;
+    regs.rax = rax;
+    regs.rdx = rdx;
 #elif defined(__i386__)
-    regs_.eip = rip;
-    regs_.eax = rax;
-    regs_.edx = rdx;
+    regs.eip = rip;
+    regs.eax = rax;
+    regs.edx = rdx;
 #else
 #error "arch not supported"
 #endif
-    withErrnoCheck(
-            "ptrace setregs",
-            ptrace,
-            PTRACE_SETREGS,
-            getPid(),
-            nullptr,
-            &regs_);
+    regsDirty_ = true;
 }
 
 void Tracee::cancelSyscall(reg_t returnValue) {
+    syscallCancelled_ = true;
+    syscallReturnValue_ = returnValue;
+    if (notification_) {
+        return;
+    }
+
+    auto& regs = getRegisters();
 #if defined(__x86_64__)
-    regs_.orig_rax = -1;
-    regs_.rax = returnValue;
+    regs.orig_rax = -1;
+    regs.rax = returnValue;
 #elif defined(__i386__)
-    regs_.orig_eax = -1;
-    regs_.eax = returnValue;
+    regs.orig_eax = -1;
+    regs.eax = returnValue;
 #else
 #error "arch not supported"
 #endif
-    withErrnoCheck(
-            "ptrace setregs",
-            ptrace,
-            PTRACE_SETREGS,
-            getPid(),
-            nullptr,
-            &regs_);
+    regsDirty_ = true;
 }
 
 } // namespace tracer
@@ -25,6 +25,17 @@ class Tracee {
 public:
     Tracee(std::shared_ptr<ProcessInfo> traceeInfo);
 
+    /**
+     * Tracee for syscall reported by seccomp user notification. Process is
+     * not stopped, so only syscall related functions can be used and
+     * cancelSyscall only records result that should be returned.
+     */
+    Tracee(
+            std::shared_ptr<ProcessInfo> traceeInfo,
+            Arch syscallArch,
+            uint64_t syscallNumber,
+            const uint64_t (&syscallArguments)[6]);
+
     pid_t getPid() const {
         return traceeInfo_->getPid();
     }
@@ -43,6 +54,19 @@ public:
      */
     int64_t getEventMsg();
 
+    /**
+     * Reads syscall arch, number and arguments of a seccomp stop in one call
+     * using PTRACE_GET_SYSCALL_INFO (Linux 5.3+). Returns false if kernel
+     * doesn't support it, in which case caller has to fall back to
+     * getEventMsg and setSyscallArch.
+     */
+    bool fetchSeccompStopInfo();
+
+    /**
+     * Returns SECCOMP_RET_DATA of seccomp stop read by fetchSeccompStopInfo.
+     */
+    uint32_t getSeccompData() const;
+
     /**
      * Syscall related functions, will work only with seccomp listener.
      */
@@ -52,10 +76,23 @@ public:
     reg_t getSyscallArgument(uint8_t argumentNumber);
 
     void cancelSyscall(reg_t returnValue);
+    bool isSyscallCancelled() const {
+        return syscallCancelled_;
+    }
+    reg_t getSyscallReturnValue() const {
+        return syscallReturnValue_;
+    }
 
     reg_t getInstructionPointer() const;
     void setRegisters(reg_t rip, reg_t rax, reg_t rdx);
 
+    /**
+     * Registers are fetched lazily on first access and modifications are
+     * kept locally, this writes them back to the process. Must be called
+     * before tracee is resumed.
+     */
+    void flushRegisters();
+
     void suppressSignal() { signalSuppressed_ = true; }
     bool isSignalSuppressed() const { return signalSuppressed_; }
 
@@ -66,11 +103,26 @@ public:
     // ...
 
 private:
+    user_regs_struct& getRegisters() const;
+
     std::shared_ptr<ProcessInfo> traceeInfo_;
-    user_regs_struct regs_{};
+    mutable user_regs_struct regs_{};
+    mutable bool regsFetched_ = false;
+    bool regsDirty_ = false;
     bool signalSuppressed_ = false;
 
+    bool hasSeccompStopInfo_ = false;
+    uint64_t syscallNumber_{};
+    uint64_t syscallArguments_[6]{};
+    uint32_t seccompData_{};
+
+    bool notification_ = false;
+    bool syscallCancelled_ = false;
+    reg_t syscallReturnValue_{};
+
     Arch syscallArch_;
+
+    static bool syscallInfoSupported_;
 };
 
 } // namespace tracer
@@ -0,0 +1,56 @@
+#include <errno.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * Calls syscalls that ignore their arguments with a grid of argument values,
+ * printing a line of errno values for each syscall, 0 for calls that
+ * succeeded.
+ */
+static const long SYSCALLS[] = {
+        SYS_getuid, SYS_getgid, SYS_geteuid, SYS_getegid, SYS_gettid, SYS_getpid};
+static const unsigned long long VALUES[] = {
+        0,
+        5,
+        7,
+        0x7fffffff,
+        0x80000000,
+        0xffffffff,
+        0x100000000,
+        0x100000001,
+        0x1200000000,
+        0xff00000005,
+        ~0ULL,
+        3,
+        897,
+        900};
+
+#define COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+int main() {
+    for (size_t index = 0; index < COUNT(SYSCALLS); ++index) {
+        for (int arg = 0; arg < 6; ++arg) {
+            for (size_t first = 0; first < COUNT(VALUES); ++first) {
+                for (size_t second = 0; second < COUNT(VALUES); ++second) {
+                    unsigned long long args[6] = {0};
+                    args[arg] = VALUES[first];
+                    args[(arg + 1) % 6] = VALUES[second];
+                    long result = syscall(
+                            SYSCALLS[index],
+                            (long)args[0],
+                            (long)args[1],
+                            (long)args[2],
+                            (long)args[3],
+                            (long)args[4],
+                            (long)args[5]);
+                    printf("%s%d",
+                           arg == 0 && first == 0 && second == 0 ? "" : " ",
+                           result < 0 ? errno : 0);
+                }
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
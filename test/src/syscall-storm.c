@@ -0,0 +1,15 @@
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char** argv) {
+    int calls = argc > 1 ? atoi(argv[1]) : 1000;
+    int failed = 0;
+    for (int i = 0; i < calls; ++i) {
+        if (sched_yield() != 0) {
+            ++failed;
+        }
+    }
+    printf("%d\n", failed);
+    return 0;
+}
@@ -0,0 +1,56 @@
+import os
+import unittest
+
+from base.supervisor import SIO2Jail
+from base.paths import *
+
+# Delegated cgroup v2 directory, cgroup tests are skipped without it.
+CGROUP_PATH = os.environ.get('SIO2JAIL_CGROUP_PATH')
+
+
+@unittest.skipUnless(CGROUP_PATH, 'SIO2JAIL_CGROUP_PATH is not set')
+class TestCgroupMemory(unittest.TestCase):
+    MB = 1 * 1024
+    OPTIONS = ['--cgroup-path', CGROUP_PATH, '--memory-accounting', 'cgroup']
+
+    def setUp(self):
+        self.sio2jail = SIO2Jail()
+
+    def test_memory_limit_exceeded(self):
+        for program in ['leak-huge_64', 'leak-tiny_64', 'leak-dive_64']:
+            result = self.sio2jail.run(
+                    os.path.join(TEST_BIN_PATH, program),
+                    memory=16 * self.MB, extra_options=self.OPTIONS)
+            self.assertEqual(result.supervisor_return_code, 0)
+            self.assertGreater(result.memory, 16 * self.MB)
+            self.assertEqual('memory limit exceeded', result.message)
+
+    def test_memory_result(self):
+        result = self.sio2jail.run(
+                os.path.join(TEST_BIN_PATH, '1-sec-prog'),
+                extra_options=self.OPTIONS)
+        self.assertEqual(result.supervisor_return_code, 0)
+        self.assertGreater(result.memory, 0)
+        self.assertEqual('ok', result.message)
+
+
+@unittest.skipUnless(CGROUP_PATH, 'SIO2JAIL_CGROUP_PATH is not set')
+class TestCgroupTime(unittest.TestCase):
+    OPTIONS = ['--cgroup-path', CGROUP_PATH, '--time-accounting', 'cgroup']
+
+    def setUp(self):
+        self.sio2jail = SIO2Jail()
+
+    def test_time_result(self):
+        result = self.sio2jail.run(
+                os.path.join(TEST_BIN_PATH, '1-sec-prog'),
+                extra_options=self.OPTIONS + ['--output', 'oiuser'])
+        self.assertEqual(result.supervisor_return_code, 0)
+        self.assertAlmostEqual(result.time, 1.0, delta=0.5)
+
+    def test_time_limit_exceeded(self):
+        result = self.sio2jail.run(
+                os.path.join(TEST_BIN_PATH, 'infinite-loop'),
+                extra_options=self.OPTIONS + ['--utimelimit', '1s'])
+        self.assertEqual(result.supervisor_return_code, 0)
+        self.assertEqual('user time limit exceeded', result.message)
@@ -0,0 +1,162 @@
+import json
+import os
+import tempfile
+import unittest
+
+from base.supervisor import SIO2Jail
+from base.paths import *
+
+TRACEFS_PATHS = ['/sys/kernel/tracing', '/sys/kernel/debug/tracing']
+HAS_SYSCALL_TRACEPOINT = any(
+        os.path.exists(os.path.join(path, 'events/raw_syscalls/sys_enter'))
+        for path in TRACEFS_PATHS)
+
+
+class ReportLinesSIO2Jail(SIO2Jail):
+    """Keeps all lines of multi line reports, e.g. of profile format."""
+
+    def parse_results(self, result, stdout, stderr):
+        result.message = [
+                s.strip() for s in stderr.split('\n') if len(s.strip()) > 0]
+
+
+class TestPerfEvents(unittest.TestCase):
+    def setUp(self):
+        self.sio2jail = SIO2Jail()
+
+    def run_json(self, program, extra_options, arguments=()):
+        result = self.sio2jail.run(
+                [os.path.join(TEST_BIN_PATH, program)] + list(arguments),
+                memory='1G',
+                extra_options=['--output', 'json'] + extra_options)
+        self.assertEqual(result.supervisor_return_code, 0)
+        # Report is a single line, so it is left unparsed as message
+        return json.loads(result.message[-1])
+
+    def test_json_output(self):
+        report = self.run_json('1-sec-prog', [])
+        self.assertEqual(report['status'], 'OK')
+        self.assertEqual(report['message'], 'ok')
+        self.assertGreater(report['instructions'], 0)
+        self.assertEqual(report['perf_events'], {})
+        self.assertEqual(report['syscalls_histogram'], {})
+        # At least the initial stop and exec are traced
+        self.assertGreater(report['traced_stops'], 0)
+
+    def test_page_faults(self):
+        report = self.run_json(
+                '1-sec-prog', ['--perf-events', 'page-faults,minor-faults'])
+        self.assertGreater(report['perf_events']['page-faults'], 0)
+        self.assertLessEqual(
+                report['perf_events']['minor-faults'],
+                report['perf_events']['page-faults'])
+
+    def test_cache(self):
+        with tempfile.TemporaryDirectory() as cache:
+            def run_cached():
+                with tempfile.NamedTemporaryFile('r', suffix='.log') as log:
+                    report = self.run_json(
+                            '1-sec-prog',
+                            ['--perf-cache-dir', cache, '-l', log.name])
+                    self.assertEqual(report['status'], 'OK')
+                    self.assertGreater(report['instructions'], 0)
+                    return log.read()
+
+            self.assertNotIn('loaded from cache', run_cached())
+            (name,) = os.listdir(cache)
+            self.assertTrue(name.startswith('pmu-'))
+            self.assertIn('loaded from cache', run_cached())
+
+            with open(os.path.join(cache, name), 'w') as file:
+                file.write('not a pmu\n')
+            log = run_cached()
+            self.assertIn('Ignoring malformed perf cache file', log)
+            self.assertNotIn('loaded from cache', log)
+            self.assertIn('loaded from cache', run_cached())
+
+    def test_unknown_event(self):
+        result = self.sio2jail.run(
+                os.path.join(TEST_BIN_PATH, '1-sec-prog'),
+                extra_options=['--perf-events', 'no-such-event'])
+        self.assertNotEqual(result.supervisor_return_code, 0)
+
+    @unittest.skipUnless(HAS_SYSCALL_TRACEPOINT, 'tracefs is not mounted')
+    def test_syscall_count(self):
+        report = self.run_json('1-sec-prog', ['--syscall-stats', 'count'])
+        self.assertEqual(report['status'], 'OK')
+        self.assertGreater(report['syscalls'], 0)
+        self.assertEqual(report['perf_events'], {})
+        self.assertEqual(report['syscalls_histogram'], {})
+
+    @unittest.skipUnless(HAS_SYSCALL_TRACEPOINT, 'tracefs is not mounted')
+    def test_syscall_histogram(self):
+        report = self.run_json('1-sec-prog', ['--syscall-stats', 'histogram'])
+        self.assertEqual(report['status'], 'OK')
+        self.assertEqual(report['syscalls_histogram']['exit_group'], 1)
+        self.assertEqual(
+                sum(report['syscalls_histogram'].values()),
+                report['syscalls'])
+
+    def test_threads_instructions(self):
+        report = self.run_json('1-sec-prog-th', ['-t', 4], ['flat', 4])
+        self.assertEqual(report['status'], 'OK')
+        # Main thread followed by all four worker threads
+        self.assertEqual(len(report['threads_instructions']), 5)
+        self.assertEqual(
+                sum(report['threads_instructions']), report['instructions'])
+
+    def test_thread_instruction_count_limit(self):
+        options = ['-t', 4, '--thread-instruction-count-limit', '1g']
+        report = self.run_json('1-sec-prog-th', options, ['flat', 4])
+        self.assertEqual(report['status'], 'OK')
+        self.assertGreater(report['instructions'], 1000000000)
+
+        report = self.run_json('1-sec-prog-th', options, ['flat', 1])
+        self.assertEqual(report['status'], 'TLE')
+        self.assertEqual(report['message'], 'time limit exceeded')
+
+    def test_calibration_profile(self):
+        with tempfile.NamedTemporaryFile('w', suffix='.prof') as profile:
+            profile.write('instructions-per-second 1000000000\n')
+            profile.flush()
+            options = ['--calibration-profile', profile.name]
+
+            report = self.run_json('1-sec-prog', options)
+            self.assertEqual(
+                    report['time_ms'], report['instructions'] // 1000000)
+
+            report = self.run_json(
+                    'infinite-loop',
+                    options + ['--instruction-time-limit', '100ms'])
+            self.assertEqual(report['status'], 'TLE')
+            self.assertGreaterEqual(report['instructions'], 100000000)
+
+    def test_exact_instruction_count_limit(self):
+        options = ['--instruction-count-limit', '100m', '--perf-exact-limits']
+        report = self.run_json('infinite-loop', options)
+        self.assertEqual(report['status'], 'TLE')
+        self.assertGreaterEqual(report['instructions'], 100000000)
+        self.assertLess(report['instructions'], 105000000)
+
+        report = self.run_json(
+                '1-sec-prog',
+                ['--instruction-count-limit', '10g', '--perf-exact-limits'])
+        self.assertEqual(report['status'], 'OK')
+
+    def test_profile(self):
+        result = ReportLinesSIO2Jail().run(
+                os.path.join(TEST_BIN_PATH, '1-sec-prog'),
+                extra_options=[
+                        '--output', 'profile', '--perf-profile', 3,
+                        '--perf-profile-period', '100k'])
+        self.assertEqual(result.supervisor_return_code, 0)
+        self.assertIn('Result: ok', result.message)
+        samples = [line for line in result.message
+                   if line.startswith('Profile samples: ')]
+        self.assertEqual(len(samples), 1)
+        self.assertGreater(int(samples[0].split()[2]), 1000)
+        # Whole program is its main loop
+        entries = result.message[result.message.index(samples[0]) + 1:]
+        self.assertGreaterEqual(len(entries), 1)
+        self.assertLessEqual(len(entries), 3)
+        self.assertEqual(entries[0].split()[2], 'main')
@@ -0,0 +1,110 @@
+import os
+import tempfile
+import unittest
+
+from base.supervisor import SIO2Jail
+from base.paths import *
+
+POLICIES_PATH = os.path.join(SOURCE_PATH, 'policies')
+
+TRACEFS_PATHS = ['/sys/kernel/tracing', '/sys/kernel/debug/tracing']
+HAS_SYSCALL_TRACEPOINT = any(
+        os.path.exists(os.path.join(path, 'events/raw_syscalls/sys_enter'))
+        for path in TRACEFS_PATHS)
+
+
+class TestPolicyFile(unittest.TestCase):
+    def setUp(self):
+        self.sio2jail = SIO2Jail()
+
+    def run_policy(self, policy, program='sum_c', args=(), options=(),
+                   **kwargs):
+        with tempfile.NamedTemporaryFile('w', suffix='.policy') as file:
+            file.write(policy)
+            file.flush()
+            return self.sio2jail.run(
+                    [os.path.join(TEST_BIN_PATH, program)] + list(args),
+                    extra_options=['--policy-file', file.name] +
+                    list(options), **kwargs)
+
+    def test_shipped_policies(self):
+        for policy in ['c.policy', 'java.policy']:
+            result = self.sio2jail.run(
+                    os.path.join(TEST_BIN_PATH, 'sum_c'),
+                    stdin='18 24',
+                    extra_options=[
+                        '--policy-file', os.path.join(POLICIES_PATH, policy)])
+            self.assertEqual(result.stdout[0], '42')
+            self.assertEqual('ok', result.message)
+
+    def test_override(self):
+        result = self.run_policy(
+                'include <default>\nread kill\n', stdin='18 24')
+        self.assertIn('intercepted forbidden syscall', result.message)
+
+        result = self.run_policy(
+                'include <default>\nread kill\nread allow arg0 == 0\n',
+                stdin='18 24')
+        self.assertEqual(result.stdout[0], '42')
+        self.assertEqual('ok', result.message)
+
+    def test_exit_allowed(self):
+        result = self.run_policy(
+                'include <default>\nexit_group allow\n', stdin='18 24',
+                memory=64 * 1024)
+        self.assertEqual(result.stdout[0], '42')
+        self.assertEqual('ok', result.message)
+
+    def test_invalid_policy(self):
+        for policy in ['read allow arg6 == 0\n', 'read deny\n',
+                       'include missing.policy\n', 'no_such_syscall allow\n']:
+            result = self.run_policy(policy, stdin='18 24')
+            self.assertNotEqual(result.supervisor_return_code, 0)
+
+    def test_errno_budget(self):
+        result = self.run_policy(
+                'include <default>\nsched_yield budget 1000 errno EAGAIN\n',
+                program='syscall-storm', args=[2000])
+        self.assertEqual(result.stdout[0], '1000')
+        self.assertEqual('ok', result.message)
+
+    def test_number_bases(self):
+        for budget, failed in [('010', '10'), ('0x10', '4')]:
+            result = self.run_policy(
+                    'include <default>\nsched_yield budget {} errno EAGAIN\n'
+                    .format(budget), program='syscall-storm', args=[20])
+            self.assertEqual(result.stdout[0], failed)
+            self.assertEqual('ok', result.message)
+
+    def check_kill_budget(self, options=()):
+        policy = 'include <default>\nsched_yield budget 1000 kill\n'
+        for calls in [500, 1000]:
+            result = self.run_policy(
+                    policy, program='syscall-storm', args=[calls],
+                    options=options)
+            self.assertEqual(result.stdout[0], '0')
+            self.assertEqual('ok', result.message)
+
+        for calls in [1001, 1500, 100000]:
+            result = self.run_policy(
+                    policy, program='syscall-storm', args=[calls],
+                    options=options)
+            self.assertEqual(
+                    'syscall budget of sched_yield exceeded', result.message)
+
+    def test_kill_budget(self):
+        self.check_kill_budget()
+
+    def test_kill_budget_without_ptrace(self):
+        self.check_kill_budget(['--ptrace', 'off', '--seccomp-notify', 'on'])
+
+    @unittest.skipUnless(HAS_SYSCALL_TRACEPOINT, 'tracefs is not mounted')
+    def test_unrelated_budget_with_histogram(self):
+        # Histogram records all syscalls and loses many of them, which must
+        # not be taken for calls of the budgeted one.
+        result = self.run_policy(
+                'include <default>\ngetpid budget 10 kill\n',
+                program='syscall-storm', args=[1000000],
+                options=['--syscall-stats', 'histogram'])
+        self.assertEqual(result.stdout[0], '0')
+        self.assertEqual('ok', result.message)
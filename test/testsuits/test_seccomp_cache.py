@@ -0,0 +1,86 @@
+import os
+import struct
+import tempfile
+import unittest
+
+from base.supervisor import SIO2Jail
+from base.paths import *
+
+
+class TestSeccompCache(unittest.TestCase):
+    def setUp(self):
+        self.sio2jail = SIO2Jail()
+        self.cache = tempfile.TemporaryDirectory()
+        self.addCleanup(self.cache.cleanup)
+
+    def run_cached(self, policy, compiler='libseccomp'):
+        with tempfile.NamedTemporaryFile('w', suffix='.policy') as file, \
+                tempfile.NamedTemporaryFile('r', suffix='.log') as log:
+            file.write(policy)
+            file.flush()
+            result = self.sio2jail.run(
+                    os.path.join(TEST_BIN_PATH, 'sum_c'),
+                    stdin='18 24',
+                    extra_options=['--policy-file', file.name,
+                                   '--seccomp-compiler', compiler,
+                                   '--seccomp-cache-dir', self.cache.name,
+                                   '-l', log.name])
+            result.log = log.read()
+            return result
+
+    def cache_files(self):
+        return sorted(os.listdir(self.cache.name))
+
+    def test_hit(self):
+        for policy, message in [('include <default>\n', 'ok'),
+                                ('include <default>\nread kill\n',
+                                 'intercepted forbidden syscall')]:
+            for compiler in ['builtin', 'libseccomp']:
+                miss = self.run_cached(policy, compiler)
+                hit = self.run_cached(policy, compiler)
+                self.assertIn('Seccomp filter cache miss', miss.log)
+                self.assertIn('Seccomp filter cache hit', hit.log)
+                for result in [miss, hit]:
+                    self.assertIn(message, result.message)
+                self.assertEqual(miss.stdout, hit.stdout)
+
+    def test_keys(self):
+        self.run_cached('include <default>\n')
+        self.assertEqual(len(self.cache_files()), 1)
+        self.run_cached('include <default>\nread kill\n')
+        self.assertEqual(len(self.cache_files()), 2)
+        self.run_cached('include <default>\nread kill\n', 'builtin')
+        self.assertEqual(len(self.cache_files()), 3)
+
+    def test_invalid_file(self):
+        self.run_cached('include <default>\nread kill\n')
+        (path,) = [os.path.join(self.cache.name, name)
+                   for name in self.cache_files()]
+        # Not a whole number of instructions, and a program that doesn't
+        # return.
+        for content in [b'\x06\x00', struct.pack('<HBBI', 0x20, 0, 0, 0)]:
+            with open(path, 'wb') as file:
+                file.write(content)
+            result = self.run_cached('include <default>\nread kill\n')
+            self.assertIn('intercepted forbidden syscall', result.message)
+            self.assertIn('Ignoring', result.log)
+            self.assertIn('Seccomp filter cache miss', result.log)
+            result = self.run_cached('include <default>\nread kill\n')
+            self.assertIn('Seccomp filter cache hit', result.log)
+
+    def test_writable_by_others(self):
+        self.run_cached('include <default>\n')
+        (path,) = [os.path.join(self.cache.name, name)
+                   for name in self.cache_files()]
+        os.chmod(path, 0o666)
+        result = self.run_cached('include <default>\n')
+        self.assertEqual('ok', result.message)
+        self.assertIn('writable by other users', result.log)
+        self.assertIn('Seccomp filter cache miss', result.log)
+
+        os.chmod(self.cache.name, 0o777)
+        for _ in range(2):
+            result = self.run_cached('include <default>\n')
+            self.assertEqual('ok', result.message)
+            self.assertIn('writable by other users', result.log)
+            self.assertNotIn('Seccomp filter cache hit', result.log)
@@ -0,0 +1,151 @@
+import os
+import tempfile
+import unittest
+
+from base.supervisor import SIO2Jail
+from base.paths import *
+
+TRACEFS_PATHS = ['/sys/kernel/tracing', '/sys/kernel/debug/tracing']
+HAS_SYSCALL_TRACEPOINT = any(
+        os.path.exists(os.path.join(path, 'events/raw_syscalls/sys_enter'))
+        for path in TRACEFS_PATHS)
+
+
+class TestSeccompCompiler(unittest.TestCase):
+    MB = 1 * 1024
+    COMPILERS = ['builtin', 'libseccomp']
+
+    # Argument values seccomp-grid calls its syscalls with
+    GRID_VALUES = [0, 5, 7, 0x7fffffff, 0x80000000, 0xffffffff, 0x100000000,
+                   0x100000001, 0x1200000000, 0xff00000005, 2**64 - 1, 3,
+                   897, 900]
+    # Syscalls called by seccomp-grid in order, each allowed unless the
+    # conditions of one of its rules are met, then failing with errno. Many
+    # rules of getpid make jumps longer than 255 instructions.
+    GRID_RULES = [
+        ('getuid', 1, ['arg0 == 0x100000000'],
+         lambda a: a[0] == 0x100000000),
+        ('getgid', 2, ['arg1 & 0xff00000000 == 0x1200000000'],
+         lambda a: a[1] & 0xff00000000 == 0x1200000000),
+        ('geteuid', 3, ['arg2 != 5 arg3 > 0xffffffff'],
+         lambda a: a[2] != 5 and a[3] > 0xffffffff),
+        ('getegid', 4, ['arg4 < 0x100000001 arg5 >= 0x80000000'],
+         lambda a: a[4] < 0x100000001 and a[5] >= 0x80000000),
+        ('gettid', 5, ['arg0 <= 7'], lambda a: a[0] <= 7),
+        ('getpid', 6, ['arg1 == {}'.format(3 * n) for n in range(300)],
+         lambda a: a[1] % 3 == 0 and a[1] < 900),
+    ]
+
+    def setUp(self):
+        self.sio2jail = SIO2Jail()
+
+    def _options(self, compiler):
+        return ['--seccomp-compiler', compiler]
+
+    def _grid_policy(self):
+        lines = ['include <default>']
+        for (syscall, error, conditions, _) in self.GRID_RULES:
+            lines.append('{} allow'.format(syscall))
+            lines.extend('{} errno {} {}'.format(syscall, error, condition)
+                         for condition in conditions)
+        return '\n'.join(lines) + '\n'
+
+    def _grid_errors(self):
+        lines = []
+        for (_, error, _, condition) in self.GRID_RULES:
+            errors = []
+            for arg in range(6):
+                for first in self.GRID_VALUES:
+                    for second in self.GRID_VALUES:
+                        args = [0] * 6
+                        args[arg] = first
+                        args[(arg + 1) % 6] = second
+                        errors.append(str(error) if condition(args) else '0')
+            lines.append(' '.join(errors))
+        return lines
+
+    def test_sum(self):
+        for compiler in self.COMPILERS:
+            result = self.sio2jail.run(
+                    os.path.join(TEST_BIN_PATH, 'sum_c'),
+                    stdin='18 24', extra_options=self._options(compiler))
+            self.assertEqual(result.stdout[0], '42')
+            self.assertEqual('ok', result.message)
+
+    def test_32bit(self):
+        for compiler in self.COMPILERS:
+            result = self.sio2jail.run(
+                    os.path.join(TEST_BIN_PATH, '1-sec-prog'),
+                    extra_options=self._options(compiler))
+            self.assertEqual('ok', result.message)
+
+    def test_memory_limit_exceeded(self):
+        for compiler in self.COMPILERS:
+            for program in ['leak-huge_64', 'leak-tiny_32']:
+                result = self.sio2jail.run(
+                        os.path.join(TEST_BIN_PATH, program),
+                        memory=16 * self.MB,
+                        extra_options=self._options(compiler))
+                self.assertEqual(result.supervisor_return_code, 0)
+                self.assertEqual('memory limit exceeded', result.message)
+
+    def test_conditions_grid(self):
+        with tempfile.NamedTemporaryFile('w', suffix='.policy') as policy:
+            policy.write(self._grid_policy())
+            policy.flush()
+            for program in ['seccomp-grid_64', 'seccomp-grid_32']:
+                errors = []
+                for compiler in self.COMPILERS:
+                    result = self.sio2jail.run(
+                            os.path.join(TEST_BIN_PATH, program),
+                            extra_options=self._options(compiler) +
+                            ['--policy-file', policy.name])
+                    self.assertEqual('ok', result.message)
+                    errors.append(result.stdout[:len(self.GRID_RULES)])
+                self.assertEqual(errors[0], errors[1])
+                if program == 'seccomp-grid_64':
+                    self.assertEqual(errors[0], self._grid_errors())
+
+    def test_disassembled_filter(self):
+        with tempfile.NamedTemporaryFile('r', suffix='.log') as log:
+            result = self.sio2jail.run(
+                    os.path.join(TEST_BIN_PATH, 'sum_c'),
+                    stdin='18 24',
+                    extra_options=self._options('builtin') + ['-l', log.name])
+            self.assertEqual('ok', result.message)
+            filter = log.read()
+            self.assertIn('bpf instructions', filter)
+            self.assertIn('ld [arch]', filter)
+            self.assertIn('ret ALLOW', filter)
+
+    def test_syscall_profile(self):
+        with tempfile.NamedTemporaryFile('w', suffix='.prof') as profile:
+            profile.write('write 1000\nread 500\nbrk 3\nunknown 1\n')
+            profile.flush()
+            for compiler in self.COMPILERS:
+                result = self.sio2jail.run(
+                        os.path.join(TEST_BIN_PATH, 'sum_c'),
+                        stdin='18 24',
+                        extra_options=self._options(compiler) +
+                        ['--seccomp-profile', profile.name])
+                self.assertEqual(result.stdout[0], '42')
+                self.assertEqual('ok', result.message)
+
+    @unittest.skipUnless(HAS_SYSCALL_TRACEPOINT, 'tracefs is not mounted')
+    def test_record_syscall_profile(self):
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, 'syscalls.prof')
+            for run in range(2):
+                result = self.sio2jail.run(
+                        os.path.join(TEST_BIN_PATH, 'sum_c'),
+                        stdin='18 24',
+                        extra_options=['--seccomp-profile-record', path])
+                self.assertEqual('ok', result.message)
+
+            with open(path) as profile:
+                counts = dict(
+                        (line.split()[0], int(line.split()[1]))
+                        for line in profile)
+            self.assertEqual(counts['exit_group'], 2)
+            self.assertGreaterEqual(counts['read'], 2)
+            self.assertGreaterEqual(counts['write'], 2)
@@ -0,0 +1,36 @@
+import os
+import unittest
+
+from base.supervisor import SIO2Jail
+from base.paths import *
+
+
+class TestSeccompNotify(unittest.TestCase):
+    MB = 1 * 1024
+    OPTIONS = ['--seccomp-notify', 'on']
+
+    def setUp(self):
+        self.sio2jail = SIO2Jail()
+
+    def test_sum(self):
+        result = self.sio2jail.run(
+                os.path.join(TEST_BIN_PATH, 'sum_c'),
+                stdin='18 24', extra_options=self.OPTIONS)
+        self.assertEqual(result.stdout[0], '42')
+        self.assertEqual('ok', result.message)
+
+    def test_memory_limit_exceeded(self):
+        for program in ['leak-huge_64', 'leak-tiny_32']:
+            result = self.sio2jail.run(
+                    os.path.join(TEST_BIN_PATH, program),
+                    memory=16 * self.MB, extra_options=self.OPTIONS)
+            self.assertEqual(result.supervisor_return_code, 0)
+            self.assertGreater(result.memory, 16 * self.MB)
+            self.assertEqual('memory limit exceeded', result.message)
+
+    def test_memory_result(self):
+        result = self.sio2jail.run(
+                os.path.join(TEST_BIN_PATH, '1-sec-prog'),
+                extra_options=self.OPTIONS)
+        self.assertGreater(result.memory, 0)
+        self.assertEqual('ok', result.message)
@@ -0,0 +1,127 @@
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import tempfile
+import time
+import unittest
+
+from base.supervisor import SIO2Jail
+from base.paths import *
+
+
+class TestServe(unittest.TestCase):
+    C_PROGRAM_PATH = os.path.join(TEST_BIN_PATH, 'sum_c')
+
+    def setUp(self):
+        self.directory = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.directory)
+
+    def serve(self, jobs, options=()):
+        process = subprocess.Popen(
+                [SIO2Jail.SUPERVISOR_BIN, '--serve'] + list(options),
+                stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE,
+                stderr=subprocess.PIPE)
+        (_, stderr) = process.communicate(
+                '\n'.join(jobs).encode('utf-8'))
+        self.assertEqual(process.returncode, 0)
+        return self.parse_results(stderr)
+
+    def parse_results(self, data):
+        results = []
+        while data:
+            (header, data) = data.split(b'\n', 1)
+            (tag, number, status, length) = header.decode('utf-8').split()
+            self.assertEqual(tag, '__JOB__')
+            self.assertEqual(int(number), len(results) + 1)
+            results.append((int(status), data[:int(length)].decode('utf-8')))
+            data = data[int(length):]
+        return results
+
+    def start_server(self, path):
+        process = subprocess.Popen(
+                [SIO2Jail.SUPERVISOR_BIN, '--serve-socket', path],
+                stdout=subprocess.DEVNULL,
+                stderr=subprocess.DEVNULL)
+        for _ in range(100):
+            try:
+                return (process, self.submit(path, []))
+            except (ConnectionRefusedError, FileNotFoundError):
+                time.sleep(0.05)
+        process.kill()
+        self.fail('server is not listening on {}'.format(path))
+
+    def submit(self, path, jobs):
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as client:
+            client.connect(path)
+            client.sendall('\n'.join(jobs).encode('utf-8'))
+            client.shutdown(socket.SHUT_WR)
+            data = b''
+            while True:
+                chunk = client.recv(4096)
+                if not chunk:
+                    return self.parse_results(data)
+                data += chunk
+
+    def job(self, index, numbers):
+        input_path = os.path.join(self.directory, '{}.in'.format(index))
+        output_path = os.path.join(self.directory, '{}.out'.format(index))
+        with open(input_path, 'w') as input_file:
+            input_file.write(numbers)
+        return ' '.join([
+            '-b', SIO2Jail.MINIMAL_BOX_PATH + ':/:ro',
+            '--stdin', input_path, '--stdout', output_path,
+            self.C_PROGRAM_PATH])
+
+    def output(self, index):
+        with open(os.path.join(self.directory, '{}.out'.format(index))) as f:
+            return f.read().strip()
+
+    def test_many_jobs(self):
+        results = self.serve([
+            self.job(1, '18 24'),
+            '',
+            '# comment',
+            self.job(2, '1 2')])
+        self.assertEqual(len(results), 2)
+        for (status, report) in results:
+            self.assertEqual(status, 0)
+            self.assertEqual(report.split('\n')[0].split()[1], '0')
+        self.assertEqual(self.output(1), '42')
+        self.assertEqual(self.output(2), '3')
+
+    def test_invalid_job(self):
+        results = self.serve([
+            '--memory-limit',
+            self.job(1, '18 24')])
+        self.assertEqual(len(results), 2)
+        self.assertEqual(results[0][0], 1)
+        self.assertEqual(results[1][0], 0)
+        self.assertEqual(self.output(1), '42')
+
+    def test_shared_seccomp_cache(self):
+        cache_directory = os.path.join(self.directory, 'cache')
+        os.mkdir(cache_directory)
+        results = self.serve(
+                [self.job(1, '18 24'), self.job(2, '1 2')],
+                ['--seccomp-cache-dir', cache_directory])
+        self.assertEqual([status for (status, _) in results], [0, 0])
+        self.assertEqual(self.output(2), '3')
+        self.assertEqual(len(os.listdir(cache_directory)), 1)
+
+    def test_socket_restart(self):
+        path = os.path.join(self.directory, 'serve.sock')
+        # Killed server leaves its socket behind, stopped one removes it
+        for stop_signal in [signal.SIGKILL, signal.SIGTERM]:
+            (process, _) = self.start_server(path)
+            results = self.submit(path, [self.job(1, '18 24')])
+            self.assertEqual(results[0][0], 0)
+            self.assertEqual(self.output(1), '42')
+            process.send_signal(stop_signal)
+            process.wait()
+        self.assertEqual(process.returncode, 0)
+        self.assertFalse(os.path.exists(path))
@@ -36,3 +36,48 @@ class TestReportedTimes(unittest.TestCase):
             memory='1G',
             extra_options=['-t', 15])
         self.assertAlmostEqual(result.time, 1.0)
+
+
+class TestTimeLimits(unittest.TestCase):
+    LOOP_PROGRAM_PATH = os.path.join(TEST_BIN_PATH, 'infinite-loop')
+
+    def setUp(self):
+        self.sio2jail = SIO2Jail()
+
+    def _run_time_limit_test(self, limit_option, message, extra_options):
+        result = self.sio2jail.run(
+            self.LOOP_PROGRAM_PATH,
+            extra_options=[limit_option, '500ms', '--output', 'oiuser']
+            + extra_options)
+        self.assertEqual(result.supervisor_return_code, 0)
+        self.assertEqual(message, result.message)
+        return result
+
+    def test_user_time_limit(self):
+        self._run_time_limit_test(
+            '--utimelimit', 'user time limit exceeded', [])
+
+    def test_user_time_limit_cpu_clock_timer(self):
+        result = self._run_time_limit_test(
+            '--utimelimit', 'user time limit exceeded',
+            ['--cpu-clock-timer', 'on'])
+        self.assertAlmostEqual(result.time, 0.5, delta=0.05)
+
+    def test_user_system_time_limit_cpu_clock_timer(self):
+        self._run_time_limit_test(
+            '--ustimelimit', 'user+system time limit exceeded',
+            ['--cpu-clock-timer', 'on'])
+
+    def test_single_timer_interval(self):
+        for interval in [['--timer-max-interval', '500us'],
+                         ['--timer-min-interval', '1s']]:
+            self._run_time_limit_test(
+                '--utimelimit', 'user time limit exceeded', interval)
+
+    def test_conflicting_timer_intervals(self):
+        result = self.sio2jail.run(
+            self.LOOP_PROGRAM_PATH,
+            extra_options=['--utimelimit', '500ms',
+                           '--timer-min-interval', '2ms',
+                           '--timer-max-interval', '1ms'])
+        self.assertNotEqual(result.supervisor_return_code, 0)